@@ -3,64 +3,96 @@
 
 #include <thread>
 #include <memory>
+#include <chrono>
+#include <future>
 #include <boost/asio.hpp>
+#include <boost/utility/base_from_member.hpp>
+#include "common/debug.h"
 #include "common/socketwrapper.h"
 
 /** Asynchronous IP socket client.
  * Needs to be inherited with some virtual methods defined.
  * Works in the other thread, some methods are not thread-safe.
+ * Derived class should call Disconnect() in its destructor: completion
+ * handlers of derived class may run until then.
  */
 template <class Protocol>
- class IPClient : public SocketWrapper<typename Protocol::socket> {
+ class IPClient : private boost::base_from_member<boost::asio::io_service>,
+                  public SocketWrapper<Protocol> {
 public:
-  IPClient() noexcept : SocketWrapper<typename Protocol::socket>(io_service_) { }
+  static const std::chrono::milliseconds kDefaultDrainTimeout;
+
+  // io_service is a base to be constructed before socket
+  IPClient() noexcept : SocketWrapper<Protocol>(member) { }
+
+  ~IPClient() {
+    AssertMsg(!thread_, "Derived class should call Disconnect() in its destructor");
+  }
 
   /** Starts asynchronous connection to endpoint.
    * If we are already connected, closes existing connection.
    * Not thread-safe.
    */
   void Connect(typename Protocol::endpoint &&endpoint) {
-    using namespace std;
-
-    if (socket()) disconnect();
-    if (thread_) {
-      thread_->join();
-    }
-    socket().reset(new typename Protocol::socket(io_service_));
-    boost::system::error_code error;
-    socket()->async_connect(endpoint, std::bind(&HandlePreConnected, this));
-    thread_.reset(new thread(bind((size_t(io_service::*)())&io_service::run, &io_service_)));
+    Disconnect();
+    io_service_.reset();
+    this->socket().async_connect(endpoint, [this](const boost::system::error_code &error) {
+                                   HandlePreConnected(error);
+                                 });
+    std::promise<void> finished;
+    finished_ = finished.get_future();
+    thread_.reset(new std::thread([this](std::promise<void> &&finished) {
+                                    io_service_.run();
+                                    finished.set_value();
+                                  }, std::move(finished)));
   }
 
-  /** Starts asynchronous disconnection.
+  /** Stops reading, lets pending writes finish and disconnects.
+   * Writes which are not complete after drain timeout are aborted.
+   * Waits for client thread to finish; should not be called from it.
    * Does nothing if we are not connected.
    * Not thread-safe.
+   * \return true if all pending operations completed before timeout
    */
-  void Disconnect() {
-    // Same problems as in IPServer; we cannot receive any callback
-    // when io_service will really stop working (to clean up)
-    // and I'm too lazy to write my own Run()
-    // TODO(abbradar) maybe later
-    if (!socket_) return;
+  bool Disconnect(std::chrono::milliseconds drain_timeout = kDefaultDrainTimeout) {
+    if (!thread_) return true;
     PrepareDisconnect();
-    socket()->close();
+    // Socket is used by client thread, so it is shut down from there.
+    // Pending read completes with EOF, writes go on.
+    io_service_.post([this]() {
+                       boost::system::error_code error;
+                       this->socket().shutdown(Protocol::socket::shutdown_receive, error);
+                     });
+    // Thread finishes as soon as there are no more operations
+    bool drained = finished_.wait_for(drain_timeout) == std::future_status::ready;
+    if (!drained) {
+      // Aborts what is left
+      io_service_.post([this]() {
+                         boost::system::error_code error;
+                         this->socket().close(error);
+                       });
+    }
+    thread_->join();
+    thread_.reset();
+    boost::system::error_code error;
+    this->socket().close(error);
+    // Handlers posted after thread ran out of work should not run on next connection
+    io_service_.reset();
+    io_service_.poll();
+    return drained;
   }
 
-  inline bool connected() const noexcept {
-    if (socket()) {
-      return socket().is_open();
-    } else {
-      return false;
-    }
+  inline bool connected() noexcept {
+    return this->socket().is_open();
   }
 
 protected:
   virtual void HandleConnected() = 0;
   virtual void PrepareDisconnect() {};
-  virtual void HandleError(boost::system::error_code &e) {};
+  virtual void HandleError(const boost::system::error_code &e) {};
 
 private:
-  void HandlePreConnected(boost::system::error_code &e) {
+  void HandlePreConnected(const boost::system::error_code &e) {
     if (!e) {
       HandleConnected();
     } else {
@@ -68,9 +100,12 @@ private:
     }
   }
 
-  boost::asio::io_service io_service_;
-  typename Protocol::socket socket_;
+  boost::asio::io_service &io_service_ = member;
   std::unique_ptr<std::thread> thread_;
+  std::future<void> finished_; ///< Ready when thread_ leaves io_service::run()
 };
 
+template <class Protocol>
+ const std::chrono::milliseconds IPClient<Protocol>::kDefaultDrainTimeout(1000);
+
 #endif // YOBAHACK_CLIENT_IPCLIENT_H_
@@ -0,0 +1,78 @@
+#include <chrono>
+#include <memory>
+#include "ipclienttest.h"
+
+using namespace std;
+using namespace std::chrono;
+
+void TestedIPClient::HandleConnected() {
+  Write(boost::asio::buffer(data_), [this](const boost::system::error_code &error, size_t bytes_transferred) {
+          written += bytes_transferred;
+          write_failed = static_cast<bool>(error);
+        });
+  ReadSome(boost::asio::buffer(buffer_), [this](const boost::system::error_code &, size_t) {
+             read_finished = true;
+           });
+  started = true;
+}
+
+bool TestedIPClient::WaitStarted(milliseconds timeout) {
+  steady_clock::time_point deadline = steady_clock::now() + timeout;
+  while (!started) {
+    if (steady_clock::now() >= deadline) return false;
+    this_thread::sleep_for(milliseconds(1));
+  }
+  return true;
+}
+
+void IPClientTest::AcceptAndRead() {
+  received_ = 0;
+  shared_ptr<GameProtocol::socket> socket = make_shared<GameProtocol::socket>(io_service_);
+  acceptor_.accept(*socket);
+  reader_ = thread([this, socket]() {
+                     char buffer[65536];
+                     boost::system::error_code error;
+                     while (!error) {
+                       received_ += socket->read_some(boost::asio::buffer(buffer), error);
+                     }
+                   });
+}
+
+void IPClientTest::JoinReader() {
+  if (reader_.joinable()) reader_.join();
+}
+
+TEST_F(IPClientTest, DrainReconnect) {
+  const string data(4 << 20, 'x');
+  TestedIPClient client(data);
+  for (int round = 0; round < 2; ++round) {
+    client.written = 0;
+    client.read_finished = false;
+    client.started = false;
+    client.Connect(endpoint());
+    AcceptAndRead();
+    ASSERT_TRUE(client.WaitStarted(seconds(1)));
+    // Pending write is finished before client thread stops
+    ASSERT_TRUE(client.Disconnect(seconds(5)));
+    ASSERT_FALSE(client.connected());
+    ASSERT_EQ(client.written, data.size());
+    ASSERT_FALSE(client.write_failed);
+    ASSERT_TRUE(client.read_finished);
+    JoinReader();
+    ASSERT_EQ(received_, data.size());
+  }
+}
+
+TEST_F(IPClientTest, DrainTimeout) {
+  // Nobody reads, so the write cannot complete
+  const string data(64 << 20, 'x');
+  TestedIPClient client(data);
+  client.Connect(endpoint());
+  GameProtocol::socket peer(io_service_);
+  acceptor_.accept(peer);
+  ASSERT_TRUE(client.WaitStarted(seconds(1)));
+  ASSERT_FALSE(client.Disconnect(milliseconds(100)));
+  ASSERT_FALSE(client.connected());
+  ASSERT_TRUE(client.write_failed);
+  ASSERT_LT(client.written, data.size());
+}
@@ -0,0 +1,62 @@
+#ifndef YOBAHACK_TESTS_IPCLIENTTEST_H_
+#define YOBAHACK_TESTS_IPCLIENTTEST_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <gtest/gtest.h>
+#include "common/defs.h"
+#include "client/ipclient.h"
+
+/** Writes given data as soon as it is connected and keeps one read pending */
+class TestedIPClient : public IPClient<GameProtocol> {
+ public:
+  explicit TestedIPClient(const std::string &data) : data_(data) { }
+
+  ~TestedIPClient() {
+    Disconnect();
+  }
+
+  /** Waits until HandleConnected() has started the operations */
+  bool WaitStarted(std::chrono::milliseconds timeout);
+
+  std::atomic<bool> started{false};
+  std::atomic<std::size_t> written{0};
+  std::atomic<bool> write_failed{false};
+  std::atomic<bool> read_finished{false};
+
+ protected:
+  virtual void HandleConnected();
+
+ private:
+  std::string data_;
+  char buffer_[64];
+};
+
+class IPClientTest : public testing::Test {
+ public:
+  IPClientTest() : acceptor_(io_service_, GameProtocol::endpoint(boost::asio::ip::address_v4::loopback(), 0)) { }
+
+ protected:
+  /** Accepts next connection and reads it until EOF in background,
+   * counting bytes in received_
+   */
+  void AcceptAndRead();
+
+  /** Waits for reader started by AcceptAndRead() */
+  void JoinReader();
+
+  inline GameProtocol::endpoint endpoint() const {
+    return acceptor_.local_endpoint();
+  }
+
+  boost::asio::io_service io_service_;
+  GameProtocol::acceptor acceptor_;
+  std::thread reader_;
+  std::atomic<std::size_t> received_{0};
+};
+
+#endif // YOBAHACK_TESTS_IPCLIENTTEST_H_
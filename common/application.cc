@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <exception>
 #include <string>
+#include "common/flightrecorder.h"
 #include "common/logging.h"
 #include "application.h"
 
@@ -17,9 +18,7 @@ int Application::Run(int argc, const char **argv) noexcept
   try {
     return runnable_->Run(argc, argv);
   } catch (exception &e) {
-    string s("Unhandled exception: ");
-    s.append(e.what());
-    LogCritical(s.c_str());
+    LogCritical("Unhandled exception: {}", e.what());
     Abort();
   }
   return 1;
@@ -36,6 +35,7 @@ void Application::Terminate(int error_code) noexcept
 void Application::Abort() noexcept
 {
   // TODO(abbradar) maybe better handling there, and maybe not
+  logging::FlightRecorder::instance().Dump();
   abort();
 }
 
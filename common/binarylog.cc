@@ -0,0 +1,442 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "binarylog.h"
+#include "messagecodec.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+const size_t BinaryLog::kDefaultFileSize;
+const size_t BinaryLog::kMinFileSize;
+
+namespace {
+
+/** File starts with header record; it is read in host order, so file of
+ * host with other byte order is rejected by its magic
+ */
+const uint32_t kMagic = 0x4c424859;
+const uint16_t kVersion = 1;
+
+enum RecordKind : uint8_t {
+  kHeaderRecord = 1, ///< Magic, version, wall and steady time of start, logger name
+  kFormatRecord = 2, ///< Format id, line, length of file name, file name, format
+  kEventRecord = 3, ///< Format id, steady time, arguments
+  kThreadRecord = 4, ///< Id of thread of following events
+};
+
+/** Every record starts with this */
+struct RecordPrefix {
+  uint16_t size; ///< Of whole record; zero marks end of data
+  uint8_t kind;
+  uint8_t level; ///< Of event record
+};
+
+struct EventHeader {
+  RecordPrefix prefix;
+  uint32_t id; ///< Format id; ready message has 0, and its text is the only argument
+  int64_t time; ///< Nanoseconds of steady clock
+};
+
+const size_t kMaxRecord = numeric_limits<uint16_t>::max();
+const size_t kMaxFileName = 1024;
+
+/** Format strings of call sites; the same for all binary logs, as id is kept by site */
+struct FormatRegistry {
+  struct Definition {
+    const char *file;
+    int line;
+    const char *format;
+  };
+
+  std::mutex mutex;
+  deque<Definition> definitions; ///< Id is index plus one
+};
+
+inline FormatRegistry &Registry() {
+  static FormatRegistry registry;
+  return registry;
+}
+
+uint32_t RegisterFormat(LogSite &site, const char *format) {
+  FormatRegistry &registry = Registry();
+  lock_guard<mutex> lock(registry.mutex);
+  uint32_t id = site.format_id.load(memory_order_relaxed);
+  if (id != 0) return id;
+  registry.definitions.push_back({site.file, site.line, format});
+  id = static_cast<uint32_t>(registry.definitions.size());
+  site.format_id.store(id, memory_order_release);
+  return id;
+}
+
+template <class T> inline void Put(MessageWriter &writer, T value) noexcept {
+  writer.WriteBytes(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <class T> inline void Get(MessageReader &reader, T &value) noexcept {
+  const char *bytes = reader.ReadBytes(sizeof(value));
+  if (bytes) memcpy(&value, bytes, sizeof(value));
+}
+
+/** Formats next argument; returns false if it is malformed */
+bool FormatEncoded(LogBuffer &buffer, MessageReader &reader) noexcept {
+  uint8_t type = 0;
+  reader.ReadByte(type);
+  switch (type) {
+    case LogArguments::kSigned: {
+      int64_t value = 0;
+      Get(reader, value);
+      FormatArgument(buffer, value);
+      break;
+    }
+    case LogArguments::kUnsigned: {
+      uint64_t value = 0;
+      Get(reader, value);
+      FormatArgument(buffer, value);
+      break;
+    }
+    case LogArguments::kDouble: {
+      double value = 0;
+      Get(reader, value);
+      FormatArgument(buffer, value);
+      break;
+    }
+    case LogArguments::kBool: {
+      uint8_t value = 0;
+      reader.ReadByte(value);
+      FormatArgument(buffer, value != 0);
+      break;
+    }
+    case LogArguments::kChar: {
+      uint8_t value = 0;
+      reader.ReadByte(value);
+      FormatArgument(buffer, static_cast<char>(value));
+      break;
+    }
+    case LogArguments::kString: {
+      uint16_t size = 0;
+      Get(reader, size);
+      const char *data = reader.ReadBytes(size);
+      if (data) buffer.Append(data, size);
+      break;
+    }
+    default:
+      reader.Fail();
+  }
+  return !reader.failed();
+}
+
+}
+
+size_t BinaryLog::WriteHeader(char *data, size_t capacity, const char *name) noexcept {
+  MessageWriter writer(data, min(capacity, kMaxRecord));
+  size_t name_size = min(strlen(name), kMaxFileName);
+  timespec wall;
+  clock_gettime(CLOCK_REALTIME, &wall);
+  Put(writer, RecordPrefix{ static_cast<uint16_t>(sizeof(RecordPrefix) + 22 + name_size), kHeaderRecord, 0 });
+  Put(writer, kMagic);
+  Put(writer, kVersion);
+  Put(writer, static_cast<int64_t>(wall.tv_sec) * 1000000000 + wall.tv_nsec);
+  Put(writer, Now());
+  writer.WriteBytes(name, name_size);
+  return writer.failed() ? 0 : writer.size();
+}
+
+size_t BinaryLog::WriteFormat(char *data, size_t capacity, uint32_t id, const char *file, int line,
+                              const char *format) noexcept {
+  MessageWriter writer(data, min(capacity, kMaxRecord));
+  size_t file_size = min(strlen(file), kMaxFileName);
+  size_t format_size = min(strlen(format), kMaxRecord - sizeof(RecordPrefix) - 10 - file_size);
+  Put(writer, RecordPrefix{ static_cast<uint16_t>(sizeof(RecordPrefix) + 10 + file_size + format_size),
+                            kFormatRecord, 0 });
+  Put(writer, id);
+  Put(writer, static_cast<int32_t>(line));
+  Put(writer, static_cast<uint16_t>(file_size));
+  writer.WriteBytes(file, file_size);
+  writer.WriteBytes(format, format_size);
+  return writer.failed() ? 0 : writer.size();
+}
+
+size_t BinaryLog::WriteEvent(char *data, size_t capacity, LogMessageLevel level, uint32_t id, int64_t time,
+                             const char *arguments, size_t size) noexcept {
+  MessageWriter writer(data, min(capacity, kMaxRecord));
+  size = min(size, LogArguments::kMaxSize);
+  EventHeader header = { { static_cast<uint16_t>(sizeof(EventHeader) + size), kEventRecord,
+                           static_cast<uint8_t>(level) }, id, time };
+  Put(writer, header);
+  writer.WriteBytes(arguments, size);
+  return writer.failed() ? 0 : writer.size();
+}
+
+size_t BinaryLog::WriteThread(char *data, size_t capacity, uint32_t thread) noexcept {
+  MessageWriter writer(data, min(capacity, kMaxRecord));
+  Put(writer, RecordPrefix{ static_cast<uint16_t>(sizeof(RecordPrefix) + sizeof(thread)), kThreadRecord, 0 });
+  Put(writer, thread);
+  return writer.failed() ? 0 : writer.size();
+}
+
+BinaryLog::BinaryLog(const string &path, size_t file_size, size_t files)
+    : path_(path), file_size_(min(max(file_size, kMinFileSize), static_cast<size_t>(numeric_limits<int32_t>::max()))),
+      files_(max<size_t>(files, 1)) {
+  lock_guard<mutex> lock(mutex_);
+  // Log of previous run is kept as the first old file
+  Rotate(nullptr);
+  if (!segment_.load()) {
+    throw runtime_error("Can not open binary log " + path + ": " + strerror(errno));
+  }
+}
+
+BinaryLog::~BinaryLog() {
+  lock_guard<mutex> lock(mutex_);
+  Segment *segment = segment_.exchange(nullptr);
+  if (!segment) return;
+  while (segment->writers.load() != 0) {
+    this_thread::yield();
+  }
+  Close(*segment);
+}
+
+void BinaryLog::Write(LogSite &site, LogMessageLevel level, const char *format,
+                      const LogArguments &arguments) noexcept {
+  uint32_t id = site.format_id.load(memory_order_acquire);
+  if (id == 0) id = RegisterFormat(site, format);
+  if (id > defined_.load(memory_order_acquire)) {
+    lock_guard<mutex> lock(mutex_);
+    Define();
+  }
+  EventHeader header = { { static_cast<uint16_t>(sizeof(EventHeader) + arguments.size()), kEventRecord,
+                           static_cast<uint8_t>(level) }, id, BinaryLog::Now() };
+  Append(&header, sizeof(header), arguments.data(), arguments.size());
+}
+
+void BinaryLog::Write(LogMessageLevel level, const char *msg) noexcept {
+  LogArguments arguments;
+  arguments.AppendString(msg, strlen(msg));
+  EventHeader header = { { static_cast<uint16_t>(sizeof(EventHeader) + arguments.size()), kEventRecord,
+                           static_cast<uint8_t>(level) }, 0, BinaryLog::Now() };
+  Append(&header, sizeof(header), arguments.data(), arguments.size());
+}
+
+void BinaryLog::Define() noexcept {
+  FormatRegistry &registry = Registry();
+  vector<FormatRegistry::Definition> definitions;
+  uint32_t defined = defined_.load(memory_order_relaxed);
+  {
+    lock_guard<mutex> lock(registry.mutex);
+    definitions.assign(registry.definitions.begin() + defined, registry.definitions.end());
+  }
+  Segment *segment = segment_.load();
+  vector<char> record(kMaxRecord);
+  for (const FormatRegistry::Definition &definition : definitions) {
+    size_t size = WriteFormat(record.data(), record.size(), ++defined, definition.file, definition.line,
+                              definition.format);
+    if (segment && !TryAppend(*segment, record.data(), size, nullptr, 0)) {
+      // New file starts with all formats
+      Rotate(segment);
+      return;
+    }
+  }
+  defined_.store(defined, memory_order_release);
+}
+
+void BinaryLog::Append(const void *header, size_t header_size, const char *body, size_t body_size) noexcept {
+  while (true) {
+    Segment *segment = segment_.load();
+    if (!segment) {
+      dropped_.fetch_add(1, memory_order_relaxed);
+      return;
+    }
+    if (TryAppend(*segment, header, header_size, body, body_size)) return;
+    lock_guard<mutex> lock(mutex_);
+    if (segment_.load() == segment) Rotate(segment);
+  }
+}
+
+bool BinaryLog::TryAppend(Segment &segment, const void *header, size_t header_size, const char *body,
+                          size_t body_size) noexcept {
+  size_t size = header_size + body_size;
+  bool appended = false;
+  // Rotation replaces segment before waiting for its writers, so writer
+  // which sees segment current after registering itself is waited for
+  segment.writers.fetch_add(1);
+  if (segment_.load() == &segment) {
+    size_t offset = segment.offset.fetch_add(size, memory_order_relaxed);
+    if (offset + size <= segment.size) {
+      memcpy(segment.data + offset, header, header_size);
+      if (body_size != 0) memcpy(segment.data + offset + header_size, body, body_size);
+      appended = true;
+    }
+  }
+  segment.writers.fetch_sub(1, memory_order_release);
+  return appended;
+}
+
+void BinaryLog::Rotate(Segment *full) noexcept {
+  if (files_ == 1) {
+    unlink(path_.c_str());
+  }
+  for (size_t i = files_ - 1; i > 0; --i) {
+    string from = i == 1 ? path_ : path_ + "." + to_string(i - 1);
+    rename(from.c_str(), (path_ + "." + to_string(i)).c_str());
+  }
+  Segment &next = full == &segments_[0] ? segments_[1] : segments_[0];
+  uint32_t defined = 0;
+  if (Open(next, defined)) {
+    segment_.store(&next);
+    // Formats are published after the file which has them
+    defined_.store(defined, memory_order_release);
+  } else {
+    segment_.store(nullptr);
+  }
+  if (!full) return;
+  rotations_.fetch_add(1, memory_order_relaxed);
+  while (full->writers.load() != 0) {
+    this_thread::yield();
+  }
+  Close(*full);
+}
+
+bool BinaryLog::Open(Segment &segment, uint32_t &defined) noexcept {
+  int fd = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+  void *data = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(file_size_)) == 0) {
+    data = mmap(nullptr, file_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (data == MAP_FAILED) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+  segment.data = static_cast<char *>(data);
+  segment.size = file_size_;
+  segment.fd = fd;
+  size_t offset = WriteHeader(segment.data, file_size_, Logger::instance().name());
+  FormatRegistry &registry = Registry();
+  lock_guard<mutex> lock(registry.mutex);
+  defined = static_cast<uint32_t>(registry.definitions.size());
+  for (uint32_t id = 1; id <= defined; ++id) {
+    // Formats which do not fit are shown as unknown by reader
+    const FormatRegistry::Definition &definition = registry.definitions[id - 1];
+    size_t size = WriteFormat(segment.data + offset, file_size_ - offset, id, definition.file, definition.line,
+                              definition.format);
+    if (size == 0) break;
+    offset += size;
+  }
+  segment.offset.store(offset, memory_order_relaxed);
+  return true;
+}
+
+void BinaryLog::Close(Segment &segment) noexcept {
+  munmap(segment.data, segment.size);
+  if (ftruncate(segment.fd, static_cast<off_t>(min(segment.offset.load(memory_order_relaxed), segment.size))) != 0) {
+    // Rest of file is zeros, which reader takes as the end
+  }
+  close(segment.fd);
+  segment.data = nullptr;
+  segment.size = 0;
+  segment.fd = -1;
+  segment.offset.store(0, memory_order_relaxed);
+}
+
+BinaryLogReader::BinaryLogReader(const char *data, size_t size) : data_(data), size_(size) {
+  MessageReader reader(data, size);
+  RecordPrefix prefix = { 0, 0, 0 };
+  uint32_t magic = 0;
+  uint16_t version = 0;
+  Get(reader, prefix);
+  Get(reader, magic);
+  Get(reader, version);
+  Get(reader, wall_start_);
+  Get(reader, steady_start_);
+  if (reader.failed() || prefix.kind != kHeaderRecord || magic != kMagic || version != kVersion ||
+      prefix.size < size - reader.remaining() || prefix.size > size) {
+    return;
+  }
+  const char *name = reader.ReadBytes(prefix.size - (size - reader.remaining()));
+  name_.assign(name, data + prefix.size - name);
+  position_ = prefix.size;
+  valid_ = true;
+}
+
+bool BinaryLogReader::Next(BinaryLogEntry &entry) {
+  while (valid_ && !corrupt_ && size_ - position_ >= sizeof(RecordPrefix)) {
+    RecordPrefix prefix;
+    memcpy(&prefix, data_ + position_, sizeof(prefix));
+    // Zeros follow the last record of file which was not closed
+    if (prefix.size == 0) return false;
+    if (prefix.size < sizeof(RecordPrefix) || prefix.size > size_ - position_) return Corrupt();
+    MessageReader reader(data_ + position_ + sizeof(prefix), prefix.size - sizeof(prefix));
+    position_ += prefix.size;
+    uint32_t id = 0;
+    Get(reader, id);
+    if (prefix.kind == kThreadRecord) {
+      if (reader.failed()) return Corrupt();
+      thread_ = id;
+      continue;
+    }
+    if (prefix.kind == kFormatRecord) {
+      Format &format = formats_[id];
+      int32_t line = 0;
+      uint16_t file_size = 0;
+      Get(reader, line);
+      Get(reader, file_size);
+      const char *file = reader.ReadBytes(file_size);
+      if (reader.failed()) return Corrupt();
+      format.file.assign(file, file_size);
+      format.line = line;
+      size_t format_size = reader.remaining();
+      format.format.assign(reader.ReadBytes(format_size), format_size);
+      continue;
+    }
+    if (prefix.kind != kEventRecord || prefix.level > kDebug) return Corrupt();
+    int64_t time = 0;
+    Get(reader, time);
+    if (reader.failed()) return Corrupt();
+    entry.level = static_cast<LogMessageLevel>(prefix.level);
+    entry.thread = thread_;
+    entry.time = system_clock::time_point(duration_cast<system_clock::duration>(
+                                            nanoseconds(wall_start_ + (time - steady_start_))));
+    LogBuffer buffer;
+    if (id == 0) {
+      entry.file.clear();
+      entry.line = 0;
+      if (!FormatEncoded(buffer, reader)) return Corrupt();
+    } else {
+      auto found = formats_.find(id);
+      if (found == formats_.end()) {
+        entry.file.clear();
+        entry.line = 0;
+        buffer.Append("Unknown format ");
+        buffer.AppendUnsigned(id);
+      } else {
+        entry.file = found->second.file;
+        entry.line = found->second.line;
+        // Placeholders left without arguments are kept, as in text log
+        const char *format = found->second.format.c_str();
+        const char *placeholder;
+        while (reader.remaining() != 0 && (placeholder = strstr(format, "{}"))) {
+          buffer.Append(format, placeholder - format);
+          if (!FormatEncoded(buffer, reader)) break;
+          format = placeholder + 2;
+        }
+        if (reader.failed()) return Corrupt();
+        buffer.Append(format);
+      }
+    }
+    entry.text = buffer.c_str();
+    return true;
+  }
+  return false;
+}
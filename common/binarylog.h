@@ -0,0 +1,179 @@
+#ifndef YOBAHACK_COMMON_BINARYLOG_H_
+#define YOBAHACK_COMMON_BINARYLOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "common/logging.h"
+
+namespace logging {
+
+/** Log destination which keeps records unformatted.
+ * Record of logging macro is id of its format string, monotonic time and
+ * raw bytes of its arguments (see LogArguments); format strings are
+ * written once per file. Records are copied into memory-mapped file, so
+ * they survive crash of application. When file is full, it is renamed to
+ * "path.1" (previous ones shift up to "path.<files - 1>") and new file is
+ * started. Files are decoded offline by BinaryLogReader (see logdecoder).
+ * Write() is thread-safe and lock-free except for rotation and first
+ * record of every call site.
+ */
+class BinaryLog {
+ public:
+  static const std::size_t kDefaultFileSize = 64 << 20;
+  static const std::size_t kMinFileSize = 4096;
+
+  /** Opens file; throws std::runtime_error on failure */
+  explicit BinaryLog(const std::string &path, std::size_t file_size = kDefaultFileSize, std::size_t files = 4);
+  ~BinaryLog();
+
+  BinaryLog(const BinaryLog &other) = delete;
+  BinaryLog(const BinaryLog &&other) = delete;
+
+  /** Writes record; format should be the same on every call of the site */
+  void Write(LogSite &site, LogMessageLevel level, const char *format,
+             const LogArguments &arguments) noexcept;
+  /** Writes ready message */
+  void Write(LogMessageLevel level, const char *msg) noexcept;
+
+  /** Number of records lost because new file could not be made */
+  inline std::size_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  inline std::size_t rotations() const noexcept {
+    return rotations_.load(std::memory_order_relaxed);
+  }
+
+  inline const std::string &path() const noexcept {
+    return path_;
+  }
+
+  /** Monotonic time of records in nanoseconds */
+  static inline std::int64_t Now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Writers of single records, also used by FlightRecorder. They only copy
+  // memory and read clocks, so they are async-signal-safe. Each returns size
+  // of record, or 0 if it does not fit.
+
+  /** File header; should be the first record */
+  static std::size_t WriteHeader(char *data, std::size_t capacity, const char *name) noexcept;
+  /** Format of events with given id */
+  static std::size_t WriteFormat(char *data, std::size_t capacity, std::uint32_t id, const char *file, int line,
+                                 const char *format) noexcept;
+  /** Event; id 0 means that arguments hold ready message */
+  static std::size_t WriteEvent(char *data, std::size_t capacity, LogMessageLevel level, std::uint32_t id,
+                                std::int64_t time, const char *arguments, std::size_t size) noexcept;
+  /** Thread of following events */
+  static std::size_t WriteThread(char *data, std::size_t capacity, std::uint32_t thread) noexcept;
+
+ private:
+  /** Mapped file; writers reserve space by moving offset */
+  struct Segment {
+    char *data = nullptr;
+    std::size_t size = 0;
+    int fd = -1;
+    std::atomic<std::size_t> offset{0};
+    std::atomic<std::size_t> writers{0}; ///< Writers which may copy to data
+  };
+
+  /** Writes definitions of formats registered since last call; mutex_ should be locked */
+  void Define() noexcept;
+  /** Reserves room for record in current file, rotating it when full, and copies record there */
+  void Append(const void *header, std::size_t header_size, const char *body, std::size_t body_size) noexcept;
+  /** Appends record if segment is current and has room */
+  bool TryAppend(Segment &segment, const void *header, std::size_t header_size, const char *body,
+                 std::size_t body_size) noexcept;
+  /** Replaces full segment with new file; mutex_ should be locked */
+  void Rotate(Segment *full) noexcept;
+  /** Maps new file and writes its header and known formats, setting their
+   * count to defined; mutex_ should be locked
+   */
+  bool Open(Segment &segment, std::uint32_t &defined) noexcept;
+  /** Unmaps file, cutting it to written size */
+  void Close(Segment &segment) noexcept;
+
+  std::string path_;
+  std::size_t file_size_;
+  std::size_t files_;
+  // Rotation alternates between two segments; old one is closed after its
+  // last writer is done
+  Segment segments_[2];
+  std::atomic<Segment *> segment_{nullptr};
+  std::atomic<std::uint32_t> defined_{0}; ///< Formats with id up to this are in current file
+  std::atomic<std::size_t> dropped_{0};
+  std::atomic<std::size_t> rotations_{0};
+  std::mutex mutex_;
+};
+
+/** Record of binary log decoded to text */
+struct BinaryLogEntry {
+  LogMessageLevel level;
+  std::chrono::system_clock::time_point time;
+  std::string file; ///< Empty for ready messages
+  int line;
+  std::uint32_t thread; ///< 0 if file does not tell
+  std::string text;
+};
+
+/** Decodes file of BinaryLog.
+ * Arguments are substituted into their formats the same way as in text
+ * log (see LogFormat()).
+ */
+class BinaryLogReader {
+ public:
+  /** Data should be kept while reader is used */
+  BinaryLogReader(const char *data, std::size_t size);
+
+  /** Decodes next record; returns false at the end of data or on corrupt record */
+  bool Next(BinaryLogEntry &entry);
+
+  /** Returns false if data is not a binary log of this host */
+  inline bool valid() const noexcept {
+    return valid_;
+  }
+
+  /** Returns true if decoding has stopped on a corrupt record */
+  inline bool corrupt() const noexcept {
+    return corrupt_;
+  }
+
+  /** Name of logger which wrote the file */
+  inline const std::string &name() const noexcept {
+    return name_;
+  }
+
+ private:
+  struct Format {
+    std::string file;
+    int line;
+    std::string format;
+  };
+
+  inline bool Corrupt() noexcept {
+    corrupt_ = true;
+    return false;
+  }
+
+  const char *data_;
+  std::size_t size_;
+  std::size_t position_ = 0;
+  bool valid_ = false;
+  bool corrupt_ = false;
+  std::uint32_t thread_ = 0;
+  std::string name_;
+  std::int64_t wall_start_ = 0; ///< Nanoseconds of system clock when file was made
+  std::int64_t steady_start_ = 0; ///< Nanoseconds of steady clock at the same moment
+  std::unordered_map<std::uint32_t, Format> formats_;
+};
+
+}
+
+#endif // YOBAHACK_COMMON_BINARYLOG_H_
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include "bitstream.h"
+
+using namespace std;
+
+namespace {
+
+const unsigned int kVarintGroup = 4;
+
+}
+
+void BitWriter::Write(uint64_t value, unsigned int bits) {
+  for (unsigned int written = 0; written < bits; ) {
+    size_t offset = bits_ % 8;
+    if (offset == 0) data_.push_back(0);
+    unsigned int chunk = min<unsigned int>(8 - offset, bits - written);
+    unsigned char part = (value >> written) & ((1u << chunk) - 1);
+    data_.back() = static_cast<char>(static_cast<unsigned char>(data_.back()) | (part << offset));
+    written += chunk;
+    bits_ += chunk;
+  }
+}
+
+void BitWriter::WriteVarint(uint64_t value) {
+  do {
+    uint64_t group = value & ((1u << kVarintGroup) - 1);
+    value >>= kVarintGroup;
+    Write(group | (value != 0 ? 1u << kVarintGroup : 0), kVarintGroup + 1);
+  } while (value != 0);
+}
+
+void BitWriter::Clear() noexcept {
+  data_.clear();
+  bits_ = 0;
+}
+
+uint64_t BitReader::Read(unsigned int bits) noexcept {
+  uint64_t value = 0;
+  for (unsigned int read = 0; read < bits; ) {
+    if (position_ >= size_ * 8) {
+      overflow_ = true;
+      return value;
+    }
+    size_t offset = position_ % 8;
+    unsigned int chunk = min<unsigned int>(8 - offset, bits - read);
+    uint64_t part = (static_cast<unsigned char>(data_[position_ / 8]) >> offset) & ((1u << chunk) - 1);
+    value |= part << read;
+    read += chunk;
+    position_ += chunk;
+  }
+  return value;
+}
+
+uint64_t BitReader::ReadVarint() noexcept {
+  uint64_t value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += kVarintGroup) {
+    uint64_t group = Read(kVarintGroup + 1);
+    value |= (group & ((1u << kVarintGroup) - 1)) << shift;
+    if (!(group >> kVarintGroup) || overflow_) break;
+  }
+  return value;
+}
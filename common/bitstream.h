@@ -0,0 +1,71 @@
+#ifndef YOBAHACK_COMMON_BITSTREAM_H_
+#define YOBAHACK_COMMON_BITSTREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** Writes values packed with given number of bits, least significant first.
+ * Not thread-safe.
+ */
+class BitWriter {
+ public:
+  /** Appends lowest bits of value; bits should be at most 64 */
+  void Write(std::uint64_t value, unsigned int bits);
+
+  /** Appends unsigned value in 4-bit groups with continuation bits, so
+   * small values take few bits */
+  void WriteVarint(std::uint64_t value);
+
+  /** Same for signed value with zigzag encoding */
+  inline void WriteSigned(std::int64_t value) {
+    WriteVarint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+  }
+
+  /** Number of bits written */
+  inline std::size_t bits() const noexcept {
+    return bits_;
+  }
+
+  /** Written bytes; last byte is padded with zero bits */
+  inline const std::string &data() const noexcept {
+    return data_;
+  }
+
+  void Clear() noexcept;
+
+ private:
+  std::string data_;
+  std::size_t bits_ = 0;
+};
+
+/** Reads values written by BitWriter.
+ * Reading past the end yields zero bits and sets overflow flag.
+ * Not thread-safe.
+ */
+class BitReader {
+ public:
+  BitReader(const char *data, std::size_t size) noexcept : data_(data), size_(size) { }
+
+  std::uint64_t Read(unsigned int bits) noexcept;
+
+  std::uint64_t ReadVarint() noexcept;
+
+  inline std::int64_t ReadSigned() noexcept {
+    std::uint64_t value = ReadVarint();
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+  }
+
+  /** Returns true if reader went past the end of data */
+  inline bool overflow() const noexcept {
+    return overflow_;
+  }
+
+ private:
+  const char *data_;
+  std::size_t size_;
+  std::size_t position_ = 0; ///< In bits
+  bool overflow_ = false;
+};
+
+#endif // YOBAHACK_COMMON_BITSTREAM_H_
@@ -0,0 +1,83 @@
+#ifndef YOBAHACK_COMMON_BOUNDEDQUEUE_H_
+#define YOBAHACK_COMMON_BOUNDEDQUEUE_H_
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+
+/** Fixed-size lock-free queue for many producers and one consumer.
+ * Each cell carries a sequence number which tells whether it is free for
+ * writing or ready for reading, so producers only contend on one atomic
+ * increment and never wait for each other. Push() fails instead of blocking
+ * when queue is full.
+ * Pop() should be called from one thread at a time.
+ */
+template <class T> class BoundedQueue {
+ public:
+  /** Creates queue; capacity is rounded up to the power of two */
+  explicit BoundedQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (std::size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedQueue(const BoundedQueue &other) = delete;
+  BoundedQueue(const BoundedQueue &&other) = delete;
+
+  /** Tries to put value to queue; returns false if queue is full */
+  bool Push(const T &value) noexcept {
+    std::size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[position & mask_];
+      std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+      if (difference == 0) {
+        if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        return false;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Tries to take value from queue; returns false if queue is empty */
+  bool Pop(T &value) noexcept {
+    Cell *cell = &cells_[dequeue_position_ & mask_];
+    std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if (sequence != dequeue_position_ + 1) return false;
+    value = cell->value;
+    cell->sequence.store(dequeue_position_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_position_;
+    return true;
+  }
+
+  inline std::size_t capacity() const noexcept {
+    return mask_ + 1;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  std::size_t mask_;
+  std::atomic<std::size_t> enqueue_position_{0};
+  std::size_t dequeue_position_ = 0; ///< Touched only by consumer
+};
+
+#endif // YOBAHACK_COMMON_BOUNDEDQUEUE_H_
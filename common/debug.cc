@@ -1,4 +1,3 @@
-#include <sstream>
 #include "common/logging.h"
 #include "common/application.h"
 #include "debug.h"
@@ -9,12 +8,11 @@ namespace boost
   void assertion_failed_msg(const char *expr, const char *msg, const char *function, const char *file, long line) noexcept {
     // Assertions are sent for logging, then application is aborted.
     // We assume assertion fail is a critical error.
-    std::stringstream ss;
-    ss << "Assertion failed in " << file << ":" << line << " (" << function << ")";
     if (msg) {
-      ss << ": " << msg;
+      LogCritical("Assertion failed in {}:{} ({}): {}", file, line, function, msg);
+    } else {
+      LogCritical("Assertion failed in {}:{} ({})", file, line, function);
     }
-    LogCritical(ss.str());
     Application::instance().Abort();
   }
 
@@ -0,0 +1,206 @@
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include "binarylog.h"
+#include "flightrecorder.h"
+
+using namespace std;
+using namespace logging;
+
+const size_t FlightRecorder::kDefaultRecords;
+const size_t FlightRecorder::kMaxThreads;
+const size_t FlightRecorder::kMaxPath;
+
+namespace {
+
+const int kFatalSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+/** Room for one record in crash file; formats longer than this are shown as unknown */
+const size_t kBufferSize = 8192;
+
+/** Recording should be cheap, and order of records of one thread is kept
+ * anyway, so coarse clock is enough
+ */
+inline int64_t RecordTime() noexcept {
+  timespec now;
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void WriteAll(int fd, const char *data, size_t size) noexcept {
+  while (size != 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return;
+    data += written;
+    size -= written;
+  }
+}
+
+}
+
+FlightRecorder::~FlightRecorder() {
+  if (recording_.exchange(false)) RestoreHandlers();
+}
+
+void FlightRecorder::Start(const string &path, size_t records) {
+  if (path.size() >= kMaxPath) {
+    throw invalid_argument("Path of crash file is too long");
+  }
+  if (recording()) Stop();
+  memcpy(path_, path.c_str(), path.size() + 1);
+  records_ = max<size_t>(records, 1);
+  dumped_.store(false);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &FlightRecorder::HandleSignal;
+  sigemptyset(&action.sa_mask);
+  for (int signal : kFatalSignals) {
+    sigaction(signal, &action, &previous_[signal]);
+  }
+  recording_.store(true, memory_order_release);
+  Logger::instance().set_flight_recorder(this);
+}
+
+void FlightRecorder::Stop() noexcept {
+  if (!recording_.exchange(false)) return;
+  Logger::instance().set_flight_recorder(nullptr);
+  RestoreHandlers();
+}
+
+void FlightRecorder::Record(const LogSite &site, LogMessageLevel level, const char *format,
+                            const LogArguments &arguments) noexcept {
+  Record(&site, level, format, arguments.data(), arguments.size());
+}
+
+void FlightRecorder::Record(LogMessageLevel level, const char *msg) noexcept {
+  LogArguments arguments;
+  arguments.AppendString(msg, strlen(msg));
+  Record(nullptr, level, nullptr, arguments.data(), arguments.size());
+}
+
+void FlightRecorder::Record(const LogSite *site, LogMessageLevel level, const char *format, const char *arguments,
+                            size_t size) noexcept {
+  Ring *ring = LocalRing();
+  if (!ring) return;
+  size_t head = ring->head.load(memory_order_relaxed);
+  Slot &slot = ring->slots[head % ring->capacity];
+  uint32_t sequence = slot.sequence.load(memory_order_relaxed);
+  slot.sequence.store(sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  Entry &entry = slot.entry;
+  entry.thread = ring->thread;
+  entry.level = static_cast<uint8_t>(level);
+  entry.size = static_cast<uint16_t>(size);
+  entry.site = site;
+  entry.format = format;
+  entry.time = RecordTime();
+  memcpy(entry.arguments, arguments, size);
+  slot.sequence.store(sequence + 2, memory_order_release);
+  ring->head.store(head + 1, memory_order_release);
+}
+
+void FlightRecorder::Dump() noexcept {
+  if (!recording() || dumped_.exchange(true)) return;
+  int fd = open(path_, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return;
+  // Dump may run in signal handler, so it uses only static memory and
+  // system calls; it runs once, so static buffers are not shared
+  static char buffer[kBufferSize];
+  static Entry entry;
+  WriteAll(fd, buffer, BinaryLog::WriteHeader(buffer, sizeof(buffer), Logger::instance().name()));
+  uint32_t id = 0;
+  uint32_t thread = 0;
+  for (atomic<Ring *> &slot : rings_) {
+    Ring *ring = slot.load(memory_order_acquire);
+    if (!ring) continue;
+    size_t head = ring->head.load(memory_order_acquire);
+    for (size_t i = head - min(head, ring->capacity); i != head; ++i) {
+      const Slot &from = ring->slots[i % ring->capacity];
+      uint32_t sequence = from.sequence.load(memory_order_acquire);
+      if (sequence % 2 != 0) continue;
+      entry = from.entry;
+      atomic_thread_fence(memory_order_acquire);
+      if (from.sequence.load(memory_order_relaxed) != sequence) continue;
+      if (entry.thread != thread) {
+        thread = entry.thread;
+        WriteAll(fd, buffer, BinaryLog::WriteThread(buffer, sizeof(buffer), thread));
+      }
+      uint32_t format_id = 0;
+      if (entry.site) {
+        // Every record gets its own format, so nothing has to be remembered
+        format_id = ++id;
+        WriteAll(fd, buffer, BinaryLog::WriteFormat(buffer, sizeof(buffer), format_id, entry.site->file,
+                                                    entry.site->line, entry.format));
+      }
+      WriteAll(fd, buffer, BinaryLog::WriteEvent(buffer, sizeof(buffer), static_cast<LogMessageLevel>(entry.level),
+                                                 format_id, entry.time, entry.arguments, entry.size));
+    }
+  }
+  close(fd);
+}
+
+FlightRecorder::Ring *FlightRecorder::LocalRing() noexcept {
+  // Holder frees ring for other threads when thread exits
+  struct Holder {
+    ~Holder() {
+      if (ring) ring->owned.store(false, memory_order_release);
+    }
+
+    Ring *ring = nullptr;
+    bool acquired = false;
+  };
+  thread_local Holder holder;
+  if (!holder.acquired) {
+    holder.ring = AcquireRing();
+    holder.acquired = true;
+  }
+  return holder.ring;
+}
+
+FlightRecorder::Ring *FlightRecorder::AcquireRing() noexcept {
+  uint32_t thread = static_cast<uint32_t>(syscall(SYS_gettid));
+  for (atomic<Ring *> &slot : rings_) {
+    Ring *ring = slot.load(memory_order_acquire);
+    bool owned = false;
+    if (ring && ring->owned.compare_exchange_strong(owned, true, memory_order_acq_rel)) {
+      ring->thread = thread;
+      return ring;
+    }
+  }
+  Ring *ring = new (nothrow) Ring(records_);
+  if (!ring || !ring->slots) {
+    delete ring;
+    return nullptr;
+  }
+  ring->thread = thread;
+  for (atomic<Ring *> &slot : rings_) {
+    Ring *empty = nullptr;
+    if (slot.compare_exchange_strong(empty, ring, memory_order_acq_rel)) return ring;
+  }
+  delete ring;
+  return nullptr;
+}
+
+void FlightRecorder::RestoreHandlers() noexcept {
+  for (int signal : kFatalSignals) {
+    sigaction(signal, &previous_[signal], nullptr);
+  }
+}
+
+void FlightRecorder::HandleSignal(int signal) noexcept {
+  FlightRecorder &recorder = instance();
+  recorder.Dump();
+  // Signal is raised again with previous handler when this one returns
+  sigaction(signal, &recorder.previous_[signal], nullptr);
+  raise(signal);
+}
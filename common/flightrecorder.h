@@ -0,0 +1,112 @@
+#ifndef YOBAHACK_COMMON_FLIGHTRECORDER_H_
+#define YOBAHACK_COMMON_FLIGHTRECORDER_H_
+
+#include <signal.h>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include "common/singleton.h"
+#include "common/logging.h"
+
+namespace logging {
+
+/** Keeps last records of every thread in memory for post-mortem.
+ * Every thread which logs gets a ring of last records of logging macros.
+ * Records of all levels are kept, including ones filtered out of text
+ * and binary logs; arguments are copied unformatted (see LogArguments),
+ * so recording costs a copy into ring of calling thread. Rings are written
+ * to crash file by Dump(), which is called by Application::Abort() (and so
+ * on failed assertion) and on fatal signals. Crash file is in format of
+ * BinaryLog and is read by logdecoder.
+ */
+class FlightRecorder : public Singleton<FlightRecorder> {
+ public:
+  static const std::size_t kDefaultRecords = 256;
+  static const std::size_t kMaxThreads = 256; ///< Threads beyond this are not recorded
+  static const std::size_t kMaxPath = 256;
+
+  FlightRecorder(const FlightRecorder &other) = delete;
+  FlightRecorder(const FlightRecorder &&other) = delete;
+
+  /** Starts recording and sets handlers of fatal signals.
+   * \param records Size of ring of every thread; rings made before keep their size
+   */
+  void Start(const std::string &path, std::size_t records = kDefaultRecords);
+
+  /** Stops recording and restores signal handlers; rings are kept */
+  void Stop() noexcept;
+
+  /** Copies record of logging macro to ring of calling thread */
+  void Record(const LogSite &site, LogMessageLevel level, const char *format,
+              const LogArguments &arguments) noexcept;
+  /** Copies ready message to ring of calling thread */
+  void Record(LogMessageLevel level, const char *msg) noexcept;
+
+  /** Writes all rings to crash file; only the first call after Start()
+   * does it. Async-signal-safe.
+   */
+  void Dump() noexcept;
+
+  inline bool recording() const noexcept {
+    return recording_.load(std::memory_order_acquire);
+  }
+
+ private:
+  friend class Singleton<FlightRecorder>;
+
+  struct Entry {
+    std::uint32_t thread;
+    std::uint8_t level;
+    std::uint16_t size; ///< Of arguments
+    const LogSite *site; ///< nullptr for ready message, which is the only argument
+    const char *format;
+    std::int64_t time; ///< Nanoseconds of steady clock
+    char arguments[LogArguments::kMaxSize];
+  };
+
+  /** Entry guarded by sequence number, which is odd while entry is written,
+   * so that dump skips entries torn by crash
+   */
+  struct Slot {
+    std::atomic<std::uint32_t> sequence{0};
+    Entry entry;
+  };
+
+  /** Records of one thread; ring of exited thread is taken by a new one */
+  struct Ring {
+    explicit Ring(std::size_t capacity) : slots(new (std::nothrow) Slot[capacity]), capacity(capacity) { }
+
+    std::unique_ptr<Slot[]> slots;
+    const std::size_t capacity;
+    std::atomic<std::size_t> head{0}; ///< Count of records written
+    std::atomic<bool> owned{true};
+    std::uint32_t thread = 0; ///< Of owner
+  };
+
+  FlightRecorder() = default;
+  ~FlightRecorder();
+
+  /** Returns ring of calling thread, taking one on first use; nullptr if there are no free slots */
+  Ring *LocalRing() noexcept;
+  /** Takes ring of exited thread or makes new one */
+  Ring *AcquireRing() noexcept;
+  void Record(const LogSite *site, LogMessageLevel level, const char *format, const char *arguments,
+              std::size_t size) noexcept;
+  /** Restores handlers which were before Start() */
+  void RestoreHandlers() noexcept;
+  static void HandleSignal(int signal) noexcept;
+
+  char path_[kMaxPath] = "";
+  std::size_t records_ = kDefaultRecords;
+  std::atomic<Ring *> rings_[kMaxThreads] = {}; ///< Rings are never freed, as dump may read them any time
+  std::atomic<bool> recording_{false};
+  std::atomic<bool> dumped_{false};
+  struct sigaction previous_[NSIG];
+};
+
+}
+
+#endif // YOBAHACK_COMMON_FLIGHTRECORDER_H_
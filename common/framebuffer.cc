@@ -0,0 +1,75 @@
+#include <cstring>
+#include <algorithm>
+#include "framebuffer.h"
+
+using namespace std;
+
+const size_t FrameBuffer::kHeaderSize;
+const size_t FrameBuffer::kReadSize;
+
+FrameBuffer::FrameBuffer(size_t capacity, size_t max_message)
+  : data_(new char[max(capacity, kHeaderSize)]), capacity_(max(capacity, kHeaderSize)),
+    max_message_(max_message) {
+}
+
+boost::asio::mutable_buffers_1 FrameBuffer::Prepare(size_t hint) {
+  // Never ask for more than one largest message can take
+  size_t limit = max_message_ + kHeaderSize;
+  size_t wanted = max(min(hint, limit), size_t(1));
+  if (capacity_ - write_ < wanted) {
+    size_t unread = write_ - read_;
+    if (capacity_ - unread < wanted && capacity_ < limit) {
+      // Grow, but only up to the size needed for the largest message
+      size_t capacity = capacity_;
+      while (capacity - unread < wanted && capacity < limit) {
+        capacity *= 2;
+      }
+      capacity = min(capacity, max(limit, unread + 1));
+      unique_ptr<char[]> data(new char[capacity]);
+      memcpy(data.get(), data_.get() + read_, unread);
+      data_ = move(data);
+      capacity_ = capacity;
+    } else if (read_ > 0) {
+      memmove(data_.get(), data_.get() + read_, unread);
+    }
+    read_ = 0;
+    write_ = unread;
+  }
+  return boost::asio::buffer(data_.get() + write_, capacity_ - write_);
+}
+
+void FrameBuffer::Commit(size_t bytes) noexcept {
+  write_ = min(write_ + bytes, capacity_);
+}
+
+bool FrameBuffer::Next(Frame &frame) noexcept {
+  if (malformed_ || write_ - read_ < kHeaderSize) return false;
+  const unsigned char *header = reinterpret_cast<const unsigned char *>(data_.get() + read_);
+  size_t size = size_t(header[0]) | size_t(header[1]) << 8 | size_t(header[2]) << 16 | size_t(header[3]) << 24;
+  if (size > max_message_) {
+    malformed_ = true;
+    return false;
+  }
+  if (write_ - read_ < kHeaderSize + size) return false;
+  frame.data = data_.get() + read_ + kHeaderSize;
+  frame.size = size;
+  read_ += kHeaderSize + size;
+  if (read_ == write_) {
+    // Cheap case: everything is consumed, next read starts from the beginning
+    // (views into data_ are still valid, nothing is moved)
+    read_ = write_ = 0;
+  }
+  return true;
+}
+
+void FrameBuffer::Reset() noexcept {
+  read_ = write_ = 0;
+  malformed_ = false;
+}
+
+void FrameBuffer::WriteHeader(char *header, uint32_t size) noexcept {
+  header[0] = char(size & 0xff);
+  header[1] = char((size >> 8) & 0xff);
+  header[2] = char((size >> 16) & 0xff);
+  header[3] = char((size >> 24) & 0xff);
+}
@@ -0,0 +1,82 @@
+#ifndef YOBAHACK_COMMON_FRAMEBUFFER_H_
+#define YOBAHACK_COMMON_FRAMEBUFFER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <boost/asio/buffer.hpp>
+
+/** View of one received message; points into FrameBuffer memory */
+struct Frame {
+  const char *data;
+  std::size_t size;
+};
+
+/** Receive buffer with length-prefixed message parsing.
+ * Each message on the wire is preceded by 4-byte little-endian length.
+ * Socket reads go straight into free tail of the buffer, and complete
+ * messages are handed out as views into it, without copying.
+ * Unread bytes are moved to the front only when the tail gets too small,
+ * which usually means a few bytes of one partial message, so every message
+ * stays contiguous in memory.
+ * Not thread-safe.
+ */
+class FrameBuffer {
+ public:
+  static const std::size_t kHeaderSize = 4;
+  /** Free tail prepared for every socket read */
+  static const std::size_t kReadSize = 4096;
+
+  /** \param capacity Initial size of buffer
+   * \param max_message Largest allowed message body; buffer grows up to fit it
+   */
+  explicit FrameBuffer(std::size_t capacity = 65536, std::size_t max_message = 1 << 20);
+  FrameBuffer(const FrameBuffer &other) = delete;
+  FrameBuffer(const FrameBuffer &&other) = delete;
+
+  /** Returns free space for the next read.
+   * Makes room for at least hint bytes if possible (limited by capacity
+   * needed for the largest message). Invalidates all Frame views.
+   */
+  boost::asio::mutable_buffers_1 Prepare(std::size_t hint = 0);
+
+  /** Marks given number of bytes after Prepare() as received */
+  void Commit(std::size_t bytes) noexcept;
+
+  /** Takes next complete message out of buffer.
+   * View stays valid until next Prepare() or Reset().
+   * \return false if there is no complete message or stream is malformed
+   */
+  bool Next(Frame &frame) noexcept;
+
+  /** Returns true if peer sent message larger than allowed; connection
+   * should be dropped. */
+  inline bool malformed() const noexcept {
+    return malformed_;
+  }
+
+  /** Number of received bytes not yet taken by Next() */
+  inline std::size_t pending() const noexcept {
+    return write_ - read_;
+  }
+
+  inline std::size_t capacity() const noexcept {
+    return capacity_;
+  }
+
+  /** Drops all data, keeping allocated memory */
+  void Reset() noexcept;
+
+  /** Writes length header for message of given size */
+  static void WriteHeader(char *header, std::uint32_t size) noexcept;
+
+ private:
+  std::unique_ptr<char[]> data_;
+  std::size_t capacity_;
+  std::size_t max_message_;
+  std::size_t read_ = 0;
+  std::size_t write_ = 0;
+  bool malformed_ = false;
+};
+
+#endif // YOBAHACK_COMMON_FRAMEBUFFER_H_
@@ -0,0 +1,16 @@
+#include "hex.h"
+
+using namespace std;
+
+void HexNeighbours(int rows, int cols, int row, int col, vector<pair<int, int>> &neighbours) {
+  // Rows touched in neighbouring columns
+  int shift = (col & 1) ? -1 : 0;
+  static const int kSide[][2] = { {0, -1}, {1, -1}, {0, 1}, {1, 1} };
+  if (row > 0) neighbours.emplace_back(row - 1, col);
+  if (row < rows - 1) neighbours.emplace_back(row + 1, col);
+  for (const int *offset : kSide) {
+    int r = row + shift + offset[0];
+    int c = col + offset[1];
+    if (r >= 0 && r < rows && c >= 0 && c < cols) neighbours.emplace_back(r, c);
+  }
+}
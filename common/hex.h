@@ -0,0 +1,30 @@
+#ifndef YOBAHACK_COMMON_HEX_H_
+#define YOBAHACK_COMMON_HEX_H_
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+/** Hex map geometry.
+ * Map is a Matrix of hexes in columns; even columns are shifted half a
+ * cell down, so hex (row, col) of even column touches rows row and
+ * row + 1 of neighbouring columns, and of odd column rows row - 1 and row.
+ * Same layout as HexTopology in planning/useful_code.
+ */
+
+/** Number of steps between two cells on map without obstacles; same as
+ * calc_distance() gives on empty field. Coordinates should not be negative.
+ */
+inline int HexDistance(int row1, int col1, int row2, int col2) noexcept {
+  // Axial coordinates: q is column, r is row shifted back by column
+  int r1 = row1 - (col1 + (col1 & 1)) / 2;
+  int r2 = row2 - (col2 + (col2 & 1)) / 2;
+  int dq = col2 - col1;
+  int dr = r2 - r1;
+  return (std::abs(dq) + std::abs(dr) + std::abs(dq + dr)) / 2;
+}
+
+/** Appends neighbours of cell which lie within map of given size */
+void HexNeighbours(int rows, int cols, int row, int col, std::vector<std::pair<int, int>> &neighbours);
+
+#endif // YOBAHACK_COMMON_HEX_H_
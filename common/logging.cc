@@ -1,15 +1,82 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <string>
 #include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/format.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include "binarylog.h"
 #include "debug.h"
+#include "flightrecorder.h"
 #include "logging.h"
 
 using namespace std;
 using namespace logging;
 using namespace boost::posix_time;
 
+const size_t Logger::kMaxMessage;
+const int64_t Logger::kNeverDue;
+const size_t LogArguments::kMaxSize;
+
+namespace {
+
+/** Background thread wakes up at least this often to write records */
+const chrono::milliseconds kWriteInterval(10);
+
+/** Most records written under one lock */
+const size_t kMaxBatch = 1024;
+
+/** Returns time of record.
+ * Log shows whole seconds, so coarse clock is enough, and it is several
+ * times cheaper to read than the precise one.
+ */
+inline chrono::system_clock::time_point RecordTime() noexcept {
+#if defined(__linux__) && defined(CLOCK_REALTIME_COARSE)
+  timespec now;
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+  return chrono::system_clock::time_point(chrono::duration_cast<chrono::system_clock::duration>(
+                                            chrono::seconds(now.tv_sec) + chrono::nanoseconds(now.tv_nsec)));
+#else
+  return chrono::system_clock::now();
+#endif
+}
+
+/** Returns nanoseconds of monotonic clock for rate limits; intervals
+ * are milliseconds or longer, so coarse clock is enough
+ */
+inline int64_t LimitTime() noexcept {
+  timespec now;
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/** Set while thread calls destinations. Message logged by a destination
+ * is written straight to stderr: in synchronous mode write_mutex_ is held,
+ * and background thread would wait for room in its own buffer forever.
+ */
+thread_local bool writing = false;
+
+/** Set in background thread; it writes records it logs itself right away
+ * (e.g. numbers of suppressed messages), as it is the one to make room
+ */
+thread_local bool consuming = false;
+
+/** Precedes message text in producer's buffer */
+struct RecordHeader {
+  int64_t time; ///< Ticks of system_clock
+  uint32_t level;
+  uint32_t size;
+};
+
+}
+
 const char *logging::LevelName(const LogMessageLevel level) {
   switch (level) {
     case kCritical:
@@ -28,45 +95,404 @@ const char *logging::LevelName(const LogMessageLevel level) {
   return nullptr;
 }
 
-Logger::Logger() noexcept : time_facet_(new TimeFacet("%x %X")) {
+Logger::Logger() : time_facet_(new TimeFacet("%x %X")) {
   time_format_.imbue(locale(time_format_.getloc(), time_facet_));
 }
 
+Logger::~Logger() {
+  StopAsync();
+}
+
 void Logger::Log(LogMessageLevel level, const char *msg) noexcept {
-  if (level > level_) return;
+  if (level > level_.load(memory_order_relaxed)) return;
 
-  if (write_to_stderr_) {
-    boost::format a;
-    time_format_ << second_clock::local_time();
-    cerr << boost::format("%1 [%2] %3: %4\n") % LevelName(level)[0] % time_format_.str() % name_ % msg;
-    time_format_.str("");
+  if (writing) {
+    cerr << LevelName(level)[0] << " " << name_ << ": " << msg << endl;
+    return;
   }
-
-  try {
-    for (auto &dest : destinations_) {
-      dest(level, msg);
+  if (!async_.load(memory_order_acquire) || consuming) {
+    // Without background thread storms which are over are reported by the next message
+    if (!consuming && LimitTime() >= suppressed_due_.load(memory_order_relaxed)) ReportSuppressed(false);
+    lock_guard<mutex> lock(write_mutex_);
+    Write(level, RecordTime(), msg);
+    return;
+  }
+  chrono::system_clock::time_point time = RecordTime();
+  size_t size = min(strlen(msg), kMaxMessage);
+  Producer &producer = LocalProducer();
+  while (!producer.Push(level, time, msg, size)) {
+    if (policy_ == kDropRecords) {
+      dropped_.fetch_add(1, memory_order_relaxed);
+      return;
     }
-  } catch (exception& e) {
-    set_write_to_stderr(true);
-    LogCritical(string("Logger destination throwed an exception: ") + string(e.what()));
+    wake_.notify_one();
+    this_thread::yield();
+  }
+  // Application is likely to abort right after critical message
+  if (level == kCritical) Flush();
+}
+
+void Logger::LogBinary(LogSite &site, LogMessageLevel level, const char *format,
+                       const LogArguments &arguments) noexcept {
+  if (flight_recorder_) flight_recorder_->Record(site, level, format, arguments);
+  if (binary_log_ && binary_enabled(level)) binary_log_->Write(site, level, format, arguments);
+}
+
+void Logger::LogBinary(LogMessageLevel level, const char *msg) noexcept {
+  if (flight_recorder_) flight_recorder_->Record(level, msg);
+  if (binary_log_ && binary_enabled(level)) binary_log_->Write(level, msg);
+}
 
+void Logger::StartAsync(OverflowPolicy policy, size_t capacity) {
+  if (async()) {
+    throw logic_error("Logger is already asynchronous");
+  }
+  policy_ = policy;
+  capacity_ = capacity;
+  {
+    // Buffers are made anew with new capacity
+    lock_guard<mutex> lock(producers_mutex_);
+    producers_.clear();
   }
+  generation_.fetch_add(1, memory_order_relaxed);
+  stop_ = false;
+  thread_ = thread(&Logger::Run, this);
+  async_.store(true, memory_order_release);
+}
+
+void Logger::StopAsync() noexcept {
+  if (!async_.exchange(false, memory_order_acq_rel)) return;
+  {
+    lock_guard<mutex> lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void Logger::Flush() noexcept {
+  // Destinations may log too
+  if (consuming) return;
+  unique_lock<mutex> lock(wake_mutex_);
+  if (!async_.load(memory_order_acquire)) {
+    lock.unlock();
+    ReportSuppressed(true);
+    return;
+  }
+  uint64_t request = ++flush_requests_;
+  wake_.notify_one();
+  flushed_.wait(lock, [this, request]() { return flushes_done_ >= request || stop_; });
 }
 
 void Logger::set_level(const LogMessageLevel level) noexcept {
-  level_ = level;
+  level_.store(level, memory_order_relaxed);
+  UpdateMaxLevel();
+}
+
+void Logger::set_binary_log(BinaryLog *binary_log, LogMessageLevel level) noexcept {
+  binary_log_ = binary_log;
+  binary_level_.store(binary_log ? level : -1, memory_order_relaxed);
+  UpdateMaxLevel();
+}
+
+void Logger::set_flight_recorder(FlightRecorder *flight_recorder) noexcept {
+  flight_recorder_ = flight_recorder;
+  UpdateMaxLevel();
 }
 
 void Logger::set_write_to_stderr(const bool write_to_stderr) noexcept {
   write_to_stderr_ = write_to_stderr;
 }
 
-void Logger::set_name(const char *) noexcept {
+void Logger::set_name(const char *name) noexcept {
   name_ = name;
 }
 
 void Logger::set_time_facet(TimeFacet *time_facet) noexcept {
-  delete time_facet_;
+  // Previous facet is released by locale
   time_facet_ = time_facet;
   time_format_.imbue(locale(time_format_.getloc(), time_facet_));
 }
+
+void Logger::ListSuppressed(LogRateLimit &limit, const LogSite &site, LogMessageLevel level,
+                            chrono::nanoseconds interval) noexcept {
+  lock_guard<mutex> lock(suppressed_mutex_);
+  limit.site = &site;
+  limit.level = level;
+  limit.interval = interval.count();
+  limit.next = suppressed_;
+  suppressed_ = &limit;
+  int64_t due = limit.window_start.load(memory_order_relaxed) + limit.interval;
+  if (due < suppressed_due_.load(memory_order_relaxed)) suppressed_due_.store(due, memory_order_relaxed);
+}
+
+void Logger::ReportSuppressed(bool all) noexcept {
+  struct Summary {
+    const LogSite *site;
+    LogMessageLevel level;
+    uint32_t suppressed;
+  };
+  vector<Summary> summaries;
+  {
+    lock_guard<mutex> lock(suppressed_mutex_);
+    if (!suppressed_) return;
+    int64_t now = LimitTime(), due = kNeverDue;
+    for (LogRateLimit **link = &suppressed_; *link; ) {
+      LogRateLimit &limit = **link;
+      int64_t end = limit.window_start.load(memory_order_relaxed) + limit.interval;
+      if (!all && now < end) {
+        due = min(due, end);
+        link = &limit.next;
+        continue;
+      }
+      *link = limit.next;
+      // Message refused from now on lists limit again
+      limit.listed.store(false, memory_order_relaxed);
+      uint32_t suppressed = limit.suppressed.exchange(0, memory_order_relaxed);
+      if (suppressed != 0) summaries.push_back(Summary{ limit.site, limit.level, suppressed });
+    }
+    suppressed_due_.store(due, memory_order_relaxed);
+  }
+  // Logged without the lock, as refused messages take it
+  for (const Summary &summary : summaries) {
+    LogSuppressed(*summary.site, summary.level, summary.suppressed);
+  }
+}
+
+void Logger::UpdateMaxLevel() noexcept {
+  // Flight recorder keeps records of all levels
+  int level = flight_recorder_ ? kDebug : max<int>(level_.load(memory_order_relaxed),
+                                                   binary_level_.load(memory_order_relaxed));
+  max_level_.store(level, memory_order_relaxed);
+}
+
+Logger::Producer &Logger::LocalProducer() {
+  // Holder marks buffer as finished when thread exits; logger keeps it
+  // until remaining records are written
+  struct Holder {
+    ~Holder() {
+      if (producer) producer->finished.store(true, memory_order_release);
+    }
+
+    shared_ptr<Producer> producer;
+    size_t generation = 0;
+  };
+  thread_local Holder holder;
+  size_t generation = generation_.load(memory_order_relaxed);
+  if (!holder.producer || holder.generation != generation) {
+    holder.producer = make_shared<Producer>(capacity_);
+    holder.generation = generation;
+    lock_guard<mutex> lock(producers_mutex_);
+    producers_.push_back(holder.producer);
+  }
+  return *holder.producer;
+}
+
+Logger::Producer::Producer(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity || size < sizeof(RecordHeader) + kMaxMessage) {
+    size <<= 1;
+  }
+  data.reset(new char[size]);
+  // Pages are faulted in here rather than by first records
+  memset(data.get(), 0, size);
+  mask = size - 1;
+}
+
+bool Logger::Producer::Push(LogMessageLevel level, chrono::system_clock::time_point time, const char *msg,
+                            size_t size) noexcept {
+  size_t position = head.load(memory_order_relaxed);
+  size_t length = sizeof(RecordHeader) + size;
+  if (mask + 1 - (position - cached_tail) < length) {
+    cached_tail = tail.load(memory_order_acquire);
+    if (mask + 1 - (position - cached_tail) < length) return false;
+  }
+  RecordHeader header = { time.time_since_epoch().count(), static_cast<uint32_t>(level),
+                          static_cast<uint32_t>(size) };
+  CopyIn(position, &header, sizeof(header));
+  CopyIn(position + sizeof(header), msg, size);
+  head.store(position + length, memory_order_release);
+  return true;
+}
+
+bool Logger::Producer::Pop(Record &record) noexcept {
+  size_t position = tail.load(memory_order_relaxed);
+  if (position == head.load(memory_order_acquire)) return false;
+  RecordHeader header;
+  CopyOut(position, &header, sizeof(header));
+  record.time = chrono::system_clock::time_point(chrono::system_clock::duration(header.time));
+  record.level = static_cast<LogMessageLevel>(header.level);
+  CopyOut(position + sizeof(header), record.text, header.size);
+  record.text[header.size] = '\0';
+  tail.store(position + sizeof(header) + header.size, memory_order_release);
+  return true;
+}
+
+void Logger::Producer::CopyIn(size_t position, const void *from, size_t size) noexcept {
+  size_t offset = position & mask;
+  size_t first = min(size, mask + 1 - offset);
+  memcpy(data.get() + offset, from, first);
+  memcpy(data.get(), static_cast<const char *>(from) + first, size - first);
+}
+
+void Logger::Producer::CopyOut(size_t position, void *to, size_t size) const noexcept {
+  size_t offset = position & mask;
+  size_t first = min(size, mask + 1 - offset);
+  memcpy(to, data.get() + offset, first);
+  memcpy(static_cast<char *>(to) + first, data.get(), size - first);
+}
+
+void Logger::Run() noexcept {
+  consuming = true;
+  vector<Record> batch;
+  while (true) {
+    uint64_t request;
+    bool stop;
+    {
+      unique_lock<mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, kWriteInterval, [this]() { return stop_ || flush_requests_ != flushes_done_; });
+      request = flush_requests_;
+      stop = stop_;
+    }
+    ReportSuppressed(stop || request != flushes_done_);
+    // Keep collecting while producers are busy
+    while (Collect(batch)) {
+      lock_guard<mutex> lock(write_mutex_);
+      for (const Record &record : batch) {
+        Write(record.level, record.time, record.text);
+      }
+      batch.clear();
+    }
+    cerr.flush();
+    {
+      lock_guard<mutex> lock(wake_mutex_);
+      flushes_done_ = request;
+    }
+    flushed_.notify_all();
+    if (stop) break;
+  }
+}
+
+bool Logger::Collect(vector<Record> &batch) noexcept {
+  lock_guard<mutex> lock(producers_mutex_);
+  Record record;
+  for (auto i = producers_.begin(); i != producers_.end() && batch.size() < kMaxBatch; ) {
+    Producer &producer = **i;
+    // Finished flag is read first, so nothing is left after it is seen
+    bool finished = producer.finished.load(memory_order_acquire);
+    bool empty = false;
+    while (batch.size() < kMaxBatch) {
+      if (!producer.Pop(record)) {
+        empty = true;
+        break;
+      }
+      batch.push_back(record);
+    }
+    if (finished && empty) {
+      i = producers_.erase(i);
+    } else {
+      ++i;
+    }
+  }
+  // Records of different threads are interleaved by time
+  stable_sort(batch.begin(), batch.end(),
+              [](const Record &a, const Record &b) { return a.time < b.time; });
+  return !batch.empty();
+}
+
+void Logger::Write(LogMessageLevel level, chrono::system_clock::time_point time, const char *msg) noexcept {
+  writing = true;
+  try {
+    if (write_to_stderr_) {
+      ptime local = boost::date_time::c_local_adjustor<ptime>::utc_to_local(
+        from_time_t(chrono::system_clock::to_time_t(time)));
+      time_format_.str("");
+      time_format_ << local;
+      line_.clear();
+      line_ += LevelName(level)[0];
+      line_ += " [";
+      line_ += time_format_.str();
+      line_ += "] ";
+      line_ += name_;
+      line_ += ": ";
+      line_ += msg;
+      line_ += '\n';
+      cerr.write(line_.data(), line_.size());
+    }
+    for (auto &dest : destinations_) {
+      dest(level, msg);
+    }
+  } catch (exception &e) {
+    write_to_stderr_ = true;
+    cerr << "C " << name_ << ": Logger destination threw an exception: " << e.what() << endl;
+  }
+  writing = false;
+}
+
+bool LogRateLimit::Allow(const LogSite &site, LogMessageLevel level, uint32_t count, chrono::nanoseconds interval,
+                         uint32_t &suppressed) noexcept {
+  int64_t now = LimitTime();
+  int64_t start = window_start.load(memory_order_relaxed);
+  // Thread which moves window resets its count; messages racing with it
+  // may be counted in either window, which is fine for a limit of spam
+  if (now - start >= interval.count() && window_start.compare_exchange_strong(start, now, memory_order_relaxed)) {
+    window_count.store(0, memory_order_relaxed);
+  }
+  // Count is not increased past limit, so it never wraps
+  if (window_count.load(memory_order_relaxed) < count &&
+      window_count.fetch_add(1, memory_order_relaxed) < count) {
+    suppressed = this->suppressed.exchange(0, memory_order_relaxed);
+    return true;
+  }
+  // The first refused message of a burst asks logger to report it, in
+  // case nothing else is logged by this site
+  if (this->suppressed.fetch_add(1, memory_order_relaxed) == 0 && !listed.exchange(true, memory_order_relaxed)) {
+    Logger::instance().ListSuppressed(*this, site, level, interval);
+  }
+  return false;
+}
+
+void logging::LogSuppressed(const LogSite &site, LogMessageLevel level, uint32_t suppressed) {
+  LogAt(level, "Suppressed {} similar messages from {}:{}", suppressed, site.file, site.line);
+}
+
+void LogArguments::AppendString(const char *data, size_t size) noexcept {
+  if (size_ + 1 + sizeof(uint16_t) > kMaxSize) return;
+  uint16_t length = static_cast<uint16_t>(min(size, kMaxSize - size_ - 1 - sizeof(length)));
+  data_[size_] = static_cast<char>(kString);
+  memcpy(data_ + size_ + 1, &length, sizeof(length));
+  memcpy(data_ + size_ + 1 + sizeof(length), data, length);
+  size_ += 1 + sizeof(length) + length;
+}
+
+void LogBuffer::Append(const char *data, size_t size) noexcept {
+  size = min(size, Logger::kMaxMessage - size_);
+  memcpy(data_ + size_, data, size);
+  size_ += size;
+}
+
+void LogBuffer::AppendSigned(long long value) noexcept {
+  if (value < 0) {
+    Append("-", 1);
+    // Works for the smallest value too
+    AppendUnsigned(0ull - static_cast<unsigned long long>(value));
+  } else {
+    AppendUnsigned(static_cast<unsigned long long>(value));
+  }
+}
+
+void LogBuffer::AppendUnsigned(unsigned long long value) noexcept {
+  char digits[20];
+  char *begin = digits + sizeof(digits);
+  do {
+    *--begin = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  Append(begin, digits + sizeof(digits) - begin);
+}
+
+void LogBuffer::AppendDouble(double value) noexcept {
+  char text[32];
+  int size = snprintf(text, sizeof(text), "%g", value);
+  if (size > 0) Append(text, min(static_cast<size_t>(size), sizeof(text) - 1));
+}
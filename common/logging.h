@@ -1,12 +1,23 @@
 #ifndef YOBAHACK_COMMON_LOGGING_H_
 #define YOBAHACK_COMMON_LOGGING_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
 #include "common/singleton.h"
+#include "common/debug.h"
 
 namespace logging {
 
@@ -22,34 +33,173 @@ enum LogMessageLevel {
 /** Returns name of givel LogMessageLevel */
 const char *LevelName(const LogMessageLevel level);
 
+class BinaryLog;
+class FlightRecorder;
+class LogArguments;
+
+/** Call site of logging macro.
+ * Every site has one static instance, which is constant-initialized, so
+ * it costs nothing until the site logs.
+ */
+struct LogSite {
+  constexpr LogSite(const char *file, int line) noexcept : file(file), line(line), format_id(0) { }
+
+  const char *const file;
+  const int line;
+  std::atomic<std::uint32_t> format_id; ///< Given on first binary record (see BinaryLog), 0 until then
+};
+
+/** Limit of messages of one call site per interval (see LogLimited()).
+ * Window is fixed: the first message after interval has passed starts a
+ * new one. Like LogSite, every site has one constant-initialized instance,
+ * and checking it takes a few atomic operations and no locks. The first
+ * refused message lists the limit in Logger, so that the number of refused
+ * messages is reported even if the site falls silent.
+ */
+struct LogRateLimit {
+  constexpr LogRateLimit() noexcept
+      : window_start(0), window_count(0), suppressed(0), listed(false), site(nullptr), level(kDebug),
+        interval(0), next(nullptr) { }
+
+  /** Returns true if message fits into count messages per interval;
+   * suppressed receives number of messages refused since they were
+   * reported last time.
+   */
+  bool Allow(const LogSite &site, LogMessageLevel level, std::uint32_t count, std::chrono::nanoseconds interval,
+             std::uint32_t &suppressed) noexcept;
+
+  std::atomic<std::int64_t> window_start; ///< Nanoseconds of steady clock
+  std::atomic<std::uint32_t> window_count;
+  std::atomic<std::uint32_t> suppressed;
+  std::atomic<bool> listed; ///< Waits in Logger's list for report of suppressed messages
+  // Set when limit is listed, under Logger's lock
+  const LogSite *site;
+  LogMessageLevel level;
+  std::int64_t interval; ///< Nanoseconds
+  LogRateLimit *next; ///< Next in Logger's list
+};
+
+/** Passes every n-th message of one call site (see LogSampled()) */
+struct LogSample {
+  constexpr LogSample() noexcept : counter(0) { }
+
+  /** Returns true for the first message and then for every n-th */
+  inline bool Take(std::uint32_t every) noexcept {
+    return every <= 1 || counter.fetch_add(1, std::memory_order_relaxed) % every == 0;
+  }
+
+  std::atomic<std::uint32_t> counter;
+};
+
+/** What asynchronous logger does when producer's buffer is full */
+enum OverflowPolicy {
+  kDropRecords, ///< Record is dropped and counted (see Logger::dropped())
+  kBlock, ///< Caller waits until background thread makes room
+};
+
 /** Handles logging; receives messages and sends them to various destinations.
  * Singleton which splits logging messages between different destinations.
- * Not thread-safe.
+ * By default messages are written by calling thread under a lock. In
+ * asynchronous mode every thread copies its records into its own
+ * lock-free ring buffer, and one background thread formats and writes
+ * them, so logging costs a copy of the message on caller's side.
+ * Messages of logging macros can also be written to BinaryLog, which
+ * stores their arguments unformatted and has its own level, so debug
+ * records can be traced there while text log keeps only important ones.
+ * While FlightRecorder is recording, logging macros record messages of
+ * all levels.
+ * Numbers of messages suppressed by LogLimited() are reported once their
+ * interval is over: by the background thread, or in synchronous mode by
+ * the next message logged by any site; Flush() reports them at once.
+ * Log() is thread-safe; setters are not and should be called before
+ * logging starts.
  */
 class Logger : public Singleton<Logger> {
  public:
   typedef std::vector<std::function<void(LogMessageLevel, const char *)>> DestinationVector;
   typedef boost::posix_time::time_facet TimeFacet;
 
+  /** Longer messages are truncated in asynchronous mode */
+  static const std::size_t kMaxMessage = 232;
+
   Logger(const Logger &other) = delete;
   Logger(const Logger &&other) = delete;
 
-  /** Sends log message to destinations */
+  /** Sends log message to destinations; binary log does not receive it */
   void Log(LogMessageLevel level, const char *) noexcept;
 
+  /** Writes record of logging macro to binary log and flight recorder;
+   * format should be a string literal, since its pointer is kept
+   */
+  void LogBinary(LogSite &site, LogMessageLevel level, const char *format,
+                 const LogArguments &arguments) noexcept;
+  /** Writes ready message to binary log and flight recorder */
+  void LogBinary(LogMessageLevel level, const char *msg) noexcept;
+
+  /** Starts background thread; records are written by it from now on.
+   * \param capacity Size of buffer of every logging thread in bytes;
+   * rounded up to the power of two
+   */
+  void StartAsync(OverflowPolicy policy = kDropRecords, std::size_t capacity = 65536);
+
+  /** Writes buffered records and stops background thread */
+  void StopAsync() noexcept;
+
+  /** Waits until records logged so far are written; also reports
+   * messages suppressed so far (see LogLimited())
+   */
+  void Flush() noexcept;
+
+  inline bool async() const noexcept {
+    return async_.load(std::memory_order_acquire);
+  }
+
+  /** Number of records dropped because of full buffers */
+  inline std::size_t dropped() const noexcept {
+    return dropped_;
+  }
+
   /** Holds instances of LoggerDestination class which will receive log messages.
    * Not thread-safe, vector should not be modified if chance of logging call exists.
+   * In asynchronous mode destinations are called from background thread.
+   * Messages logged by destinations themselves go straight to stderr.
    */
   inline DestinationVector &destinations() noexcept {
     return destinations_;
   }
 
   inline LogMessageLevel level() const noexcept {
-    return level_;
+    return level_.load(std::memory_order_relaxed);
+  }
+
+  /** Returns true if messages of given level are logged anywhere */
+  inline bool enabled(LogMessageLevel level) const noexcept {
+    return level <= max_level_.load(std::memory_order_relaxed);
   }
 
   void set_level(const LogMessageLevel level) noexcept;
 
+  /** Returns true if messages of given level are written to binary log */
+  inline bool binary_enabled(LogMessageLevel level) const noexcept {
+    return level <= binary_level_.load(std::memory_order_relaxed);
+  }
+
+  inline BinaryLog *binary_log() const noexcept {
+    return binary_log_;
+  }
+
+  /** Sets binary log receiving messages up to given level; nullptr turns
+   * it off. Log is not owned and should outlive its use.
+   */
+  void set_binary_log(BinaryLog *binary_log, LogMessageLevel level = kDebug) noexcept;
+
+  inline FlightRecorder *flight_recorder() const noexcept {
+    return flight_recorder_;
+  }
+
+  /** Set by FlightRecorder::Start() and Stop() */
+  void set_flight_recorder(FlightRecorder *flight_recorder) noexcept;
+
   inline bool write_to_stderr() const noexcept {
     return write_to_stderr_;
   }
@@ -66,54 +216,420 @@ class Logger : public Singleton<Logger> {
     return *time_facet_;
   }
 
+  /** Sets format of time; logger takes ownership of facet */
   void set_time_facet(TimeFacet *time_facet) noexcept;
 
  private:
   friend class Singleton<Logger>;
+  friend struct LogRateLimit;
 
-  Logger() = default;
-  ~Logger() = default;
+  /** Log message copied by caller for background thread */
+  struct Record {
+    std::chrono::system_clock::time_point time;
+    LogMessageLevel level;
+    char text[kMaxMessage + 1];
+  };
+
+  /** Ring buffer of records of one logging thread.
+   * Single producer, single consumer: thread writes records after their
+   * header, background thread reads them, and each moves its own index.
+   */
+  struct Producer {
+    explicit Producer(std::size_t capacity);
+
+    /** Copies record into buffer; returns false if there is no room */
+    bool Push(LogMessageLevel level, std::chrono::system_clock::time_point time, const char *msg,
+              std::size_t size) noexcept;
+    /** Takes next record; called by background thread */
+    bool Pop(Record &record) noexcept;
+
+    void CopyIn(std::size_t position, const void *data, std::size_t size) noexcept;
+    void CopyOut(std::size_t position, void *data, std::size_t size) const noexcept;
+
+    std::unique_ptr<char[]> data;
+    std::size_t mask;
+    std::atomic<bool> finished{false}; ///< Thread has exited
+    // Indices are kept in separate cache lines, and producer rereads
+    // consumer's index only when buffer looks full
+    char padding1[64];
+    std::atomic<std::size_t> head{0}; ///< Moved by producer
+    std::size_t cached_tail = 0; ///< Used by producer
+    char padding2[64];
+    std::atomic<std::size_t> tail{0}; ///< Moved by background thread
+    char padding3[64];
+  };
+
+  Logger();
+  ~Logger();
+
+  /** Returns buffer of calling thread, registering it on first use */
+  Producer &LocalProducer();
+  /** Body of background thread */
+  void Run() noexcept;
+  /** Moves records of all producers to batch; returns false if there were none */
+  bool Collect(std::vector<Record> &batch) noexcept;
+  /** Updates most verbose level which is logged anywhere */
+  void UpdateMaxLevel() noexcept;
+  static const std::int64_t kNeverDue = INT64_MAX;
+
+  /** Adds limit with suppressed messages to the list of ReportSuppressed() */
+  void ListSuppressed(LogRateLimit &limit, const LogSite &site, LogMessageLevel level,
+                      std::chrono::nanoseconds interval) noexcept;
+  /** Logs numbers of suppressed messages of listed limits whose window is
+   * over, or of all of them, and takes them off the list
+   */
+  void ReportSuppressed(bool all) noexcept;
+  /** Formats message and sends it to destinations; write_mutex_ should be locked */
+  void Write(LogMessageLevel level, std::chrono::system_clock::time_point time, const char *msg) noexcept;
 
   DestinationVector destinations_;
   bool write_to_stderr_ = true;
-  LogMessageLevel level_ = kNotice;
+  std::atomic<LogMessageLevel> level_{kNotice};
+  std::atomic<int> binary_level_{-1}; ///< -1 if there is no binary log
+  std::atomic<int> max_level_{kNotice};
+  BinaryLog *binary_log_ = nullptr;
+  FlightRecorder *flight_recorder_ = nullptr;
   const char *name_ = "";
-  TimeFacet *time_facet_;
+  TimeFacet *time_facet_; ///< Owned by locale of time_format_
   std::stringstream time_format_;
+  std::string line_; ///< Used by Write()
+  std::mutex write_mutex_;
+
+  std::mutex suppressed_mutex_;
+  LogRateLimit *suppressed_ = nullptr; ///< Limits with suppressed messages to report
+  /** Earliest end of window of listed limits, in nanoseconds of steady clock */
+  std::atomic<std::int64_t> suppressed_due_{kNeverDue};
+
+  std::atomic<bool> async_{false};
+  OverflowPolicy policy_ = kDropRecords;
+  std::size_t capacity_ = 0;
+  std::atomic<std::size_t> generation_{0}; ///< Incremented by StartAsync(), which makes new buffers
+  std::atomic<std::size_t> dropped_{0};
+  std::mutex producers_mutex_;
+  std::vector<std::shared_ptr<Producer>> producers_;
+  std::thread thread_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_; ///< Wakes background thread
+  std::condition_variable flushed_; ///< Signalled when flush request is done
+  std::uint64_t flush_requests_ = 0;
+  std::uint64_t flushes_done_ = 0;
+  bool stop_ = false;
 };
 
+/** Text of message being formatted; longer text is truncated */
+class LogBuffer {
+ public:
+  void Append(const char *data, std::size_t size) noexcept;
+
+  inline void Append(const char *str) noexcept {
+    Append(str, std::strlen(str));
+  }
+
+  void AppendSigned(long long value) noexcept;
+  void AppendUnsigned(unsigned long long value) noexcept;
+  void AppendDouble(double value) noexcept;
+
+  /** Null-terminated text */
+  inline const char *c_str() noexcept {
+    data_[size_] = '\0';
+    return data_;
+  }
+
+ private:
+  char data_[Logger::kMaxMessage + 1];
+  std::size_t size_ = 0;
+};
+
+inline void FormatArgument(LogBuffer &buffer, const char *value) noexcept {
+  buffer.Append(value ? value : "(null)");
 }
 
-// TODO(abbradar) Comment properly
+inline void FormatArgument(LogBuffer &buffer, const std::string &value) noexcept {
+  buffer.Append(value.data(), value.size());
+}
 
-/** Convenience function */
-inline void Log(logging::LogMessageLevel level, const char *msg) {
-  logging::Logger::instance().Log(level, msg);
+inline void FormatArgument(LogBuffer &buffer, bool value) noexcept {
+  buffer.Append(value ? "true" : "false");
+}
+
+inline void FormatArgument(LogBuffer &buffer, char value) noexcept {
+  buffer.Append(&value, 1);
 }
 
-/** Convenience function */
-inline void LogDebug(const char *msg) {
-  Log(logging::kDebug, msg);
+template <class T>
+ inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+ FormatArgument(LogBuffer &buffer, const T &value) noexcept {
+  buffer.AppendSigned(value);
 }
 
-/** Convenience function */
-inline void LogNotice(const char *msg) {
-  Log(logging::kNotice, msg);
+template <class T>
+ inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+ FormatArgument(LogBuffer &buffer, const T &value) noexcept {
+  buffer.AppendUnsigned(value);
 }
 
-/** Convenience function */
-inline void LogWarning(const char *msg) {
-  Log(logging::kWarning, msg);
+template <class T>
+ inline typename std::enable_if<std::is_floating_point<T>::value>::type
+ FormatArgument(LogBuffer &buffer, const T &value) noexcept {
+  buffer.AppendDouble(value);
 }
 
-/** Convenience function */
-inline void LogError(const char *msg) {
-  Log(logging::kError, msg);
+/** Anything else which can be written to std::ostream */
+template <class T>
+ typename std::enable_if<!std::is_arithmetic<T>::value>::type
+ FormatArgument(LogBuffer &buffer, const T &value) {
+  std::ostringstream stream;
+  stream << value;
+  FormatArgument(buffer, stream.str());
 }
 
-/** Convenience function */
-inline void LogCritical(const char *msg) {
-  Log(logging::kCritical, msg);
+inline void FormatRest(LogBuffer &buffer, const char *format) noexcept {
+  buffer.Append(format);
+}
+
+template <class First, class... Rest>
+ void FormatRest(LogBuffer &buffer, const char *format, const First &first, const Rest &... rest) {
+  const char *placeholder = std::strstr(format, "{}");
+  if (!placeholder) {
+    buffer.Append(format);
+    return;
+  }
+  buffer.Append(format, placeholder - format);
+  FormatArgument(buffer, first);
+  FormatRest(buffer, placeholder + 2, rest...);
+}
+
+/** Arguments of binary record, unformatted.
+ * Every argument is its type byte followed by its bytes in host order;
+ * strings are preceded by 16-bit length. Arguments which do not fit are
+ * dropped.
+ */
+class LogArguments {
+ public:
+  static const std::size_t kMaxSize = 256;
+
+  enum Type : std::uint8_t {
+    kSigned, ///< std::int64_t
+    kUnsigned, ///< std::uint64_t
+    kDouble,
+    kBool, ///< One byte
+    kChar,
+    kString,
+  };
+
+  inline void Append(Type type, const void *value, std::size_t size) noexcept {
+    if (size + 1 > kMaxSize - size_) return;
+    data_[size_] = static_cast<char>(type);
+    std::memcpy(data_ + size_ + 1, value, size);
+    size_ += size + 1;
+  }
+
+  /** Appends string, truncated to fit */
+  void AppendString(const char *data, std::size_t size) noexcept;
+
+  inline const char *data() const noexcept {
+    return data_;
+  }
+
+  inline std::size_t size() const noexcept {
+    return size_;
+  }
+
+ private:
+  char data_[kMaxSize];
+  std::size_t size_ = 0;
+};
+
+inline void EncodeArgument(LogArguments &arguments, const char *value) noexcept {
+  if (!value) value = "(null)";
+  arguments.AppendString(value, std::strlen(value));
+}
+
+inline void EncodeArgument(LogArguments &arguments, const std::string &value) noexcept {
+  arguments.AppendString(value.data(), value.size());
+}
+
+inline void EncodeArgument(LogArguments &arguments, bool value) noexcept {
+  arguments.Append(LogArguments::kBool, &value, 1);
+}
+
+inline void EncodeArgument(LogArguments &arguments, char value) noexcept {
+  arguments.Append(LogArguments::kChar, &value, 1);
+}
+
+template <class T>
+ inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+ EncodeArgument(LogArguments &arguments, const T &value) noexcept {
+  std::int64_t wide = value;
+  arguments.Append(LogArguments::kSigned, &wide, sizeof(wide));
+}
+
+template <class T>
+ inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+ EncodeArgument(LogArguments &arguments, const T &value) noexcept {
+  std::uint64_t wide = value;
+  arguments.Append(LogArguments::kUnsigned, &wide, sizeof(wide));
+}
+
+template <class T>
+ inline typename std::enable_if<std::is_floating_point<T>::value>::type
+ EncodeArgument(LogArguments &arguments, const T &value) noexcept {
+  double wide = value;
+  arguments.Append(LogArguments::kDouble, &wide, sizeof(wide));
+}
+
+/** Anything else is stored as its text */
+template <class T>
+ typename std::enable_if<!std::is_arithmetic<T>::value>::type
+ EncodeArgument(LogArguments &arguments, const T &value) {
+  std::ostringstream stream;
+  stream << value;
+  EncodeArgument(arguments, stream.str());
+}
+
+inline void EncodeArguments(LogArguments &) noexcept {
+}
+
+template <class First, class... Rest>
+ void EncodeArguments(LogArguments &arguments, const First &first, const Rest &... rest) {
+  EncodeArgument(arguments, first);
+  EncodeArguments(arguments, rest...);
+}
+
+/** Formats message and logs it.
+ * Every "{}" in format is replaced with next argument; arguments left
+ * without placeholder are ignored. Message without arguments is logged
+ * as it is.
+ */
+template <class... Args> void LogFormat(LogMessageLevel level, const char *format, const Args &... args) {
+  LogBuffer buffer;
+  FormatRest(buffer, format, args...);
+  Logger::instance().Log(level, buffer.c_str());
+}
+
+inline void LogFormat(LogMessageLevel level, const char *message) noexcept {
+  Logger::instance().Log(level, message);
+}
+
+/** Literal format is the same on every call, so it is stored once and
+ * binary records keep only arguments
+ */
+template <class... Args>
+ void LogBinary(LogSite &site, LogMessageLevel level, const char *format, std::true_type,
+                const Args &... args) {
+  LogArguments arguments;
+  EncodeArguments(arguments, args...);
+  Logger::instance().LogBinary(site, level, format, arguments);
+}
+
+/** Any other format may change, so message is formatted */
+template <class... Args>
+ void LogBinary(LogSite &, LogMessageLevel level, const char *format, std::false_type,
+                const Args &... args) {
+  LogBuffer buffer;
+  FormatRest(buffer, format, args...);
+  Logger::instance().LogBinary(level, buffer.c_str());
+}
+
+/** Logs message of logging macro to flight recorder, and to binary and
+ * text logs as their levels allow.
+ * \param Spelled True if macro saw a string literal as its format; array
+ * which is not spelled so (e.g. char buffer) is formatted as any other
+ * format, since binary log and flight recorder keep the pointer for good
+ */
+template <bool Spelled, class Format, class... Args>
+ void LogFormat(LogSite &site, LogMessageLevel level, std::integral_constant<bool, Spelled>,
+                const Format &format, const Args &... args) {
+  Logger &logger = Logger::instance();
+  if (logger.flight_recorder() || logger.binary_enabled(level)) {
+    LogBinary(site, level, format, std::integral_constant<bool, Spelled && std::is_array<Format>::value>(),
+              args...);
+  }
+  if (level <= logger.level()) LogFormat(level, format, args...);
+}
+
+/** Logs how many messages of site were suppressed by its LogRateLimit */
+void LogSuppressed(const LogSite &site, LogMessageLevel level, std::uint32_t suppressed);
+
+}
+
+#ifndef LOG_MAX_LEVEL
+/** Most verbose level of messages compiled in; logging macros of higher
+ * levels compile to nothing. Debug messages are compiled in when
+ * DEBUG_LEVEL is 2 or higher. Release builds which trace debug messages to
+ * binary log or flight recorder define it as 4 (LOG_DEBUG_SITES option of
+ * CMake); then every disabled debug message costs a load and comparison.
+ */
+#if DEBUG_LEVEL >= 2
+#define LOG_MAX_LEVEL 4
+#else
+#define LOG_MAX_LEVEL 3
+#endif
+#endif
+
+/** Whether first of macro arguments is spelled as a string literal */
+#define LOG_LITERAL_FORMAT(...) std::integral_constant<bool, (#__VA_ARGS__)[0] == '"'>()
+
+/** Logs message of given level: LogAt(logging::kNotice, "Player {} joined", name).
+ * Arguments are evaluated and formatted only if message is logged (see
+ * LogFormat()). Binary log receives literal format once and then only
+ * arguments of every message.
+ */
+#define LogAt(level, ...)                                               \
+  do {                                                                  \
+    if ((level) <= LOG_MAX_LEVEL && ::logging::Logger::instance().enabled(level)) { \
+      static ::logging::LogSite log_site(__FILE__, __LINE__);          \
+      ::logging::LogFormat(log_site, (level), LOG_LITERAL_FORMAT(__VA_ARGS__), \
+                           __VA_ARGS__);                                \
+    }                                                                   \
+  } while (false)
+
+/** Logs message of given level, but at most count messages of this call
+ * site per interval: LogLimited(logging::kWarning, 10, std::chrono::seconds(1), "Slow client").
+ * Suppressed messages are not formatted and do not reach any destination;
+ * their number is logged as "Suppressed K similar messages from file:line"
+ * before the next message let through, or when the interval is over and
+ * the site is silent (see Logger).
+ */
+#define LogLimited(level, count, interval, ...)                         \
+  do {                                                                  \
+    if ((level) <= LOG_MAX_LEVEL && ::logging::Logger::instance().enabled(level)) { \
+      static ::logging::LogSite log_site(__FILE__, __LINE__);          \
+      static ::logging::LogRateLimit log_limit;                         \
+      std::uint32_t log_suppressed = 0;                                 \
+      if (log_limit.Allow(log_site, (level), (count), (interval), log_suppressed)) { \
+        if (log_suppressed != 0) ::logging::LogSuppressed(log_site, (level), log_suppressed); \
+        ::logging::LogFormat(log_site, (level), LOG_LITERAL_FORMAT(__VA_ARGS__), \
+                             __VA_ARGS__);                              \
+      }                                                                 \
+    }                                                                   \
+  } while (false)
+
+/** Logs the first and then every n-th message of this call site:
+ * LogSampled(logging::kDebug, 100, "Packet from {}", endpoint).
+ */
+#define LogSampled(level, every, ...)                                   \
+  do {                                                                  \
+    if ((level) <= LOG_MAX_LEVEL && ::logging::Logger::instance().enabled(level)) { \
+      static ::logging::LogSite log_site(__FILE__, __LINE__);          \
+      static ::logging::LogSample log_sample;                           \
+      if (log_sample.Take(every)) {                                     \
+        ::logging::LogFormat(log_site, (level), LOG_LITERAL_FORMAT(__VA_ARGS__), \
+                             __VA_ARGS__);                              \
+      }                                                                 \
+    }                                                                   \
+  } while (false)
+
+/** Same as LogAt() with corresponding level */
+#define LogDebug(...) LogAt(::logging::kDebug, __VA_ARGS__)
+#define LogNotice(...) LogAt(::logging::kNotice, __VA_ARGS__)
+#define LogWarning(...) LogAt(::logging::kWarning, __VA_ARGS__)
+#define LogError(...) LogAt(::logging::kError, __VA_ARGS__)
+#define LogCritical(...) LogAt(::logging::kCritical, __VA_ARGS__)
+
+/** Logs ready message; prefer LogAt() and friends, which check level first */
+inline void Log(logging::LogMessageLevel level, const char *msg) {
+  logging::Logger::instance().Log(level, msg);
 }
 
 #endif // YOBAHACK_COMMON_LOGGING_H_
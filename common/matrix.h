@@ -0,0 +1,80 @@
+#ifndef YOBAHACK_COMMON_MATRIX_H_
+#define YOBAHACK_COMMON_MATRIX_H_
+
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+
+/** Rectangular grid of values stored row by row.
+ * Used for the map: every cell also has a linear index
+ * row * cols() + col, which is what snapshots send over the wire.
+ */
+template <class T> class Matrix {
+ public:
+  typedef T value_type;
+
+  static const int kMaxSize = 16384;
+
+  Matrix() = default;
+
+  Matrix(int rows, int cols, const T &value = T()) : rows_(rows), cols_(cols) {
+    if (rows < 0 || rows > kMaxSize || cols < 0 || cols > kMaxSize) {
+      throw std::invalid_argument("Invalid matrix size");
+    }
+    data_.assign(static_cast<std::size_t>(rows) * cols, value);
+  }
+
+  inline int rows() const noexcept {
+    return rows_;
+  }
+
+  inline int cols() const noexcept {
+    return cols_;
+  }
+
+  /** Number of cells */
+  inline std::size_t size() const noexcept {
+    return data_.size();
+  }
+
+  inline T &at(int row, int col) {
+    return data_.at(Index(row, col));
+  }
+
+  inline const T &at(int row, int col) const {
+    return data_.at(Index(row, col));
+  }
+
+  /** Cell by linear index; not checked */
+  inline T &operator[](std::size_t index) noexcept {
+    return data_[index];
+  }
+
+  inline const T &operator[](std::size_t index) const noexcept {
+    return data_[index];
+  }
+
+  inline bool operator==(const Matrix &other) const {
+    return rows_ == other.rows_ && cols_ == other.cols_ && data_ == other.data_;
+  }
+
+  inline bool operator!=(const Matrix &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  inline std::size_t Index(int row, int col) const {
+    if (row < 0 || row >= rows_ || col < 0 || col >= cols_) {
+      throw std::out_of_range("Invalid cell");
+    }
+    return static_cast<std::size_t>(row) * cols_ + col;
+  }
+
+  int rows_ = 0;
+  int cols_ = 0;
+  std::vector<T> data_;
+};
+
+template <class T> const int Matrix<T>::kMaxSize;
+
+#endif // YOBAHACK_COMMON_MATRIX_H_
@@ -0,0 +1,439 @@
+#ifndef YOBAHACK_COMMON_MESSAGECODEC_H_
+#define YOBAHACK_COMMON_MESSAGECODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include "common/framebuffer.h"
+#include "common/outboundqueue.h"
+
+/** Binary codec of protocol messages.
+ * Every message is a plain struct which describes its wire layout once,
+ * as a MessageSchema of fields:
+ *
+ *   struct Move {
+ *     static const std::uint8_t kType = 3;
+ *     std::uint32_t entity;
+ *     std::int32_t row;
+ *     typedef MessageSchema<Move,
+ *                           MessageField<Move, std::uint32_t, &Move::entity, VarintCoding>,
+ *                           MessageField<Move, std::int32_t, &Move::row, VarintCoding>> Schema;
+ *   };
+ *
+ * Encoding and decoding are unrolled by templates at compile time, with no
+ * virtual calls. On the wire message is its type byte followed by fields
+ * in schema order. Decoder works right over the receive buffer (see Frame);
+ * byte fields are decoded as views into it.
+ */
+
+/** Writes message bytes to caller's buffer.
+ * Running out of space sets failure flag instead of throwing.
+ */
+class MessageWriter {
+ public:
+  MessageWriter(char *data, std::size_t capacity) noexcept : data_(data), capacity_(capacity) { }
+
+  inline void WriteByte(std::uint8_t value) noexcept {
+    if (size_ == capacity_) {
+      failed_ = true;
+      return;
+    }
+    data_[size_++] = static_cast<char>(value);
+  }
+
+  inline void WriteBytes(const char *data, std::size_t size) noexcept {
+    if (size > capacity_ - size_) {
+      failed_ = true;
+      return;
+    }
+    if (size != 0) std::memcpy(data_ + size_, data, size);
+    size_ += size;
+  }
+
+  inline std::size_t size() const noexcept {
+    return size_;
+  }
+
+  inline bool failed() const noexcept {
+    return failed_;
+  }
+
+ private:
+  char *data_;
+  std::size_t capacity_;
+  std::size_t size_ = 0;
+  bool failed_ = false;
+};
+
+/** Reads message bytes from receive buffer.
+ * Every read is checked against the end of data; after the first failed
+ * read all further reads fail too, so decoder checks failure only once.
+ */
+class MessageReader {
+ public:
+  MessageReader(const char *data, std::size_t size) noexcept : data_(data), size_(size) { }
+
+  inline bool ReadByte(std::uint8_t &value) noexcept {
+    if (failed_ || position_ == size_) {
+      failed_ = true;
+      return false;
+    }
+    value = static_cast<std::uint8_t>(data_[position_++]);
+    return true;
+  }
+
+  /** Skips given number of bytes; returns pointer to them or nullptr */
+  inline const char *ReadBytes(std::size_t size) noexcept {
+    if (failed_ || size > size_ - position_) {
+      failed_ = true;
+      return nullptr;
+    }
+    const char *result = data_ + position_;
+    position_ += size;
+    return result;
+  }
+
+  inline void Fail() noexcept {
+    failed_ = true;
+  }
+
+  inline std::size_t remaining() const noexcept {
+    return size_ - position_;
+  }
+
+  inline bool failed() const noexcept {
+    return failed_;
+  }
+
+ private:
+  const char *data_;
+  std::size_t size_;
+  std::size_t position_ = 0;
+  bool failed_ = false;
+};
+
+/** View of bytes; after decoding points into receive buffer */
+struct BytesView {
+  const char *data;
+  std::size_t size;
+
+  inline std::string str() const {
+    return std::string(data, size);
+  }
+};
+
+/** Size of message with fields of unbounded size */
+const std::size_t kUnboundedSize = std::numeric_limits<std::size_t>::max();
+
+/** Sum of sizes which saturates at kUnboundedSize */
+constexpr std::size_t AddMessageSizes(std::size_t a, std::size_t b) noexcept {
+  return a > kUnboundedSize - b ? kUnboundedSize : a + b;
+}
+
+/** Integer in little-endian byte order of its full width */
+struct FixedCoding {
+  template <class T> static constexpr std::size_t MinSize() noexcept {
+    return sizeof(T);
+  }
+
+  template <class T> static constexpr std::size_t MaxSize() noexcept {
+    return sizeof(T);
+  }
+
+  template <class T> static constexpr std::size_t Size(T value) noexcept {
+    return sizeof(T);
+  }
+
+  template <class T> static void Write(MessageWriter &writer, T value) noexcept {
+    static_assert(std::is_integral<T>::value, "Fixed coding needs integer type");
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    Unsigned bits = static_cast<Unsigned>(value);
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      writer.WriteByte(static_cast<std::uint8_t>(bits >> (8 * i)));
+    }
+  }
+
+  template <class T> static void Read(MessageReader &reader, T &value) noexcept {
+    static_assert(std::is_integral<T>::value, "Fixed coding needs integer type");
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    const char *bytes = reader.ReadBytes(sizeof(T));
+    if (!bytes) return;
+    Unsigned bits = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      bits |= static_cast<Unsigned>(static_cast<std::uint8_t>(bytes[i])) << (8 * i);
+    }
+    value = static_cast<T>(bits);
+  }
+};
+
+/** Integer in 7-bit groups with continuation bits, so small values take
+ * one byte; signed values are zigzag encoded first. Decoder rejects
+ * overlong encodings and values out of type range.
+ */
+struct VarintCoding {
+  template <class T> static constexpr std::size_t MinSize() noexcept {
+    return 1;
+  }
+
+  template <class T> static constexpr std::size_t MaxSize() noexcept {
+    return (sizeof(T) * 8 + 6) / 7;
+  }
+
+  template <class T> static inline std::size_t Size(T value) noexcept {
+    std::uint64_t bits = ZigZag(value, std::is_signed<T>());
+    std::size_t size = 1;
+    for (; bits >= 0x80; bits >>= 7) {
+      ++size;
+    }
+    return size;
+  }
+
+  template <class T> static void Write(MessageWriter &writer, T value) noexcept {
+    static_assert(std::is_integral<T>::value, "Varint coding needs integer type");
+    std::uint64_t bits = ZigZag(value, std::is_signed<T>());
+    while (bits >= 0x80) {
+      writer.WriteByte(static_cast<std::uint8_t>(bits | 0x80));
+      bits >>= 7;
+    }
+    writer.WriteByte(static_cast<std::uint8_t>(bits));
+  }
+
+  template <class T> static void Read(MessageReader &reader, T &value) noexcept {
+    static_assert(std::is_integral<T>::value, "Varint coding needs integer type");
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    std::uint64_t bits = 0;
+    std::uint8_t byte = 0x80;
+    for (unsigned int shift = 0; byte & 0x80; shift += 7) {
+      if (shift >= 8 * sizeof(T) || !reader.ReadByte(byte)) {
+        reader.Fail();
+        return;
+      }
+      std::uint64_t group = byte & 0x7f;
+      // Zero last group means overlong encoding, bits beyond type width
+      // mean value out of range
+      if ((byte == 0 && shift != 0) ||
+          (shift + 7 > 8 * sizeof(T) && (group >> (8 * sizeof(T) - shift)) != 0)) {
+        reader.Fail();
+        return;
+      }
+      bits |= group << shift;
+    }
+    value = UnZigZag<T>(static_cast<Unsigned>(bits), std::is_signed<T>());
+  }
+
+ private:
+  template <class T> static inline std::uint64_t ZigZag(T value, std::true_type) noexcept {
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    return static_cast<Unsigned>((static_cast<Unsigned>(value) << 1) ^
+                                 static_cast<Unsigned>(value >> (8 * sizeof(T) - 1)));
+  }
+
+  template <class T> static inline std::uint64_t ZigZag(T value, std::false_type) noexcept {
+    return value;
+  }
+
+  template <class T, class Unsigned> static inline T UnZigZag(Unsigned bits, std::true_type) noexcept {
+    return static_cast<T>((bits >> 1) ^ (~(bits & 1) + 1));
+  }
+
+  template <class T, class Unsigned> static inline T UnZigZag(Unsigned bits, std::false_type) noexcept {
+    return static_cast<T>(bits);
+  }
+};
+
+/** Bytes with varint length; decoded as BytesView into receive buffer */
+struct BytesCoding {
+  template <class T> static constexpr std::size_t MinSize() noexcept {
+    return 1;
+  }
+
+  template <class T> static constexpr std::size_t MaxSize() noexcept {
+    return kUnboundedSize;
+  }
+
+  static inline std::size_t Size(const BytesView &value) noexcept {
+    return VarintCoding::Size(static_cast<std::uint32_t>(value.size)) + value.size;
+  }
+
+  static void Write(MessageWriter &writer, const BytesView &value) noexcept {
+    VarintCoding::Write<std::uint32_t>(writer, static_cast<std::uint32_t>(value.size));
+    writer.WriteBytes(value.data, value.size);
+  }
+
+  static void Read(MessageReader &reader, BytesView &value) noexcept {
+    std::uint32_t size = 0;
+    VarintCoding::Read(reader, size);
+    const char *data = reader.ReadBytes(size);
+    if (!data) return;
+    value.data = data;
+    value.size = size;
+  }
+};
+
+/** Field of message: its member and coding */
+template <class Message, class T, T Message::*Member, class Coding> struct MessageField {
+  static constexpr std::size_t MinSize() noexcept {
+    return Coding::template MinSize<T>();
+  }
+
+  static constexpr std::size_t MaxSize() noexcept {
+    return Coding::template MaxSize<T>();
+  }
+
+  static inline std::size_t Size(const Message &message) noexcept {
+    return Coding::Size(message.*Member);
+  }
+
+  static inline void Write(MessageWriter &writer, const Message &message) noexcept {
+    Coding::Write(writer, message.*Member);
+  }
+
+  static inline void Read(MessageReader &reader, Message &message) noexcept {
+    Coding::Read(reader, message.*Member);
+  }
+};
+
+/** Wire layout of message: its fields in order */
+template <class Message, class... Fields> struct MessageSchema;
+
+template <class Message> struct MessageSchema<Message> {
+  static constexpr std::size_t kFieldCount = 0;
+
+  static constexpr std::size_t MinSize() noexcept {
+    return 0;
+  }
+
+  static constexpr std::size_t MaxSize() noexcept {
+    return 0;
+  }
+
+  static inline std::size_t Size(const Message &message) noexcept {
+    return 0;
+  }
+
+  static inline void Write(MessageWriter &writer, const Message &message) noexcept { }
+  static inline void Read(MessageReader &reader, Message &message) noexcept { }
+};
+
+template <class Message, class First, class... Rest> struct MessageSchema<Message, First, Rest...> {
+  typedef MessageSchema<Message, Rest...> Next;
+
+  static constexpr std::size_t kFieldCount = 1 + Next::kFieldCount;
+
+  /** Smallest encoded size of fields */
+  static constexpr std::size_t MinSize() noexcept {
+    return First::MinSize() + Next::MinSize();
+  }
+
+  /** Largest encoded size of fields or kUnboundedSize */
+  static constexpr std::size_t MaxSize() noexcept {
+    return AddMessageSizes(First::MaxSize(), Next::MaxSize());
+  }
+
+  /** Encoded size of fields of given message */
+  static inline std::size_t Size(const Message &message) noexcept {
+    return First::Size(message) + Next::Size(message);
+  }
+
+  static inline void Write(MessageWriter &writer, const Message &message) noexcept {
+    First::Write(writer, message);
+    Next::Write(writer, message);
+  }
+
+  static inline void Read(MessageReader &reader, Message &message) noexcept {
+    First::Read(reader, message);
+    Next::Read(reader, message);
+  }
+};
+
+template <class Message> constexpr std::size_t MessageSchema<Message>::kFieldCount;
+template <class Message, class First, class... Rest>
+constexpr std::size_t MessageSchema<Message, First, Rest...>::kFieldCount;
+
+/** Largest encoded size of message, including type byte */
+template <class Message> constexpr std::size_t MaxMessageSize() noexcept {
+  return AddMessageSizes(1, Message::Schema::MaxSize());
+}
+
+/** Encodes message to buffer.
+ * \return encoded size or 0 if buffer is too small
+ */
+template <class Message> std::size_t EncodeMessage(const Message &message, char *out,
+                                                   std::size_t capacity) noexcept {
+  MessageWriter writer(out, capacity);
+  writer.WriteByte(Message::kType);
+  Message::Schema::Write(writer, message);
+  return writer.failed() ? 0 : writer.size();
+}
+
+/** Makes message with length header ready to be sent (see OutboundQueue) */
+template <class Message> OutboundMessage MakeMessage(const Message &message) {
+  std::size_t size = 1 + Message::Schema::Size(message);
+  std::string data(FrameBuffer::kHeaderSize + size, '\0');
+  FrameBuffer::WriteHeader(&data[0], static_cast<std::uint32_t>(size));
+  EncodeMessage(message, &data[FrameBuffer::kHeaderSize], size);
+  return std::make_shared<const std::string>(std::move(data));
+}
+
+/** Decodes message of known type.
+ * Fails on wrong type, truncated data, malformed fields or trailing bytes.
+ * Byte fields point into data.
+ */
+template <class Message> bool DecodeMessage(const char *data, std::size_t size, Message &message) noexcept {
+  MessageReader reader(data, size);
+  std::uint8_t type = 0;
+  if (!reader.ReadByte(type) || type != Message::kType || size - 1 < Message::Schema::MinSize()) {
+    return false;
+  }
+  Message::Schema::Read(reader, message);
+  return !reader.failed() && reader.remaining() == 0;
+}
+
+/** Set of messages which can arrive on one connection.
+ * Dispatch() decodes message by its type byte and passes it to handler,
+ * which should have operator() (or overloads) for every message type.
+ */
+template <class... Messages> struct MessageSet;
+
+template <> struct MessageSet<> {
+  static constexpr bool Contains(std::uint8_t type) noexcept {
+    return false;
+  }
+
+  template <class Handler> static inline bool Dispatch(std::uint8_t type, const char *data,
+                                                       std::size_t size, Handler &handler) {
+    return false;
+  }
+};
+
+template <class First, class... Rest> struct MessageSet<First, Rest...> {
+  typedef MessageSet<Rest...> Next;
+
+  static_assert(!Next::Contains(First::kType), "Message types should be unique");
+
+  static constexpr bool Contains(std::uint8_t type) noexcept {
+    return type == First::kType || Next::Contains(type);
+  }
+
+  /** Decodes message and calls handler.
+   * \return false if message type is unknown or message is malformed
+   */
+  template <class Handler> static bool Dispatch(const char *data, std::size_t size, Handler &handler) {
+    if (size == 0) return false;
+    return Dispatch(static_cast<std::uint8_t>(data[0]), data, size, handler);
+  }
+
+  template <class Handler> static inline bool Dispatch(std::uint8_t type, const char *data,
+                                                       std::size_t size, Handler &handler) {
+    if (type != First::kType) return Next::Dispatch(type, data, size, handler);
+    First message;
+    if (!DecodeMessage(data, size, message)) return false;
+    handler(message);
+    return true;
+  }
+};
+
+#endif // YOBAHACK_COMMON_MESSAGECODEC_H_
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include "common/framebuffer.h"
+#include "outboundqueue.h"
+
+using namespace std;
+
+OutboundMessage MakeFrame(const char *data, size_t size) {
+  char header[FrameBuffer::kHeaderSize];
+  FrameBuffer::WriteHeader(header, size);
+  string message;
+  message.reserve(sizeof(header) + size);
+  message.append(header, sizeof(header));
+  message.append(data, size);
+  return make_shared<const string>(move(message));
+}
+
+OutboundQueue::PushResult OutboundQueue::Push(OutboundMessage &&message, bool coalescable) {
+  lock_guard<mutex> lock(mutex_);
+  size_t size = message->size();
+  if (low_watermark_ && queued_bytes_ + writing_bytes_ + size > low_watermark_) {
+    DropCoalescable();
+    if (coalescable && queued_bytes_ + writing_bytes_ + size > low_watermark_) {
+      ++dropped_;
+      return kDropped;
+    }
+  }
+  if (high_watermark_ && queued_bytes_ + writing_bytes_ + size > high_watermark_) {
+    return kOverflow;
+  }
+  queued_bytes_ += size;
+  queued_.push_back(Entry{ move(message), coalescable });
+  if (in_flight_ || scheduled_) return kQueued;
+  scheduled_ = true;
+  return kScheduleFlush;
+}
+
+void OutboundQueue::set_watermarks(size_t low, size_t high) noexcept {
+  lock_guard<mutex> lock(mutex_);
+  low_watermark_ = low;
+  high_watermark_ = high;
+}
+
+void OutboundQueue::Reset() noexcept {
+  lock_guard<mutex> lock(mutex_);
+  queued_.clear();
+  writing_.clear();
+  buffers_.clear();
+  queued_bytes_ = writing_bytes_ = 0;
+  dropped_ = 0;
+  in_flight_ = scheduled_ = false;
+}
+
+size_t OutboundQueue::pending_bytes() noexcept {
+  lock_guard<mutex> lock(mutex_);
+  return queued_bytes_ + writing_bytes_;
+}
+
+size_t OutboundQueue::pending_messages() noexcept {
+  lock_guard<mutex> lock(mutex_);
+  return queued_.size() + writing_.size();
+}
+
+size_t OutboundQueue::dropped() noexcept {
+  lock_guard<mutex> lock(mutex_);
+  return dropped_;
+}
+
+void OutboundQueue::DropCoalescable() {
+  auto last = remove_if(queued_.begin(), queued_.end(), [this](const Entry &entry) {
+                          if (!entry.coalescable) return false;
+                          queued_bytes_ -= entry.message->size();
+                          ++dropped_;
+                          return true;
+                        });
+  queued_.erase(last, queued_.end());
+}
+
+void OutboundQueue::StartBatch() {
+  writing_.swap(queued_);
+  writing_bytes_ = queued_bytes_;
+  queued_bytes_ = 0;
+  buffers_.clear();
+  for (const Entry &entry : writing_) {
+    buffers_.push_back(boost::asio::buffer(*entry.message));
+  }
+  in_flight_ = true;
+}
@@ -0,0 +1,135 @@
+#ifndef YOBAHACK_COMMON_OUTBOUNDQUEUE_H_
+#define YOBAHACK_COMMON_OUTBOUNDQUEUE_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/system/error_code.hpp>
+#include <boost/asio.hpp>
+
+/** Immutable message ready to be sent; can be shared between queues */
+typedef std::shared_ptr<const std::string> OutboundMessage;
+
+/** Makes message with length header (see FrameBuffer) */
+OutboundMessage MakeFrame(const char *data, std::size_t size);
+
+/** Queue of outbound messages of one connection.
+ * At most one write is in flight at any time. Messages pushed while it is
+ * going are coalesced and sent by the next write as one gather (vectored)
+ * write, which is started as soon as previous one completes.
+ * Push() does not write anything by itself; call Flush() (typically once
+ * at the end of a tick) to start sending.
+ * Amount of pending data can be bounded with watermarks: above low one
+ * coalescable messages (state updates superseded by later ones) are
+ * dropped, above high one queue reports overflow and the peer should be
+ * disconnected.
+ * Thread-safe.
+ */
+class OutboundQueue {
+ public:
+  /** Result of Push() */
+  enum PushResult {
+    kQueued, ///< Flush is already scheduled or write is in flight
+    kScheduleFlush, ///< Queue was idle, someone should schedule a flush
+    kDropped, ///< Coalescable message dropped because of low watermark
+    kOverflow ///< Not queued, pending data would exceed high watermark
+  };
+
+  OutboundQueue() = default;
+  OutboundQueue(const OutboundQueue &other) = delete;
+  OutboundQueue(const OutboundQueue &&other) = delete;
+
+  /** Queues message for sending.
+   * When pending data would exceed low watermark, queued coalescable
+   * messages are discarded; coalescable message itself is queued only if
+   * it fits after that.
+   */
+  PushResult Push(OutboundMessage &&message, bool coalescable = false);
+
+  /** Sets watermarks in bytes of pending data; 0 means no limit */
+  void set_watermarks(std::size_t low, std::size_t high) noexcept;
+
+  /** Starts writing queued messages to stream if nothing is in flight.
+   * After the write, messages queued meanwhile are written too, until
+   * queue is empty. Then on_done(error) is called, with error if the
+   * last write failed.
+   * Queue and stream should outlive the operation.
+   * \return true if writing was started; otherwise on_done is not called
+   */
+  template <class AsyncWriteStream, class DoneHandler>
+   bool Flush(AsyncWriteStream &stream, DoneHandler on_done) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      scheduled_ = false;
+      if (in_flight_ || queued_.empty()) return false;
+      StartBatch();
+    }
+    Write(stream, on_done);
+    return true;
+  }
+
+  /** Drops all queued messages; should not be called while write is in flight */
+  void Reset() noexcept;
+
+  /** Bytes queued and in flight */
+  std::size_t pending_bytes() noexcept;
+
+  /** Messages queued and in flight */
+  std::size_t pending_messages() noexcept;
+
+  /** Number of coalescable messages dropped since last Reset() */
+  std::size_t dropped() noexcept;
+
+ private:
+  struct Entry {
+    OutboundMessage message;
+    bool coalescable;
+  };
+
+  /** Removes queued coalescable messages; mutex_ should be locked */
+  void DropCoalescable();
+
+  /** Moves queued messages to in-flight batch; mutex_ should be locked */
+  void StartBatch();
+
+  template <class AsyncWriteStream, class DoneHandler>
+   void Write(AsyncWriteStream &stream, DoneHandler on_done) {
+    boost::asio::async_write(stream, buffers_,
+                             [this, &stream, on_done](const boost::system::error_code &error, std::size_t) mutable {
+                               bool more = false;
+                               {
+                                 std::lock_guard<std::mutex> lock(mutex_);
+                                 writing_.clear();
+                                 writing_bytes_ = 0;
+                                 if (error || queued_.empty()) {
+                                   in_flight_ = false;
+                                 } else {
+                                   StartBatch();
+                                   more = true;
+                                 }
+                               }
+                               if (more) {
+                                 Write(stream, on_done);
+                               } else {
+                                 on_done(error);
+                               }
+                             });
+  }
+
+  std::mutex mutex_;
+  std::vector<Entry> queued_;
+  std::vector<Entry> writing_; ///< Kept alive until write completes
+  std::vector<boost::asio::const_buffer> buffers_;
+  std::size_t queued_bytes_ = 0;
+  std::size_t writing_bytes_ = 0;
+  std::size_t low_watermark_ = 0;
+  std::size_t high_watermark_ = 0;
+  std::size_t dropped_ = 0;
+  bool in_flight_ = false;
+  bool scheduled_ = false;
+};
+
+#endif // YOBAHACK_COMMON_OUTBOUNDQUEUE_H_
@@ -0,0 +1,63 @@
+#ifndef YOBAHACK_COMMON_PROTOCOL_H_
+#define YOBAHACK_COMMON_PROTOCOL_H_
+
+#include <cstdint>
+#include "common/messagecodec.h"
+
+/** Messages of game protocol between client and server (see MessageSchema) */
+
+const std::uint16_t kProtocolVersion = 1;
+
+/** Client introduces itself; first message on connection */
+struct HelloMessage {
+  static const std::uint8_t kType = 1;
+
+  std::uint16_t version;
+  BytesView name;
+
+  typedef MessageSchema<HelloMessage,
+                        MessageField<HelloMessage, std::uint16_t, &HelloMessage::version, FixedCoding>,
+                        MessageField<HelloMessage, BytesView, &HelloMessage::name, BytesCoding>> Schema;
+};
+
+/** Server accepts client; session is its token for unreliable channel */
+struct WelcomeMessage {
+  static const std::uint8_t kType = 2;
+
+  std::uint64_t session;
+  std::uint32_t player;
+
+  typedef MessageSchema<WelcomeMessage,
+                        MessageField<WelcomeMessage, std::uint64_t, &WelcomeMessage::session, FixedCoding>,
+                        MessageField<WelcomeMessage, std::uint32_t, &WelcomeMessage::player, VarintCoding>> Schema;
+};
+
+/** Entity moved to cell */
+struct MoveMessage {
+  static const std::uint8_t kType = 3;
+
+  std::uint32_t entity;
+  std::int32_t row;
+  std::int32_t col;
+
+  typedef MessageSchema<MoveMessage,
+                        MessageField<MoveMessage, std::uint32_t, &MoveMessage::entity, VarintCoding>,
+                        MessageField<MoveMessage, std::int32_t, &MoveMessage::row, VarintCoding>,
+                        MessageField<MoveMessage, std::int32_t, &MoveMessage::col, VarintCoding>> Schema;
+};
+
+/** Chat line from player */
+struct ChatMessage {
+  static const std::uint8_t kType = 4;
+
+  std::uint32_t player;
+  BytesView text;
+
+  typedef MessageSchema<ChatMessage,
+                        MessageField<ChatMessage, std::uint32_t, &ChatMessage::player, VarintCoding>,
+                        MessageField<ChatMessage, BytesView, &ChatMessage::text, BytesCoding>> Schema;
+};
+
+typedef MessageSet<HelloMessage, WelcomeMessage, MoveMessage, ChatMessage> GameMessages;
+
+#endif // YOBAHACK_COMMON_PROTOCOL_H_
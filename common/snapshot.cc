@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <stdexcept>
+#include "snapshot.h"
+
+using namespace std;
+
+const size_t SnapshotEncoder::kRingSize;
+
+namespace {
+
+const unsigned int kTickBits = 32;
+const unsigned int kSizeBits = 16;
+const unsigned int kCellBits = 8;
+
+inline bool LessId(const Entity &entity, uint32_t id) noexcept {
+  return entity.id < id;
+}
+
+void WriteEntity(BitWriter &writer, const Entity &entity) {
+  writer.WriteSigned(entity.row);
+  writer.WriteSigned(entity.col);
+  writer.WriteVarint(entity.state);
+}
+
+void ReadEntity(BitReader &reader, Entity &entity) noexcept {
+  entity.row = static_cast<int32_t>(reader.ReadSigned());
+  entity.col = static_cast<int32_t>(reader.ReadSigned());
+  entity.state = static_cast<uint32_t>(reader.ReadVarint());
+}
+
+/** Lower bound of full snapshot size in bits */
+size_t FullBits(const Snapshot &snapshot) noexcept {
+  // Every varint takes at least 5 bits
+  return 1 + kTickBits + 2 * kSizeBits + snapshot.cells().size() * kCellBits + 5 +
+    snapshot.entities().size() * 4 * 5;
+}
+
+}
+
+shared_ptr<const Snapshot> Snapshot::Make(Tick tick, CellMatrix &&cells, vector<Entity> &&entities,
+                                          const Snapshot *previous) {
+  shared_ptr<Snapshot> snapshot(new Snapshot());
+  snapshot->tick_ = tick;
+  snapshot->cells_ = move(cells);
+  snapshot->entities_ = move(entities);
+  sort(snapshot->entities_.begin(), snapshot->entities_.end(),
+       [](const Entity &a, const Entity &b) { return a.id < b.id; });
+  const vector<Entity> &current = snapshot->entities_;
+  if (!previous || previous->cells_.rows() != snapshot->cells_.rows() ||
+      previous->cells_.cols() != snapshot->cells_.cols()) {
+    return snapshot;
+  }
+  snapshot->has_changes_ = true;
+  const CellMatrix &before = previous->cells_;
+  for (size_t i = 0; i < before.size(); ++i) {
+    if (before[i] != snapshot->cells_[i]) snapshot->changed_cells_.push_back(static_cast<uint32_t>(i));
+  }
+  // Both lists are sorted by id, so merge them
+  const vector<Entity> &old = previous->entities_;
+  vector<uint32_t> &changed = snapshot->changed_entities_;
+  auto a = old.begin(), b = current.begin();
+  while (a != old.end() || b != current.end()) {
+    if (b == current.end() || (a != old.end() && a->id < b->id)) {
+      changed.push_back((a++)->id);
+    } else if (a == old.end() || b->id < a->id) {
+      changed.push_back((b++)->id);
+    } else {
+      if (*a != *b) changed.push_back(b->id);
+      ++a;
+      ++b;
+    }
+  }
+  return snapshot;
+}
+
+const Entity *Snapshot::Find(uint32_t id) const noexcept {
+  auto found = lower_bound(entities_.begin(), entities_.end(), id, LessId);
+  return found != entities_.end() && found->id == id ? &*found : nullptr;
+}
+
+void SnapshotHistory::Push(shared_ptr<const Snapshot> snapshot) {
+  if (snapshots_.size() >= capacity_) snapshots_.pop_front();
+  snapshots_.push_back(move(snapshot));
+}
+
+const Snapshot *SnapshotHistory::Find(Snapshot::Tick tick) const noexcept {
+  for (auto i = snapshots_.rbegin(); i != snapshots_.rend(); ++i) {
+    if ((*i)->tick() == tick) return i->get();
+  }
+  return nullptr;
+}
+
+bool SnapshotHistory::ChangesSince(Snapshot::Tick baseline, vector<uint32_t> &cells,
+                                   vector<uint32_t> &entities) const {
+  cells.clear();
+  entities.clear();
+  auto i = snapshots_.rbegin();
+  for (; i != snapshots_.rend() && (*i)->tick() != baseline; ++i) {
+    auto next = i + 1;
+    // Each snapshot should be made against the one before it
+    if (!(*i)->has_changes() || next == snapshots_.rend() || (*next)->tick() + 1 != (*i)->tick()) {
+      return false;
+    }
+    cells.insert(cells.end(), (*i)->changed_cells().begin(), (*i)->changed_cells().end());
+    entities.insert(entities.end(), (*i)->changed_entities().begin(), (*i)->changed_entities().end());
+  }
+  if (i == snapshots_.rend()) return false;
+  sort(cells.begin(), cells.end());
+  cells.erase(unique(cells.begin(), cells.end()), cells.end());
+  sort(entities.begin(), entities.end());
+  entities.erase(unique(entities.begin(), entities.end()), entities.end());
+  return true;
+}
+
+const string &SnapshotEncoder::Encode(const SnapshotHistory &history) {
+  const Snapshot *snapshot = history.latest().get();
+  if (!snapshot) {
+    throw logic_error("No snapshot to encode");
+  }
+  writer_.Clear();
+  if (has_acked_ && EncodeDelta(history, *snapshot)) {
+    ++delta_sent_;
+  } else {
+    writer_.Clear();
+    EncodeFull(*snapshot);
+    ++full_sent_;
+  }
+  sent_[sent_count_ % kRingSize] = snapshot->tick();
+  ++sent_count_;
+  return writer_.data();
+}
+
+void SnapshotEncoder::Acknowledge(Snapshot::Tick tick) noexcept {
+  if (has_acked_ && static_cast<int32_t>(tick - acked_) <= 0) return;
+  size_t count = min(sent_count_, kRingSize);
+  for (size_t i = 0; i < count; ++i) {
+    if (sent_[i] == tick) {
+      acked_ = tick;
+      has_acked_ = true;
+      return;
+    }
+  }
+}
+
+void SnapshotEncoder::Reset() noexcept {
+  has_acked_ = false;
+  sent_count_ = 0;
+}
+
+void SnapshotEncoder::EncodeFull(const Snapshot &snapshot) {
+  const CellMatrix &cells = snapshot.cells();
+  writer_.Write(1, 1);
+  writer_.Write(snapshot.tick(), kTickBits);
+  writer_.Write(cells.rows(), kSizeBits);
+  writer_.Write(cells.cols(), kSizeBits);
+  for (size_t i = 0; i < cells.size(); ++i) {
+    writer_.Write(cells[i], kCellBits);
+  }
+  writer_.WriteVarint(snapshot.entities().size());
+  uint32_t id = 0;
+  for (const Entity &entity : snapshot.entities()) {
+    writer_.WriteVarint(entity.id - id);
+    id = entity.id;
+    WriteEntity(writer_, entity);
+  }
+}
+
+bool SnapshotEncoder::EncodeDelta(const SnapshotHistory &history, const Snapshot &snapshot) {
+  const Snapshot *baseline = history.Find(acked_);
+  if (!baseline || baseline->cells().rows() != snapshot.cells().rows() ||
+      baseline->cells().cols() != snapshot.cells().cols()) {
+    return false;
+  }
+  if (!history.ChangesSince(acked_, cells_, entities_)) return false;
+  writer_.Write(0, 1);
+  writer_.Write(snapshot.tick(), kTickBits);
+  writer_.Write(acked_, kTickBits);
+  // Indices and ids are sorted, so gaps between them are small
+  writer_.WriteVarint(cells_.size());
+  uint32_t index = 0;
+  for (uint32_t changed : cells_) {
+    writer_.WriteVarint(changed - index);
+    index = changed;
+    writer_.Write(snapshot.cells()[changed], kCellBits);
+  }
+  writer_.WriteVarint(entities_.size());
+  uint32_t id = 0;
+  for (uint32_t changed : entities_) {
+    writer_.WriteVarint(changed - id);
+    id = changed;
+    const Entity *entity = snapshot.Find(changed);
+    writer_.Write(entity != nullptr, 1);
+    if (entity) WriteEntity(writer_, *entity);
+  }
+  return writer_.bits() < FullBits(snapshot);
+}
+
+bool ApplySnapshot(const char *data, size_t size, Snapshot::Tick &tick, CellMatrix &cells,
+                   vector<Entity> &entities) {
+  BitReader reader(data, size);
+  bool full = reader.Read(1) != 0;
+  Snapshot::Tick new_tick = static_cast<Snapshot::Tick>(reader.Read(kTickBits));
+  if (full) {
+    int rows = static_cast<int>(reader.Read(kSizeBits));
+    int cols = static_cast<int>(reader.Read(kSizeBits));
+    // Do not allocate more cells than data can hold
+    if (reader.overflow() || rows > CellMatrix::kMaxSize || cols > CellMatrix::kMaxSize ||
+        static_cast<size_t>(rows) * cols > size) {
+      return false;
+    }
+    CellMatrix new_cells(rows, cols);
+    for (size_t i = 0; i < new_cells.size(); ++i) {
+      new_cells[i] = static_cast<uint8_t>(reader.Read(kCellBits));
+    }
+    uint64_t count = reader.ReadVarint();
+    if (count > size) return false;
+    vector<Entity> new_entities(count);
+    uint32_t id = 0;
+    for (Entity &entity : new_entities) {
+      id += static_cast<uint32_t>(reader.ReadVarint());
+      entity.id = id;
+      ReadEntity(reader, entity);
+    }
+    if (reader.overflow()) return false;
+    cells = move(new_cells);
+    entities = move(new_entities);
+    tick = new_tick;
+    return true;
+  }
+  Snapshot::Tick baseline = static_cast<Snapshot::Tick>(reader.Read(kTickBits));
+  // Our state should be the baseline or anything received after it
+  if (tick - baseline > new_tick - baseline) return false;
+  uint64_t count = reader.ReadVarint();
+  uint32_t index = 0;
+  for (uint64_t i = 0; i < count && !reader.overflow(); ++i) {
+    index += static_cast<uint32_t>(reader.ReadVarint());
+    uint8_t value = static_cast<uint8_t>(reader.Read(kCellBits));
+    if (index >= cells.size()) return false;
+    cells[index] = value;
+  }
+  count = reader.ReadVarint();
+  uint32_t id = 0;
+  for (uint64_t i = 0; i < count && !reader.overflow(); ++i) {
+    id += static_cast<uint32_t>(reader.ReadVarint());
+    bool present = reader.Read(1) != 0;
+    auto found = lower_bound(entities.begin(), entities.end(), id, LessId);
+    bool exists = found != entities.end() && found->id == id;
+    if (present) {
+      if (!exists) {
+        found = entities.insert(found, Entity());
+        found->id = id;
+      }
+      ReadEntity(reader, *found);
+    } else if (exists) {
+      entities.erase(found);
+    }
+  }
+  if (reader.overflow()) return false;
+  tick = new_tick;
+  return true;
+}
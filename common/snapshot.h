@@ -0,0 +1,173 @@
+#ifndef YOBAHACK_COMMON_SNAPSHOT_H_
+#define YOBAHACK_COMMON_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "common/matrix.h"
+#include "common/bitstream.h"
+
+/** State of one entity (player, monster, item) sent to clients */
+struct Entity {
+  std::uint32_t id;
+  std::int32_t row;
+  std::int32_t col;
+  std::uint32_t state; ///< Type, health and flags, packed by game logic
+
+  inline bool operator==(const Entity &other) const noexcept {
+    return id == other.id && row == other.row && col == other.col && state == other.state;
+  }
+
+  inline bool operator!=(const Entity &other) const noexcept {
+    return !(*this == other);
+  }
+};
+
+typedef Matrix<std::uint8_t> CellMatrix;
+
+/** World state at one tick.
+ * Immutable once made and shared by encoders of all clients. Keeps the
+ * list of cells and entities changed since previous tick, so that
+ * deltas are built from the changes, not by comparing whole maps.
+ */
+class Snapshot {
+ public:
+  typedef std::uint32_t Tick;
+
+  /** Makes snapshot; entities are sorted by id.
+   * \param previous Snapshot of previous tick, if any; changes are
+   * computed against it
+   */
+  static std::shared_ptr<const Snapshot> Make(Tick tick, CellMatrix &&cells, std::vector<Entity> &&entities,
+                                              const Snapshot *previous);
+
+  inline Tick tick() const noexcept {
+    return tick_;
+  }
+
+  inline const CellMatrix &cells() const noexcept {
+    return cells_;
+  }
+
+  /** Sorted by id */
+  inline const std::vector<Entity> &entities() const noexcept {
+    return entities_;
+  }
+
+  /** Returns entity with given id or nullptr */
+  const Entity *Find(std::uint32_t id) const noexcept;
+
+  /** Returns true if changes against previous tick are known */
+  inline bool has_changes() const noexcept {
+    return has_changes_;
+  }
+
+  /** Indices of cells changed since previous tick, sorted */
+  inline const std::vector<std::uint32_t> &changed_cells() const noexcept {
+    return changed_cells_;
+  }
+
+  /** Ids of entities changed, added or removed since previous tick, sorted */
+  inline const std::vector<std::uint32_t> &changed_entities() const noexcept {
+    return changed_entities_;
+  }
+
+ private:
+  Snapshot() = default;
+
+  Tick tick_ = 0;
+  CellMatrix cells_;
+  std::vector<Entity> entities_;
+  bool has_changes_ = false;
+  std::vector<std::uint32_t> changed_cells_;
+  std::vector<std::uint32_t> changed_entities_;
+};
+
+/** Recent world snapshots which serve as baselines for deltas.
+ * Not thread-safe.
+ */
+class SnapshotHistory {
+ public:
+  explicit SnapshotHistory(std::size_t capacity = 64) noexcept : capacity_(capacity) { }
+
+  /** Adds snapshot of next tick, dropping the oldest one if full */
+  void Push(std::shared_ptr<const Snapshot> snapshot);
+
+  /** Returns snapshot of given tick or nullptr */
+  const Snapshot *Find(Snapshot::Tick tick) const noexcept;
+
+  inline const std::shared_ptr<const Snapshot> &latest() const noexcept {
+    static const std::shared_ptr<const Snapshot> kEmpty;
+    return snapshots_.empty() ? kEmpty : snapshots_.back();
+  }
+
+  /** Collects cells and entities changed after baseline tick up to latest.
+   * \return false if baseline is not in history or changes are not known
+   */
+  bool ChangesSince(Snapshot::Tick baseline, std::vector<std::uint32_t> &cells,
+                    std::vector<std::uint32_t> &entities) const;
+
+ private:
+  std::size_t capacity_;
+  std::deque<std::shared_ptr<const Snapshot>> snapshots_;
+};
+
+/** Encodes world snapshots for one client.
+ * Every update is a delta against the latest snapshot client has
+ * acknowledged, or a full snapshot when there is none or delta would not
+ * be smaller. Delta holds new values of everything changed since baseline,
+ * so it applies in place to any later state client may have.
+ * Remembers a ring of recently sent ticks; snapshots themselves stay in
+ * the shared history.
+ * Not thread-safe.
+ */
+class SnapshotEncoder {
+ public:
+  static const std::size_t kRingSize = 32;
+
+  /** Encodes latest snapshot of history; result is valid until next call */
+  const std::string &Encode(const SnapshotHistory &history);
+
+  /** Marks snapshot of given tick as received by client */
+  void Acknowledge(Snapshot::Tick tick) noexcept;
+
+  /** Forgets acknowledgements; next update is full */
+  void Reset() noexcept;
+
+  inline std::size_t full_sent() const noexcept {
+    return full_sent_;
+  }
+
+  inline std::size_t delta_sent() const noexcept {
+    return delta_sent_;
+  }
+
+ private:
+  void EncodeFull(const Snapshot &snapshot);
+  bool EncodeDelta(const SnapshotHistory &history, const Snapshot &snapshot);
+
+  BitWriter writer_;
+  std::array<Snapshot::Tick, kRingSize> sent_ = {};
+  std::size_t sent_count_ = 0;
+  Snapshot::Tick acked_ = 0;
+  bool has_acked_ = false;
+  std::vector<std::uint32_t> cells_; ///< Scratch buffers
+  std::vector<std::uint32_t> entities_;
+  std::size_t full_sent_ = 0;
+  std::size_t delta_sent_ = 0;
+};
+
+/** Applies encoded snapshot to client state in place.
+ * \param tick Tick of client state; updated on success
+ * \return false if data is malformed or delta is not based on client
+ * state; state may be partly updated then, and client should not
+ * acknowledge anything until next full snapshot
+ */
+bool ApplySnapshot(const char *data, std::size_t size, Snapshot::Tick &tick, CellMatrix &cells,
+                   std::vector<Entity> &entities);
+
+#endif // YOBAHACK_COMMON_SNAPSHOT_H_
@@ -5,6 +5,7 @@
 #include <exception>
 #include <boost/system/error_code.hpp>
 #include <boost/asio.hpp>
+#include "common/framebuffer.h"
 
 /** Class that wraps socket operations */
 template <class Protocol> class SocketWrapper {
@@ -44,6 +45,29 @@ template <class Protocol> class SocketWrapper {
     boost::asio::async_write(socket_, buffers, func);
   }
 
+  /** Reads whatever socket has into free tail of given frame buffer.
+   * At least FrameBuffer::kReadSize bytes are prepared when message size
+   * allows. After completion received bytes are committed and
+   * func(error, bytes_transferred) is called; take messages with
+   * FrameBuffer::Next(). If buffer is malformed or has no room left
+   * (messages are not taken), socket is closed and func receives an error.
+   * Buffer should outlive the operation.
+   */
+  template <class ReadHandler> void ReadFrames(FrameBuffer &buffer, ReadHandler func) noexcept {
+    boost::asio::mutable_buffers_1 tail = buffer.Prepare(FrameBuffer::kReadSize);
+    if (buffer.malformed() || boost::asio::buffer_size(tail) == 0) {
+      // Empty read would complete at once and be repeated forever; read
+      // from closed socket fails asynchronously, as any other read does
+      boost::system::error_code e;
+      socket_.close(e);
+    }
+    socket_.async_read_some(tail,
+                            [&buffer, func](const boost::system::error_code &error, std::size_t bytes_transferred) mutable {
+                              buffer.Commit(bytes_transferred);
+                              func(error, bytes_transferred);
+                            });
+  }
+
  private:
   Socket socket_;
 };
@@ -0,0 +1,233 @@
+#include <cstring>
+#include <stdexcept>
+#include "unreliablechannel.h"
+
+using namespace std;
+using namespace boost::asio;
+
+const size_t DatagramHeader::kSize;
+const uint8_t DatagramHeader::kNothingReceived;
+const size_t SequenceState::kHistory;
+const size_t UnreliableChannel::kMaxDatagram;
+const size_t UnreliableChannel::kMaxPayload;
+const UnreliableChannel::Session UnreliableChannel::kInvalidSession;
+
+namespace {
+
+template <class T> void WriteLittleEndian(char *out, T value) noexcept {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out[i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+template <class T> T ReadLittleEndian(const char *in) noexcept {
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(static_cast<unsigned char>(in[i])) << (8 * i);
+  }
+  return value;
+}
+
+}
+
+void DatagramHeader::Write(char *out) const noexcept {
+  WriteLittleEndian(out, session);
+  WriteLittleEndian(out + 8, sequence);
+  WriteLittleEndian(out + 10, ack);
+  WriteLittleEndian(out + 12, ack_bits);
+  WriteLittleEndian(out + 16, flags);
+}
+
+DatagramHeader DatagramHeader::Read(const char *in) noexcept {
+  DatagramHeader header;
+  header.session = ReadLittleEndian<uint64_t>(in);
+  header.sequence = ReadLittleEndian<uint16_t>(in + 8);
+  header.ack = ReadLittleEndian<uint16_t>(in + 10);
+  header.ack_bits = ReadLittleEndian<uint32_t>(in + 12);
+  header.flags = ReadLittleEndian<uint8_t>(in + 16);
+  return header;
+}
+
+uint16_t SequenceState::Next(Clock::time_point now) noexcept {
+  uint16_t sequence = local_++;
+  sent_[sequence % kHistory] = Sent{ now, sequence, true };
+  return sequence;
+}
+
+bool SequenceState::Receive(uint16_t sequence) noexcept {
+  if (!received_any_) {
+    received_any_ = true;
+    remote_ = sequence;
+    remote_bits_ = 0;
+    return true;
+  }
+  if (SequenceNewer(sequence, remote_)) {
+    uint16_t shift = sequence - remote_;
+    if (shift < 32) {
+      remote_bits_ = (remote_bits_ << shift) | (1u << (shift - 1));
+    } else if (shift == 32) {
+      remote_bits_ = 1u << 31;
+    } else {
+      remote_bits_ = 0;
+    }
+    remote_ = sequence;
+    return true;
+  }
+  // Too late to be delivered, but peer still learns that it arrived
+  uint16_t age = remote_ - sequence;
+  if (age >= 1 && age <= 32) {
+    remote_bits_ |= 1u << (age - 1);
+  }
+  return false;
+}
+
+void SequenceState::Acknowledge(const DatagramHeader &header, Clock::time_point now, vector<uint16_t> &acked) {
+  // Otherwise zero ack of peer which got nothing would acknowledge sequence 0
+  if (header.flags & DatagramHeader::kNothingReceived) return;
+  for (int i = 32; i >= 0; --i) {
+    if (i != 0 && !(header.ack_bits & (1u << (i - 1)))) continue;
+    uint16_t sequence = header.ack - i;
+    Sent &sent = sent_[sequence % kHistory];
+    if (!sent.pending || sent.sequence != sequence) continue;
+    sent.pending = false;
+    acked.push_back(sequence);
+    Clock::duration sample = now - sent.time;
+    // Exponential moving average, as in TCP
+    rtt_ = rtt_ == Clock::duration::zero() ? sample : rtt_ + (sample - rtt_) / 8;
+  }
+}
+
+void SequenceState::Stamp(DatagramHeader &header, Clock::time_point now) noexcept {
+  header.sequence = Next(now);
+  header.ack = remote_;
+  header.ack_bits = remote_bits_;
+  header.flags = received_any_ ? 0 : DatagramHeader::kNothingReceived;
+}
+
+UnreliableChannel::UnreliableChannel(io_service &io_service) :
+  io_service_(io_service), socket_(io_service), random_(random_device()()) { }
+
+void UnreliableChannel::Open(const Protocol::endpoint &local) {
+  socket_.open(local.protocol());
+  socket_.bind(local);
+  // Datagram which does not fit into socket buffer is just lost
+  socket_.non_blocking(true);
+  ReceiveNext();
+}
+
+void UnreliableChannel::Close() noexcept {
+  // Receive is pending in io_service thread; socket is not touched from other threads
+  io_service_.post([this]() {
+                     boost::system::error_code ec;
+                     socket_.close(ec);
+                   });
+}
+
+UnreliableChannel::Session UnreliableChannel::CreateSession() {
+  lock_guard<mutex> lock(mutex_);
+  Session session;
+  do {
+    session = random_();
+  } while (session == kInvalidSession || peers_.count(session));
+  peers_[session];
+  return session;
+}
+
+void UnreliableChannel::AddSession(Session session, const Protocol::endpoint &remote) {
+  lock_guard<mutex> lock(mutex_);
+  peers_[session].remote = remote;
+}
+
+void UnreliableChannel::RemoveSession(Session session) noexcept {
+  lock_guard<mutex> lock(mutex_);
+  peers_.erase(session);
+}
+
+bool UnreliableChannel::Send(Session session, const char *data, size_t size, uint16_t *sequence) {
+  if (size > kMaxPayload) {
+    throw length_error("Datagram is too large");
+  }
+  Protocol::endpoint remote;
+  DatagramHeader header;
+  bool lost = false;
+  {
+    lock_guard<mutex> lock(mutex_);
+    auto peer = peers_.find(session);
+    if (peer == peers_.end() || peer->second.remote.port() == 0) return false;
+    remote = peer->second.remote;
+    header.session = session;
+    peer->second.state.Stamp(header, SequenceState::Clock::now());
+    if (simulated_loss_ > 0) {
+      lost = uniform_real_distribution<double>()(random_) < simulated_loss_;
+    }
+  }
+  if (sequence) *sequence = header.sequence;
+  if (lost) return true;
+  vector<char> datagram(DatagramHeader::kSize + size);
+  header.Write(datagram.data());
+  memcpy(datagram.data() + DatagramHeader::kSize, data, size);
+  io_service_.post(std::bind(&UnreliableChannel::SendQueued, this, std::move(datagram), remote));
+  return true;
+}
+
+void UnreliableChannel::SendQueued(const vector<char> &datagram, const Protocol::endpoint &remote) noexcept {
+  boost::system::error_code ec;
+  socket_.send_to(buffer(datagram), remote, 0, ec);
+  if (ec) ++dropped_;
+}
+
+SequenceState::Clock::duration UnreliableChannel::rtt(Session session) {
+  lock_guard<mutex> lock(mutex_);
+  auto peer = peers_.find(session);
+  return peer == peers_.end() ? SequenceState::Clock::duration::zero() : peer->second.state.rtt();
+}
+
+void UnreliableChannel::ReceiveNext() {
+  socket_.async_receive_from(buffer(receive_buffer_), sender_,
+                             [this](const boost::system::error_code &error, size_t bytes) {
+                               HandleReceive(error, bytes);
+                             });
+}
+
+void UnreliableChannel::HandleReceive(const boost::system::error_code &error, size_t bytes) {
+  if (error == error::operation_aborted || !socket_.is_open()) return;
+  // Other errors (e.g. ICMP port unreachable) concern single datagram
+  if (error || bytes < DatagramHeader::kSize) {
+    if (!error) ++rejected_;
+    ReceiveNext();
+    return;
+  }
+  DatagramHeader header = DatagramHeader::Read(receive_buffer_.data());
+  bool fresh;
+  acked_.clear();
+  {
+    lock_guard<mutex> lock(mutex_);
+    auto peer = peers_.find(header.session);
+    if (peer == peers_.end()) {
+      ++rejected_;
+      ReceiveNext();
+      return;
+    }
+    SequenceState &state = peer->second.state;
+    state.Acknowledge(header, SequenceState::Clock::now(), acked_);
+    fresh = state.Receive(header.sequence);
+    if (fresh) {
+      // Token authenticates peer; address may change with NAT rebinding
+      peer->second.remote = sender_;
+    }
+  }
+  if (ack_handler_) {
+    for (uint16_t sequence : acked_) {
+      ack_handler_(header.session, sequence);
+    }
+  }
+  if (fresh) {
+    if (receive_handler_) {
+      receive_handler_(header.session, header.sequence, receive_buffer_.data() + DatagramHeader::kSize,
+                       bytes - DatagramHeader::kSize);
+    }
+  } else {
+    ++stale_;
+  }
+  ReceiveNext();
+}
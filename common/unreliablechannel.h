@@ -0,0 +1,219 @@
+#ifndef YOBAHACK_COMMON_UNRELIABLECHANNEL_H_
+#define YOBAHACK_COMMON_UNRELIABLECHANNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+/** Header of every datagram of unreliable channel.
+ * On the wire it is little-endian: session (8 bytes), sequence (2),
+ * ack (2), ack bits (4), flags (1).
+ */
+struct DatagramHeader {
+  static const std::size_t kSize = 17;
+  /** Sender has not received anything yet; ack and ack bits mean nothing */
+  static const std::uint8_t kNothingReceived = 1;
+
+  std::uint64_t session; ///< Token given to client over TCP after authentication
+  std::uint16_t sequence; ///< Number of this datagram
+  std::uint16_t ack; ///< Latest sequence received from peer
+  std::uint32_t ack_bits; ///< Bit i set if ack - 1 - i was received too
+  std::uint8_t flags;
+
+  void Write(char *out) const noexcept;
+  static DatagramHeader Read(const char *in) noexcept;
+};
+
+/** Returns true if sequence a is newer than b, taking wrap-around into account */
+inline bool SequenceNewer(std::uint16_t a, std::uint16_t b) noexcept {
+  return a != b && static_cast<std::uint16_t>(a - b) < 0x8000;
+}
+
+/** Sequence numbers and acknowledgements of one peer.
+ * Keeps send times of recent datagrams to report which of them were
+ * acknowledged and to estimate round-trip time.
+ * Not thread-safe.
+ */
+class SequenceState {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  /** Takes sequence number for outgoing datagram */
+  std::uint16_t Next(Clock::time_point now) noexcept;
+
+  /** Registers incoming datagram.
+   * \return false if it is not newer than latest received one; with
+   * latest-wins semantics such datagram should be dropped
+   */
+  bool Receive(std::uint16_t sequence) noexcept;
+
+  /** Processes acknowledgements from peer's header.
+   * Appends sequences acknowledged for the first time to acked. Header
+   * with kNothingReceived flag acknowledges nothing.
+   */
+  void Acknowledge(const DatagramHeader &header, Clock::time_point now, std::vector<std::uint16_t> &acked);
+
+  /** Fills header of outgoing datagram with new sequence and acknowledgements */
+  void Stamp(DatagramHeader &header, Clock::time_point now) noexcept;
+
+  /** Whether anything was received from peer; until then ack() is meaningless */
+  inline bool received_any() const noexcept {
+    return received_any_;
+  }
+
+  /** Latest sequence received from peer */
+  inline std::uint16_t ack() const noexcept {
+    return remote_;
+  }
+
+  /** Which of 32 sequences before ack() were received */
+  inline std::uint32_t ack_bits() const noexcept {
+    return remote_bits_;
+  }
+
+  /** Smoothed round-trip time */
+  inline Clock::duration rtt() const noexcept {
+    return rtt_;
+  }
+
+ private:
+  static const std::size_t kHistory = 1024;
+
+  struct Sent {
+    Clock::time_point time;
+    std::uint16_t sequence;
+    bool pending;
+  };
+
+  std::array<Sent, kHistory> sent_ = {};
+  std::uint16_t local_ = 0; ///< Next sequence to send
+  std::uint16_t remote_ = 0;
+  std::uint32_t remote_bits_ = 0;
+  bool received_any_ = false;
+  Clock::duration rtt_ = Clock::duration::zero();
+};
+
+/** Unreliable datagram channel accompanying TCP session.
+ * Used for high-rate state updates where only the latest one matters:
+ * datagrams older than latest received are dropped, nothing is resent.
+ * Each datagram carries acknowledgements of peer's recent datagrams, so
+ * sender learns which states reached the peer.
+ * Sessions are identified by random tokens handed out over the reliable
+ * TCP connection; peer address is learned from its first datagram with
+ * valid token. Client adds the one session with server's address.
+ * Thread-safe, except for setters, which should be called before Open().
+ * Socket itself is used only in io_service thread: Send() and Close()
+ * post their work there.
+ */
+class UnreliableChannel {
+ public:
+  typedef boost::asio::ip::udp Protocol;
+  typedef std::uint64_t Session;
+  /** (session, sequence, data, size) */
+  typedef std::function<void(Session, std::uint16_t, const char *, std::size_t)> ReceiveHandler;
+  /** (session, sequence of our datagram which reached peer) */
+  typedef std::function<void(Session, std::uint16_t)> AckHandler;
+
+  static const std::size_t kMaxDatagram = 1200; ///< Fits in common path MTU
+  static const std::size_t kMaxPayload = kMaxDatagram - DatagramHeader::kSize;
+  static const Session kInvalidSession = 0;
+
+  explicit UnreliableChannel(boost::asio::io_service &io_service);
+  UnreliableChannel(const UnreliableChannel &other) = delete;
+  UnreliableChannel(const UnreliableChannel &&other) = delete;
+
+  /** Binds socket and starts receiving; throws exception on failure */
+  void Open(const Protocol::endpoint &local);
+
+  void Close() noexcept;
+
+  inline bool is_open() const noexcept {
+    return socket_.is_open();
+  }
+
+  inline Protocol::endpoint local_endpoint() const {
+    return socket_.local_endpoint();
+  }
+
+  /** Creates session with new random token (server side) */
+  Session CreateSession();
+
+  /** Adds session with known token (client side) */
+  void AddSession(Session session, const Protocol::endpoint &remote = Protocol::endpoint());
+
+  void RemoveSession(Session session) noexcept;
+
+  /** Queues datagram for sending in io_service thread; drops it if peer
+   * address is not known yet. Datagram which does not fit into socket
+   * buffer is dropped later (see dropped()).
+   * \param sequence Receives sequence number of datagram if it was queued
+   * \return true if datagram was queued
+   */
+  bool Send(Session session, const char *data, std::size_t size, std::uint16_t *sequence = nullptr);
+
+  inline void set_receive_handler(ReceiveHandler &&handler) noexcept {
+    receive_handler_ = std::move(handler);
+  }
+
+  inline void set_ack_handler(AckHandler &&handler) noexcept {
+    ack_handler_ = std::move(handler);
+  }
+
+  /** Fraction of outgoing datagrams dropped on purpose; simulates lossy link */
+  inline void set_simulated_loss(double value) noexcept {
+    simulated_loss_ = value;
+  }
+
+  /** Returns smoothed round-trip time of session */
+  SequenceState::Clock::duration rtt(Session session);
+
+  /** Datagrams dropped because newer one was received already */
+  inline std::size_t stale() const noexcept {
+    return stale_;
+  }
+
+  /** Datagrams dropped because of unknown session or bad size */
+  inline std::size_t rejected() const noexcept {
+    return rejected_;
+  }
+
+  /** Outgoing datagrams dropped because socket buffer was full */
+  inline std::size_t dropped() const noexcept {
+    return dropped_;
+  }
+
+ private:
+  struct Peer {
+    Protocol::endpoint remote;
+    SequenceState state;
+  };
+
+  void ReceiveNext();
+  void HandleReceive(const boost::system::error_code &error, std::size_t bytes);
+  void SendQueued(const std::vector<char> &datagram, const Protocol::endpoint &remote) noexcept;
+
+  boost::asio::io_service &io_service_;
+  Protocol::socket socket_;
+  std::array<char, kMaxDatagram> receive_buffer_;
+  Protocol::endpoint sender_;
+  std::mutex mutex_;
+  std::unordered_map<Session, Peer> peers_;
+  std::mt19937_64 random_;
+  std::vector<std::uint16_t> acked_; ///< Used only by receive handler
+  ReceiveHandler receive_handler_;
+  AckHandler ack_handler_;
+  double simulated_loss_ = 0;
+  std::atomic<std::size_t> stale_{0};
+  std::atomic<std::size_t> rejected_{0};
+  std::atomic<std::size_t> dropped_{0};
+};
+
+#endif // YOBAHACK_COMMON_UNRELIABLECHANNEL_H_
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "common/binarylog.h"
+#include "logdecoder.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+namespace {
+
+struct Line {
+  BinaryLogEntry entry;
+  const string *name;
+};
+
+/** Local time with microseconds */
+string FormatTime(system_clock::time_point time) {
+  time_t seconds = system_clock::to_time_t(time);
+  tm local;
+  localtime_r(&seconds, &local);
+  char text[64];
+  size_t size = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+  long long micros = duration_cast<microseconds>(time.time_since_epoch()).count() % 1000000;
+  snprintf(text + size, sizeof(text) - size, ".%06lld", micros < 0 ? micros + 1000000 : micros);
+  return text;
+}
+
+}
+
+int LogDecoder::Run(int argc, const char **argv) {
+  bool sites = false;
+  vector<string> files;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-s") == 0) {
+      sites = true;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    cerr << "Usage: " << argv[0] << " [-s] FILE..." << endl;
+    return 2;
+  }
+  int result = 0;
+  vector<string> names;
+  // Names are referred by lines, so they should not move
+  names.reserve(files.size());
+  vector<Line> lines;
+  for (const string &file : files) {
+    ifstream stream(file, ios::binary);
+    if (!stream) {
+      cerr << file << ": can not open" << endl;
+      result = 1;
+      continue;
+    }
+    string data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+    BinaryLogReader reader(data.data(), data.size());
+    if (!reader.valid()) {
+      cerr << file << ": not a binary log" << endl;
+      result = 1;
+      continue;
+    }
+    names.push_back(reader.name());
+    Line line;
+    line.name = &names.back();
+    while (reader.Next(line.entry)) {
+      lines.push_back(line);
+    }
+    if (reader.corrupt()) {
+      cerr << file << ": corrupt record after " << lines.size() << " records" << endl;
+      result = 1;
+    }
+  }
+  // Threads reserve space in file a bit out of order
+  stable_sort(lines.begin(), lines.end(),
+              [](const Line &a, const Line &b) { return a.entry.time < b.entry.time; });
+  for (const Line &line : lines) {
+    cout << LevelName(line.entry.level)[0] << " [" << FormatTime(line.entry.time) << "] " << *line.name;
+    if (line.entry.thread != 0) {
+      cout << " #" << line.entry.thread;
+    }
+    cout << ": ";
+    if (sites && !line.entry.file.empty()) {
+      cout << line.entry.file << ':' << line.entry.line << ": ";
+    }
+    cout << line.entry.text << '\n';
+  }
+  cout.flush();
+  return result;
+}
+
+void LogDecoder::Terminate(int exit_code) noexcept {
+}
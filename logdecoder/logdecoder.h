@@ -0,0 +1,26 @@
+#ifndef YOBAHACK_LOGDECODER_LOGDECODER_H_
+#define YOBAHACK_LOGDECODER_LOGDECODER_H_
+
+#include "common/application.h"
+
+/** Prints files of binary log as text.
+ * Usage: yobahack-logdecoder [-s] FILE...
+ * Records of all files are merged by time; -s adds call site to every line.
+ * Crash files of FlightRecorder are read the same way, with thread of
+ * every record after logger name.
+ */
+class LogDecoder : public Runnable
+{
+ public:
+  LogDecoder() = default;
+  LogDecoder(const LogDecoder &other) = delete;
+  LogDecoder(const LogDecoder &&other) = delete;
+
+ private:
+  ~LogDecoder() = default;
+
+  virtual int Run(int argc, const char **argv);
+  virtual void Terminate(int error_code) noexcept;
+};
+
+#endif // YOBAHACK_LOGDECODER_LOGDECODER_H_
@@ -0,0 +1,5 @@
+#include "logdecoder.h"
+
+int main(int argc, const char **argv) {
+  return ApplicationRun<LogDecoder>(argc, argv);
+}
@@ -0,0 +1,133 @@
+#ifndef YOBAHACK_SERVER_CONNECTIONPOOL_H_
+#define YOBAHACK_SERVER_CONNECTIONPOOL_H_
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+
+/** Pool of idle connection objects ready for reuse.
+ * Keeps constructed connections (with their sockets and buffers) after
+ * they are closed, so new ones do not need to be allocated during
+ * reconnect storms. Pool is filled up to warm size in advance and never
+ * keeps more than high-water mark of idle objects.
+ * Thread-safe, except for set_limits().
+ */
+template <class Connection> class ConnectionPool {
+ public:
+  typedef std::unique_ptr<Connection> Pointer;
+  typedef std::function<Pointer()> Factory;
+
+  /** \param factory Creates new connection when pool is empty */
+  explicit ConnectionPool(Factory &&factory) noexcept : factory_(std::move(factory)) { }
+
+  ConnectionPool(const ConnectionPool &other) = delete;
+  ConnectionPool(const ConnectionPool &&other) = delete;
+
+  /** Returns idle connection or creates new one */
+  Pointer Acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        Pointer connection = std::move(idle_.back());
+        idle_.pop_back();
+        ++reused_;
+        return connection;
+      }
+      ++created_;
+    }
+    return factory_();
+  }
+
+  /** Takes connection back into pool.
+   * Connection should already be reset to just-constructed state.
+   * If pool is full, connection is destroyed.
+   */
+  void Release(Pointer &&connection) noexcept {
+    Pointer extra;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (idle_.size() < high_water_) {
+        // Capacity is reserved in set_limits(), so this does not allocate
+        idle_.push_back(std::move(connection));
+        return;
+      }
+      extra = std::move(connection);
+    }
+    // Destructor runs outside of the lock
+  }
+
+  /** Creates connections until there are at least warm size idle ones */
+  void Warm() {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() >= warm_size_) return;
+      }
+      Pointer connection = factory_();
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++created_;
+      idle_.push_back(std::move(connection));
+    }
+  }
+
+  /** Sets number of idle connections created in advance and maximum
+   * number of idle connections kept.
+   */
+  void set_limits(std::size_t warm_size, std::size_t high_water) {
+    if (warm_size > high_water) {
+      throw std::out_of_range("Warm size should not exceed high-water mark");
+    }
+    std::vector<Pointer> extra;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      warm_size_ = warm_size;
+      high_water_ = high_water;
+      while (idle_.size() > high_water_) {
+        extra.push_back(std::move(idle_.back()));
+        idle_.pop_back();
+      }
+      idle_.reserve(high_water_);
+    }
+  }
+
+  inline std::size_t warm_size() const noexcept {
+    return warm_size_;
+  }
+
+  inline std::size_t high_water() const noexcept {
+    return high_water_;
+  }
+
+  /** Number of idle connections in pool */
+  std::size_t idle() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+  }
+
+  /** Number of connections ever created by pool */
+  std::size_t created() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_;
+  }
+
+  /** Number of times idle connection was handed out again */
+  std::size_t reused() noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reused_;
+  }
+
+ private:
+  Factory factory_;
+  std::mutex mutex_;
+  std::vector<Pointer> idle_;
+  std::size_t warm_size_ = 0;
+  std::size_t high_water_ = 0;
+  std::size_t created_ = 0;
+  std::size_t reused_ = 0;
+};
+
+#endif // YOBAHACK_SERVER_CONNECTIONPOOL_H_
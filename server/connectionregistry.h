@@ -0,0 +1,152 @@
+#ifndef YOBAHACK_SERVER_CONNECTIONREGISTRY_H_
+#define YOBAHACK_SERVER_CONNECTIONREGISTRY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <boost/thread.hpp>
+
+/** Sharded slot map of connections with stable ids.
+ * Connections are spread between shards round-robin; each shard is a slot
+ * table with its own lock and free list, so Insert() and Remove() are O(1)
+ * and contend only with operations on the same shard. Id stays the same
+ * while connection is registered and is never reused for another one.
+ * Thread-safe.
+ */
+template <class Connection, std::size_t kShardsNumber = 16> class ConnectionRegistry {
+ public:
+  typedef std::uint64_t Id;
+  typedef std::unique_ptr<Connection> Pointer;
+
+  /** Id which never belongs to any connection */
+  static const Id kInvalidId = 0;
+
+  ConnectionRegistry() = default;
+  ConnectionRegistry(const ConnectionRegistry &other) = delete;
+  ConnectionRegistry(const ConnectionRegistry &&other) = delete;
+
+  /** Takes ownership of connection and returns its id */
+  inline Id Insert(Pointer &&connection) {
+    return Insert(std::move(connection), [](Id, Connection &) { });
+  }
+
+  /** Same as above, but calls assign(id, connection) before connection
+   * becomes visible to other threads. assign is called under shard lock.
+   */
+  template <class Function> Id Insert(Pointer &&connection, Function assign) {
+    std::size_t shard_index = next_shard_++ % kShardsNumber;
+    Shard &shard = shards_[shard_index];
+    boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+    std::uint32_t index;
+    if (!shard.free.empty()) {
+      index = shard.free.back();
+      shard.free.pop_back();
+    } else {
+      index = shard.entries.size();
+      shard.entries.emplace_back();
+    }
+    Entry &entry = shard.entries[index];
+    Id id = MakeId(entry.generation, index, shard_index);
+    assign(id, *connection);
+    entry.connection = std::move(connection);
+    ++size_;
+    return id;
+  }
+
+  /** Unregisters connection and gives it back to caller.
+   * Returns nullptr if there is no connection with such id.
+   * Connection is destroyed by caller, outside of registry locks.
+   */
+  Pointer Remove(Id id) {
+    Shard &shard = shards_[ShardIndex(id)];
+    boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+    Entry *entry = Lookup(shard, id);
+    if (!entry) return nullptr;
+    Pointer connection = std::move(entry->connection);
+    // Generation 0 is skipped so that id is never kInvalidId
+    if (++entry->generation == 0) {
+      entry->generation = 1;
+    }
+    shard.free.push_back(SlotIndex(id));
+    --size_;
+    return connection;
+  }
+
+  /** Calls func(connection) if connection with given id is registered.
+   * Shard is locked for reading while func runs, so func should be short
+   * and must not insert or remove connections.
+   * \return false if there is no such connection
+   */
+  template <class Function> bool With(Id id, Function func) {
+    Shard &shard = shards_[ShardIndex(id)];
+    boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+    Entry *entry = Lookup(shard, id);
+    if (!entry) return false;
+    func(*entry->connection);
+    return true;
+  }
+
+  /** Calls func(id, connection) for each registered connection.
+   * Shards are visited one by one, each locked for reading only while it
+   * is visited; same restrictions on func apply as in With().
+   */
+  template <class Function> void ForEach(Function func) {
+    for (std::size_t shard_index = 0; shard_index < kShardsNumber; ++shard_index) {
+      Shard &shard = shards_[shard_index];
+      boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+      for (std::size_t index = 0; index < shard.entries.size(); ++index) {
+        Entry &entry = shard.entries[index];
+        if (entry.connection) {
+          func(MakeId(entry.generation, index, shard_index), *entry.connection);
+        }
+      }
+    }
+  }
+
+  /** Number of registered connections */
+  inline std::size_t size() const noexcept {
+    return size_;
+  }
+
+ private:
+  struct Entry {
+    Pointer connection;
+    std::uint32_t generation = 1;
+  };
+
+  struct Shard {
+    boost::shared_mutex mutex;
+    std::vector<Entry> entries;
+    std::vector<std::uint32_t> free;
+  };
+
+  static inline Id MakeId(std::uint32_t generation, std::size_t index, std::size_t shard) noexcept {
+    return (Id(generation) << 32) | Id(index * kShardsNumber + shard);
+  }
+
+  static inline std::size_t ShardIndex(Id id) noexcept {
+    return std::uint32_t(id) % kShardsNumber;
+  }
+
+  static inline std::uint32_t SlotIndex(Id id) noexcept {
+    return std::uint32_t(id) / kShardsNumber;
+  }
+
+  static inline Entry *Lookup(Shard &shard, Id id) noexcept {
+    std::uint32_t index = SlotIndex(id);
+    if (index >= shard.entries.size()) return nullptr;
+    Entry &entry = shard.entries[index];
+    if (!entry.connection || entry.generation != std::uint32_t(id >> 32)) return nullptr;
+    return &entry;
+  }
+
+  std::array<Shard, kShardsNumber> shards_;
+  std::atomic<std::size_t> next_shard_{0};
+  std::atomic<std::size_t> size_{0};
+};
+
+#endif // YOBAHACK_SERVER_CONNECTIONREGISTRY_H_
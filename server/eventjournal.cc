@@ -0,0 +1,107 @@
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include "eventjournal.h"
+
+static const char kMagic[4] = { 'Y', 'H', 'E', 'J' };
+
+EventJournal::EventJournal(std::size_t capacity) : buffer_(capacity) {
+}
+
+EventJournal::~EventJournal() {
+  try {
+    Close();
+  } catch (...) {
+  }
+}
+
+void EventJournal::Open(const std::string &path) {
+  if (file_) {
+    throw std::runtime_error("Journal is already open");
+  }
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error("Cannot open journal file " + path);
+  }
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(EventRecord);
+  if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+    std::fclose(file);
+    throw std::runtime_error("Cannot write journal file " + path);
+  }
+  file_ = file;
+  stopping_ = false;
+  writer_ = std::thread(&EventJournal::WriterLoop, this);
+}
+
+void EventJournal::Close() {
+  if (!file_) return;
+  stopping_ = true;
+  writer_.join();
+  std::FILE *file = file_;
+  file_ = nullptr;
+  if (std::fclose(file) != 0) {
+    throw std::runtime_error("Cannot close journal file");
+  }
+}
+
+bool EventJournal::Write(const EventRecord &record) noexcept {
+  if (!file_) return false;
+  if (!buffer_.Push(record)) {
+    ++dropped_;
+    return false;
+  }
+  return true;
+}
+
+std::vector<EventRecord> EventJournal::Load(const std::string &path) {
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+  if (!file) {
+    throw std::runtime_error("Cannot open journal file " + path);
+  }
+  FileHeader header;
+  if (std::fread(&header, sizeof(header), 1, file.get()) != 1
+      || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+      || header.version != kVersion || header.record_size != sizeof(EventRecord)) {
+    throw std::runtime_error("Invalid journal file " + path);
+  }
+  std::vector<EventRecord> records;
+  EventRecord batch[kBatchSize];
+  std::size_t read;
+  while ((read = std::fread(batch, sizeof(EventRecord), kBatchSize, file.get())) > 0) {
+    records.insert(records.end(), batch, batch + read);
+  }
+  return records;
+}
+
+void EventJournal::WriterLoop() noexcept {
+  // Поток записи не будят: производители не должны трогать блокировки,
+  // поэтому, когда буфер пуст, просто спим немного.
+  while (!stopping_) {
+    if (Drain() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  Drain();
+  std::fflush(file_);
+}
+
+std::size_t EventJournal::Drain() noexcept {
+  EventRecord batch[kBatchSize];
+  std::size_t total = 0;
+  std::size_t count;
+  do {
+    count = 0;
+    while (count < kBatchSize && buffer_.Pop(batch[count])) {
+      ++count;
+    }
+    if (count > 0) {
+      written_ += std::fwrite(batch, sizeof(EventRecord), count, file_);
+      total += count;
+    }
+  } while (count == kBatchSize);
+  return total;
+}
@@ -0,0 +1,112 @@
+#ifndef YOBAHACK_SERVER_EVENTJOURNAL_H_
+#define YOBAHACK_SERVER_EVENTJOURNAL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include "common/boundedqueue.h"
+
+/** Запись журнала очереди событий.
+ * Пишется в файл как есть, в порядке байт машины.
+ */
+struct EventRecord {
+  /** Что случилось с событием */
+  enum Kind : std::uint8_t {
+    kScheduled, ///< Поставлено в очередь; delay -- задержка
+    kFired, ///< Выполнено
+    kCancelled, ///< Отменено
+    kRescheduled, ///< Перенесено; delay -- новая задержка
+  };
+
+  static const std::size_t kPayloadSize = 16;
+
+  std::uint64_t tick; ///< Шаг очереди, на котором это случилось
+  std::uint64_t id; ///< Порядковый номер постановки события в очередь
+  std::uint32_t delay;
+  std::uint32_t type; ///< Тип события, задается пользователем
+  std::uint32_t affinity; ///< Ключ привязки
+  std::uint8_t kind;
+  std::uint8_t payload_size;
+  std::uint8_t reserved[2];
+  std::uint8_t payload[kPayloadSize]; ///< Данные события, задаются пользователем
+};
+
+/** Двоичный журнал очереди событий.
+ * Write() кладет запись в неблокирующий буфер, а отдельный поток сбрасывает
+ * накопленное в файл, так что на шаг очереди журнал почти не влияет.
+ * При переполнении буфера записи выбрасываются и считаются в dropped().
+ * Write() потокобезопасен, Open() и Close() -- нет.
+ */
+class EventJournal {
+ public:
+  /** Заголовок файла журнала */
+  struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t record_size;
+  };
+
+  static const std::uint32_t kVersion = 1;
+
+  /** \param capacity Размер буфера в записях */
+  explicit EventJournal(std::size_t capacity = 65536);
+  EventJournal(const EventJournal &other) = delete;
+  EventJournal(const EventJournal &&other) = delete;
+  ~EventJournal();
+
+  /** Открывает файл и запускает поток записи.
+   * Бросает исключение, если файл открыть не удалось или журнал уже открыт.
+   */
+  void Open(const std::string &path);
+
+  /** Сбрасывает буфер в файл, останавливает поток записи и закрывает файл.
+   * Если журнал не открыт, ничего не делает.
+   */
+  void Close();
+
+  /** Кладет запись в буфер.
+   * \return false, если журнал закрыт или буфер переполнен
+   */
+  bool Write(const EventRecord &record) noexcept;
+
+  inline bool is_open() const noexcept {
+    return file_ != nullptr;
+  }
+
+  /** Количество записей, попавших в файл */
+  inline std::uint64_t written() const noexcept {
+    return written_;
+  }
+
+  /** Количество записей, выброшенных из-за переполнения буфера */
+  inline std::uint64_t dropped() const noexcept {
+    return dropped_;
+  }
+
+  /** Читает весь журнал из файла.
+   * Бросает исключение, если файл не открывается или не является журналом.
+   */
+  static std::vector<EventRecord> Load(const std::string &path);
+
+ private:
+  /** Записи, сбрасываемые в файл одним вызовом fwrite */
+  static const std::size_t kBatchSize = 256;
+
+  void WriterLoop() noexcept;
+
+  /** Сбрасывает все, что есть в буфере; возвращает количество записей */
+  std::size_t Drain() noexcept;
+
+  BoundedQueue<EventRecord> buffer_;
+  std::FILE *file_ = nullptr;
+  std::thread writer_;
+  std::atomic_bool stopping_{false};
+  std::atomic<std::uint64_t> written_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+};
+
+#endif // YOBAHACK_SERVER_EVENTJOURNAL_H_
@@ -1,25 +1,337 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
 #include "eventqueue.h"
 
-friend bool EventQueue::Event::operator >(const Event &a, const Event &b) {
-  return a.etick > b.etick;
+namespace {
+
+/** Начальный размер таблицы дорожек; степень двойки */
+const std::size_t kMinLaneTable = 16;
+
+/** Перемешивает биты ключа, чтобы соседние ключи не шли подряд в таблице */
+inline std::size_t LaneHash(EventQueue::Affinity affinity) noexcept {
+  std::uint32_t hash = affinity * 0x9E3779B1u;
+  return hash ^ (hash >> 16);
+}
+
+}
+
+EventQueue::Tag::Tag(std::uint32_t type, Affinity affinity, const void *payload, std::size_t size) noexcept :
+  affinity(affinity), type(type) {
+  payload_size = size < EventRecord::kPayloadSize ? size : EventRecord::kPayloadSize;
+  if (payload_size > 0) {
+    std::memcpy(this->payload, payload, payload_size);
+  }
+}
+
+bool EventQueue::Handle::Cancel() noexcept {
+  if (!queue_) return false;
+  std::unique_lock<std::mutex> lock(queue_->mutex_, std::defer_lock);
+  if (queue_->parallel_) lock.lock();
+  if (!queue_->IsValid(index_, generation_)) return false;
+  queue_->Journal(queue_->slots_[index_], EventRecord::kCancelled);
+  queue_->Release(index_);
+  return true;
+}
+
+bool EventQueue::Handle::Reschedule(unsigned int delay) {
+  if (!queue_) return false;
+  std::unique_lock<std::mutex> lock(queue_->mutex_, std::defer_lock);
+  if (queue_->parallel_) lock.lock();
+  if (!queue_->IsValid(index_, generation_)) return false;
+  // Старая запись в колесе становится мертвой, а слот со своей функцией остается
+  Slot &slot = queue_->slots_[index_];
+  ++slot.stamp;
+  ++queue_->tombstones_;
+  queue_->Schedule(index_, delay);
+  queue_->Journal(slot, EventRecord::kRescheduled, delay);
+  return true;
+}
+
+bool EventQueue::Handle::pending() const noexcept {
+  if (!queue_) return false;
+  std::unique_lock<std::mutex> lock(queue_->mutex_, std::defer_lock);
+  if (queue_->parallel_) lock.lock();
+  return queue_->IsValid(index_, generation_);
+}
+
+EventQueue::Handle EventQueue::Push(Function &&func, unsigned int delay, const Tag &tag) {
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  if (parallel_) lock.lock();
+  return PushUnlocked(std::move(func), delay, tag);
 }
 
-void EventQueue::Push(Function &&func, unsigned int delay) {
-  Event temp;
-  temp.func = func;
-  temp.tick = delay; 
-  main_queue_.push(std::move(temp));  // А вот тут мы не копируем, а переносим, ибо нефиг
-};
+EventQueue::Handle EventQueue::PushUnlocked(Function &&func, unsigned int delay, const Tag &tag) {
+  std::uint32_t index = Acquire(std::move(func), delay, tag);
+  Schedule(index, delay);
+  return Handle(this, index, slots_[index].generation);
+}
+
+std::uint32_t EventQueue::Acquire(Function &&func, unsigned int delay, const Tag &tag) {
+  std::uint32_t index;
+  if (!free_slots_.empty()) {
+    index = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    index = slots_.size();
+    slots_.emplace_back();
+    // Release не должен выделять память
+    free_slots_.reserve(slots_.capacity());
+  }
+  Slot &slot = slots_[index];
+  slot.func = std::move(func); // Не копируем, а переносим, ибо нефиг
+  slot.tag = tag;
+  slot.id = next_id_++;
+  slot.live = true;
+  Journal(slot, EventRecord::kScheduled, delay);
+  ++size_;
+  return index;
+}
+
+void EventQueue::Reserve(std::size_t count) {
+  if (count <= free_slots_.size()) return;
+  slots_.reserve(slots_.size() + count - free_slots_.size());
+  free_slots_.reserve(slots_.capacity());
+}
 
 void EventQueue::Tick() {
-  if (!main_queue_.empty()) {  // функциям %%в кармочку%% этот самый тик
-    while (main_queue_.top().etick == 0) {
-      // Выполняем функции, чей тик равен 0 и минусуем всем.
-      main_queue_.top().func(); // Выполняем функцию...
-      main_queue_.pop(); // ...и выбрасываем ее
+  // На границе оборота младшего уровня спускаем события со старших
+  if ((tick_ & kSlotMask) == 0) {
+    for (unsigned int level = 1; level < kLevels && Cascade(level); ++level);
+  }
+
+  Bucket &bucket = wheel_[0][tick_ & kSlotMask];
+  Order(bucket);
+  if (task_pool_) {
+    RunParallel(bucket);
+  } else {
+    RunSerial(bucket);
+  }
+  ++tick_;
+}
+
+void EventQueue::set_threads_number(unsigned int value) {
+  if (value <= 1) {
+    task_pool_.reset();
+  } else {
+    task_pool_.reset(new TaskPool(value));
+  }
+}
+
+void EventQueue::RunSerial(Bucket &bucket) {
+  // Функции могут добавлять события с нулевой задержкой в эту же ячейку,
+  // поэтому идем по индексу и забираем функцию перед вызовом.
+  for (std::size_t i = 0; i < bucket.size(); ++i) {
+    if (!IsAlive(bucket[i])) {
+      --tombstones_;
+      continue;
     }
+    std::uint32_t index = bucket[i].index;
+    Journal(slots_[index], EventRecord::kFired);
+    Function func = std::move(slots_[index].func);
+    Release(index);
+    --tombstones_; // Release посчитал эту запись мертвой, но она уже обработана
+    func();
+  }
+  bucket.clear(); // память ячейки остается на следующий оборот
+}
+
+void EventQueue::RunParallel(Bucket &bucket) {
+  // События, добавленные с нулевой задержкой, попадают в эту же ячейку;
+  // обрабатываем их следующей волной.
+  while (!bucket.empty()) {
+    for (const Event &event : bucket) {
+      if (!IsAlive(event)) {
+        --tombstones_;
+        continue;
+      }
+      Affinity affinity = slots_[event.index].tag.affinity;
+      (affinity == kNoAffinity ? unbound_ : LaneOf(affinity)).events.push_back(event);
+    }
+    bucket.clear();
 
-    for (auto temp_event : main_queue_)
-      --temp_event->tick;
+    std::size_t lanes_number = lanes_used_;
+    auto clear = [this, lanes_number]() {
+      for (std::size_t i = 0; i < lanes_number; ++i) {
+        DropLane(lanes_[i]);
+      }
+      DropLane(unbound_);
+      lanes_used_ = 0;
+      std::fill(lane_table_.begin(), lane_table_.end(), 0);
+    };
+    try {
+      parallel_ = true;
+      task_pool_->Run(lanes_number, [this](std::size_t lane) {
+                        RunLane(lanes_[lane]);
+                      });
+      parallel_ = false;
+      RunLane(unbound_);
+    } catch (...) {
+      parallel_ = false;
+      clear();
+      throw;
+    }
+    clear();
+  }
+}
+
+void EventQueue::RunLane(Lane &lane) {
+  Function func;
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  while (true) {
+    if (parallel_) lock.lock();
+    // Функции уничтожаем под блокировкой: пул памяти не потокобезопасен
+    func = nullptr;
+    while (lane.done < lane.events.size() && !IsAlive(lane.events[lane.done])) {
+      --tombstones_;
+      ++lane.done;
+    }
+    if (lane.done == lane.events.size()) return;
+    std::uint32_t index = lane.events[lane.done++].index;
+    Journal(slots_[index], EventRecord::kFired);
+    func = std::move(slots_[index].func);
+    Release(index);
+    --tombstones_; // Release посчитал эту запись мертвой, но она уже обработана
+    if (lock.owns_lock()) lock.unlock();
+    try {
+      func();
+    } catch (...) {
+      if (parallel_) lock.lock();
+      func = nullptr;
+      throw;
+    }
   }
-};
+}
+
+void EventQueue::DropLane(Lane &lane) noexcept {
+  for (; lane.done < lane.events.size(); ++lane.done) {
+    const Event &event = lane.events[lane.done];
+    if (IsAlive(event)) {
+      Release(event.index);
+    }
+    --tombstones_;
+  }
+  lane.events.clear();
+  lane.done = 0;
+}
+
+EventQueue::Lane &EventQueue::LaneOf(Affinity affinity) {
+  if ((lanes_used_ + 1) * 2 > lane_table_.size()) {
+    GrowLaneTable();
+  }
+  std::size_t mask = lane_table_.size() - 1;
+  for (std::size_t i = LaneHash(affinity) & mask; ; i = (i + 1) & mask) {
+    std::uint32_t entry = lane_table_[i];
+    if (entry == 0) {
+      if (lanes_used_ == lanes_.size()) {
+        lanes_.emplace_back();
+      }
+      Lane &lane = lanes_[lanes_used_++];
+      lane.affinity = affinity;
+      lane_table_[i] = lanes_used_;
+      return lane;
+    }
+    if (lanes_[entry - 1].affinity == affinity) return lanes_[entry - 1];
+  }
+}
+
+void EventQueue::GrowLaneTable() {
+  lane_table_.assign(std::max<std::size_t>(lane_table_.size() * 2, kMinLaneTable), 0);
+  std::size_t mask = lane_table_.size() - 1;
+  for (std::size_t lane = 0; lane < lanes_used_; ++lane) {
+    std::size_t i = LaneHash(lanes_[lane].affinity) & mask;
+    while (lane_table_[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    lane_table_[i] = lane + 1;
+  }
+}
+
+void EventQueue::Insert(const Event &event) {
+  std::size_t place = Place(event.tick);
+  wheel_[place / kSlots][place % kSlots].push_back(event);
+}
+
+void EventQueue::InsertBatch(const std::vector<Event> &events) {
+  // Сначала считаем, сколько событий попадет в каждую ячейку, чтобы
+  // каждая выросла не больше одного раза; порядок постановки сохраняется
+  std::array<std::uint32_t, kLevels * kSlots> counts = {};
+  for (const Event &event : events) {
+    ++counts[Place(event.tick)];
+  }
+  for (std::size_t place = 0; place < counts.size(); ++place) {
+    if (counts[place] != 0) {
+      Bucket &bucket = wheel_[place / kSlots][place % kSlots];
+      bucket.reserve(bucket.size() + counts[place]);
+    }
+  }
+  for (const Event &event : events) {
+    Insert(event);
+  }
+}
+
+std::size_t EventQueue::Place(TickType tick) const noexcept {
+  TickType delta = tick - tick_;
+  unsigned int level = 0;
+  while (level + 1 < kLevels && delta >= (TickType(1) << (kLevelBits * (level + 1)))) {
+    ++level;
+  }
+  return level * kSlots + ((tick >> (kLevelBits * level)) & kSlotMask);
+}
+
+void EventQueue::Order(Bucket &bucket) {
+  auto earlier = [](const Event &a, const Event &b) { return a.sequence < b.sequence; };
+  // Обычно ячейка уже упорядочена, и проверки хватает
+  if (!std::is_sorted(bucket.begin(), bucket.end(), earlier)) {
+    std::sort(bucket.begin(), bucket.end(), earlier);
+  }
+}
+
+bool EventQueue::Cascade(unsigned int level) {
+  std::size_t index = (tick_ >> (kLevelBits * level)) & kSlotMask;
+  // Все события этой ячейки наступят раньше, чем через оборот уровня ниже,
+  // так что обратно в нее ничего не попадет.
+  Bucket temp;
+  temp.swap(wheel_[level][index]);
+  for (const Event &event : temp) {
+    if (IsAlive(event)) {
+      Insert(event);
+    } else {
+      // Мертвые записи просто выбрасываем
+      --tombstones_;
+    }
+  }
+  temp.clear();
+  wheel_[level][index].swap(temp);
+  return index == 0;
+}
+
+void EventQueue::WriteJournal(const Slot &slot, EventRecord::Kind kind, unsigned int delay) noexcept {
+  EventRecord record;
+  record.tick = tick_;
+  record.id = slot.id;
+  record.delay = delay;
+  record.type = slot.tag.type;
+  record.affinity = slot.tag.affinity;
+  record.kind = kind;
+  record.payload_size = slot.tag.payload_size;
+  record.reserved[0] = record.reserved[1] = 0;
+  std::memcpy(record.payload, slot.tag.payload, slot.tag.payload_size);
+  std::memset(record.payload + slot.tag.payload_size, 0, EventRecord::kPayloadSize - slot.tag.payload_size);
+  journal_->Write(record);
+}
+
+void EventQueue::Release(std::uint32_t index) noexcept {
+  Slot &slot = slots_[index];
+  slot.func = nullptr;
+  slot.live = false;
+  ++slot.generation;
+  ++slot.stamp;
+  free_slots_.push_back(index);
+  --size_;
+  ++tombstones_;
+}
+
+bool EventQueue::IsValid(std::uint32_t index, std::uint32_t generation) const noexcept {
+  return index < slots_.size() && slots_[index].live && slots_[index].generation == generation;
+}
@@ -1,35 +1,352 @@
 #ifndef YOBAHACK_SERVER_EVENTQUEUE_H_
 #define YOBAHACK_SERVER_EVENTQUEUE_H_
 
-#include <functional>
-#include <boost/heap/priority_queue.hpp>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include "server/slabpool.h"
+#include "server/smallfunction.h"
+#include "server/taskpool.h"
+#include "server/eventjournal.h"
 
-/** Класс очереди событий */
+/** Класс очереди событий.
+ * Построен на иерархическом колесе таймеров с абсолютным счетчиком шагов:
+ * Push и Tick работают за амортизированное O(1), а за один шаг
+ * трогается только ячейка, чье время пришло (и изредка ячейка старшего
+ * уровня, которую надо разложить по младшим).
+ *
+ * События могут нести ключ привязки (регион карты, шард сущностей и т.п.).
+ * Если задано число потоков больше одного, события одного шага с разными
+ * ключами выполняются параллельно, а с одинаковым -- по порядку постановки.
+ * События одного шага выполняются в порядке постановки (перенесенное
+ * событие считается поставленным в момент переноса), даже если они
+ * попали в ячейку с разных уровней колеса.
+ * События без ключа выполняются после них в вызывающем потоке.
+ * Во время параллельного выполнения Push, Cancel и Reschedule можно вызывать
+ * из самих событий; Tick() -- только из одного потока.
+ *
+ * Если подключен журнал, в него пишется постановка, выполнение, отмена
+ * и перенос каждого события вместе с его тегом.
+ */
 class EventQueue {
  public:
-  typedef std::function<void()> Function;
+  /** Замыкания вида "id сущности + действие" хранятся без выделения памяти,
+   * а более крупные -- в пуле очереди */
+  typedef SmallFunction<void()> Function;
+  typedef std::uint64_t TickType;
+  typedef std::uint32_t Affinity;
 
-  /** Тикаем один шаг и выполняем функцию, если надо */
+  /** Ключ привязки, означающий ее отсутствие */
+  static const Affinity kNoAffinity = 0;
+
+  /** Описание события: ключ привязки и то, что пишется про него в журнал.
+   * Неявно строится из ключа привязки.
+   */
+  struct Tag {
+    Tag() noexcept : Tag(kNoAffinity) { }
+    Tag(Affinity affinity) noexcept : affinity(affinity), type(0), payload_size(0) { }
+
+    /** \param payload Данные для журнала; обрезаются до EventRecord::kPayloadSize байт */
+    Tag(std::uint32_t type, Affinity affinity, const void *payload = nullptr, std::size_t size = 0) noexcept;
+
+    Affinity affinity;
+    std::uint32_t type; ///< Тип события для журнала
+    std::uint8_t payload_size;
+    std::uint8_t payload[EventRecord::kPayloadSize];
+  };
+
+  /** Ручка запланированного события.
+   * Позволяет отменить или перенести событие за O(1). Ручка ничем не владеет,
+   * ее можно свободно копировать; после выполнения или отмены события она
+   * становится недействительной. Не должна переживать свою очередь.
+   */
+  class Handle {
+   public:
+    Handle() = default;
+
+    /** Отменяет событие.
+     * \return false, если событие уже выполнено или отменено
+     */
+    bool Cancel() noexcept;
+
+    /** Переносит событие на delay шагов от текущего.
+     * \return false, если событие уже выполнено или отменено
+     */
+    bool Reschedule(unsigned int delay);
+
+    /** Возвращает true, если событие еще ждет выполнения */
+    bool pending() const noexcept;
+
+   private:
+    friend class EventQueue;
+
+    Handle(EventQueue *queue, std::uint32_t index, std::uint32_t generation) noexcept :
+      queue_(queue), index_(index), generation_(generation) { }
+
+    EventQueue *queue_ = nullptr;
+    std::uint32_t index_ = 0;
+    std::uint32_t generation_ = 0;
+  };
+
+  /** Тикаем один шаг и выполняем функции, чье время пришло */
   void Tick();
- 
+
   /** Записываем функцию на выполнение
    * \param func Функция на выполнение
-   * \param delay Количество шагов
+   * \param delay Количество шагов; 0 -- выполнить на ближайшем Tick()
+   * \param tag Ключ привязки и описание события для журнала
+   * \return Ручка для отмены или переноса события
    */
-  void Push(Function &&func, unsigned int delay);
+  Handle Push(Function &&func, unsigned int delay, const Tag &tag = Tag());
+
+  /** То же самое, но крупные замыкания размещаются в пуле очереди, а не в куче */
+  template <class F> inline Handle Push(F &&func, unsigned int delay, const Tag &tag = Tag()) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (parallel_) lock.lock();
+    return PushUnlocked(Function(std::forward<F>(func), &pool_), delay, tag);
+  }
+
+  /** Ставит на выполнение сразу много функций.
+   * Память под все события выделяется один раз, блокировка (если идет
+   * параллельное выполнение) берется тоже один раз. События заранее
+   * раскладываются по ячейкам колеса, так что каждая ячейка растет один раз
+   * на весь пакет.
+   * \param first, last Диапазон пар (функция, задержка); функции из него переносятся
+   * \param tag Ключ привязки и описание для всех событий
+   * \param handles Если не nullptr, сюда дописываются ручки событий по порядку
+   */
+  template <class ForwardIterator>
+   void PushBatch(ForwardIterator first, ForwardIterator last, const Tag &tag = Tag(),
+                  std::vector<Handle> *handles = nullptr) {
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (parallel_) lock.lock();
+    std::size_t count = std::distance(first, last);
+    Reserve(count);
+    if (handles) {
+      handles->reserve(handles->size() + count);
+    }
+    batch_.clear();
+    batch_.reserve(count);
+    try {
+      for (; first != last; ++first) {
+        unsigned int delay = first->second;
+        std::uint32_t index = Acquire(MakeFunction(std::move(first->first)), delay, tag);
+        batch_.push_back(Event{tick_ + delay, index, slots_[index].stamp, next_sequence_++});
+        if (handles) {
+          handles->push_back(Handle(this, index, slots_[index].generation));
+        }
+      }
+    } catch (...) {
+      // Уже поставленные события не должны потеряться
+      InsertBatch(batch_);
+      throw;
+    }
+    InsertBatch(batch_);
+  }
+
+  /** Текущий абсолютный шаг очереди */
+  inline TickType tick() const noexcept {
+    return tick_;
+  }
+
+  /** Количество живых (не отмененных и не выполненных) событий */
+  inline std::size_t size() const noexcept {
+    return size_;
+  }
+
+  inline bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  /** Количество мертвых записей в колесе, оставшихся от отмен и переносов.
+   * Они выбрасываются, когда до их ячейки доходит очередь.
+   */
+  inline std::size_t tombstones() const noexcept {
+    return tombstones_;
+  }
+
+  /** Количество потоков, выполняющих события с разными ключами */
+  inline unsigned int threads_number() const noexcept {
+    return task_pool_ ? task_pool_->threads_number() : 1;
+  }
+
+  /** Задает количество потоков (включая вызывающий Tick()).
+   * 1 -- все выполняется в вызывающем потоке, как раньше.
+   * Нельзя вызывать из событий.
+   */
+  void set_threads_number(unsigned int value);
+
+  /** Пул, в котором лежат крупные замыкания */
+  inline const SlabPool &pool() const noexcept {
+    return pool_;
+  }
+
+  inline EventJournal *journal() const noexcept {
+    return journal_;
+  }
+
+  /** Подключает журнал (nullptr -- отключает). Журнал должен пережить очередь
+   * или быть отключен раньше. Нельзя вызывать из событий.
+   */
+  inline void set_journal(EventJournal *journal) noexcept {
+    journal_ = journal;
+  }
 
  private:
-  /** Класс объектов, которыми управляет класс очереди */
-  struct Event {
-    friend bool operator >(const Event &a, const Event &b);
-    
+  /** Состояние события; хранится в таблице и переиспользуется после освобождения */
+  struct Slot {
     Function func; ///< Функция, которую надо выполнить
-    unsigned int tick; ///< Кол-во шагок, через которое ее надо выполнить
+    std::uint32_t generation = 0; ///< Меняется при освобождении, делает старые ручки недействительными
+    std::uint32_t stamp = 0; ///< Меняется при отмене и переносе, делает старые записи в колесе мертвыми
+    Tag tag;
+    std::uint64_t id = 0; ///< Порядковый номер постановки, для журнала
+    bool live = false;
+  };
+
+  /** Запись в колесе; сама функция лежит в таблице слотов */
+  struct Event {
+    TickType tick; ///< Абсолютный шаг, на котором ее надо выполнить
+    std::uint32_t index; ///< Номер слота
+    std::uint32_t stamp; ///< Должен совпадать со stamp слота, иначе запись мертвая
+    std::uint64_t sequence; ///< Порядковый номер постановки в колесо
   };
 
-  typedef boost::heap::priority_queue<Event, boost::heap::compare<std::greater<Event>>> Queue; 
+  typedef std::vector<Event> Bucket;
+
+  static const unsigned int kLevelBits = 8;
+  static const std::size_t kSlots = 1 << kLevelBits;
+  static const TickType kSlotMask = kSlots - 1;
+  /** Уровней хватает, чтобы покрыть любую задержку типа unsigned int */
+  static const unsigned int kLevels = (sizeof(unsigned int) * 8 + kLevelBits - 1) / kLevelBits;
+
+  typedef std::array<Bucket, kSlots> Level;
+
+  /** Записи событий одного ключа на текущем шаге. Функции остаются в
+   * слотах до самого выполнения, так что отмена из другой дорожки или из
+   * этой же успевает сработать, как и при выполнении в одном потоке.
+   */
+  struct Lane {
+    Affinity affinity = kNoAffinity;
+    std::vector<Event> events;
+    std::size_t done = 0; ///< Сколько записей уже обработано
+  };
+
+  Handle PushUnlocked(Function &&func, unsigned int delay, const Tag &tag);
+
+  /** Занимает слот под новое событие и пишет его постановку в журнал;
+   * в колесо событие не кладет
+   * \return Номер слота
+   */
+  std::uint32_t Acquire(Function &&func, unsigned int delay, const Tag &tag);
+
+  /** Заворачивает замыкание в Function, размещая крупные в пуле очереди */
+  template <class F> inline Function MakeFunction(F &&func) {
+    return Function(std::forward<F>(func), &pool_);
+  }
+
+  inline Function MakeFunction(Function &&func) noexcept {
+    return std::move(func);
+  }
+
+  /** Готовит таблицу слотов к добавлению count событий */
+  void Reserve(std::size_t count);
+
+  /** Выполняет текущую ячейку по порядку в вызывающем потоке */
+  void RunSerial(Bucket &bucket);
+
+  /** Раскладывает текущую ячейку по дорожкам и выполняет их параллельно */
+  void RunParallel(Bucket &bucket);
+
+  /** Выполняет живые события дорожки по порядку; во время параллельного
+   * выполнения берет блокировку на проверку и освобождение слота
+   */
+  void RunLane(Lane &lane);
+
+  /** Выбрасывает необработанные записи дорожки (после исключения) и очищает ее */
+  void DropLane(Lane &lane) noexcept;
+
+  /** Возвращает дорожку ключа на текущем шаге, заводя ее при первом обращении */
+  Lane &LaneOf(Affinity affinity);
+
+  /** Увеличивает таблицу дорожек вдвое и заново раскладывает по ней занятые */
+  void GrowLaneTable();
+
+  /** Кладет событие в нужную ячейку колеса относительно tick_ */
+  void Insert(const Event &event);
+
+  /** Кладет в колесо пакет событий, упорядоченный по постановке;
+   * память каждой ячейки выделяется разом на весь пакет
+   */
+  void InsertBatch(const std::vector<Event> &events);
+
+  /** Возвращает номер ячейки (уровень * kSlots + позиция), в которую
+   * попадает событие шага tick относительно tick_
+   */
+  std::size_t Place(TickType tick) const noexcept;
+
+  /** Создает запись о событии слота index через delay шагов и кладет ее в колесо */
+  inline void Schedule(std::uint32_t index, unsigned int delay) {
+    Insert(Event{tick_ + delay, index, slots_[index].stamp, next_sequence_++});
+  }
+
+  /** Восстанавливает порядок постановки в текущей ячейке: записи,
+   * спущенные со старших уровней, оказываются после поставленных прямо
+   * в нее, хотя могли быть поставлены раньше
+   */
+  void Order(Bucket &bucket);
+
+  /** Раскладывает текущую ячейку уровня level по младшим уровням.
+   * \return true, если нужно раскладывать и следующий уровень
+   */
+  bool Cascade(unsigned int level);
+
+  /** Возвращает true, если запись в колесе все еще соответствует живому событию */
+  inline bool IsAlive(const Event &event) const noexcept {
+    return slots_[event.index].stamp == event.stamp;
+  }
+
+  /** Пишет в журнал, если он подключен */
+  inline void Journal(const Slot &slot, EventRecord::Kind kind, unsigned int delay = 0) noexcept {
+    if (journal_) {
+      WriteJournal(slot, kind, delay);
+    }
+  }
+
+  void WriteJournal(const Slot &slot, EventRecord::Kind kind, unsigned int delay) noexcept;
+
+  /** Освобождает слот, делая недействительными его ручки и записи */
+  void Release(std::uint32_t index) noexcept;
+
+  /** Возвращает true, если ручка (index, generation) указывает на живое событие */
+  bool IsValid(std::uint32_t index, std::uint32_t generation) const noexcept;
+
+  std::array<Level, kLevels> wheel_;
+  SlabPool pool_; ///< Должен быть разрушен после slots_
+  std::vector<Slot> slots_;
+  std::vector<std::uint32_t> free_slots_;
+  TickType tick_ = 0;
+  std::size_t size_ = 0;
+  std::size_t tombstones_ = 0;
+  std::uint64_t next_id_ = 0;
+  std::uint64_t next_sequence_ = 0;
+  EventJournal *journal_ = nullptr;
 
-  Queue main_queue_;
+  std::unique_ptr<TaskPool> task_pool_;
+  std::vector<Lane> lanes_; ///< Память дорожек переиспользуется между шагами
+  std::size_t lanes_used_ = 0; ///< Сколько дорожек занято на текущем шаге
+  /** Открытая адресация по ключу: номер дорожки + 1, 0 -- пусто; заполнена
+   * не больше чем наполовину и тоже переиспользуется между шагами */
+  std::vector<std::uint32_t> lane_table_;
+  Lane unbound_; ///< События без ключа
+  std::vector<Event> batch_; ///< Память PushBatch переиспользуется между вызовами
+  std::mutex mutex_; ///< Защищает очередь, пока события выполняются параллельно
+  std::atomic_bool parallel_{false};
 };
 
 #endif // YOBAHACK_SERVER_EVENTQUEUE_H_
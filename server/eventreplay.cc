@@ -0,0 +1,67 @@
+#include <utility>
+#include "eventreplay.h"
+
+void EventReplay::Load(const std::string &path) {
+  records_ = EventJournal::Load(path);
+}
+
+void EventReplay::Register(std::uint32_t type, Factory &&factory) {
+  factories_[type] = std::move(factory);
+}
+
+EventReplay::Stats EventReplay::Run(EventQueue &queue) {
+  Stats stats;
+  EventQueue::TickType start = queue.tick();
+  if (records_.empty()) return stats;
+
+  // Шаги журнала отсчитываются от первой записи, шаги очереди -- от текущего
+  EventQueue::TickType offset = start - records_.front().tick;
+  std::unordered_map<std::uint64_t, EventQueue::Handle> handles;
+  for (const EventRecord &record : records_) {
+    while (queue.tick() < record.tick + offset) {
+      queue.Tick();
+    }
+    switch (record.kind) {
+      case EventRecord::kScheduled: {
+        EventQueue::Tag tag(record.type, record.affinity, record.payload, record.payload_size);
+        auto factory = factories_.find(record.type);
+        EventQueue::Function func;
+        if (factory != factories_.end()) {
+          func = factory->second(record);
+        } else {
+          func = EventQueue::Function([]() { });
+          ++stats.unknown;
+        }
+        handles[record.id] = queue.Push(std::move(func), record.delay, tag);
+        ++stats.scheduled;
+        break;
+      }
+      case EventRecord::kFired:
+        handles.erase(record.id);
+        ++stats.fired;
+        break;
+      case EventRecord::kCancelled: {
+        auto handle = handles.find(record.id);
+        if (handle != handles.end()) {
+          handle->second.Cancel();
+          handles.erase(handle);
+        }
+        ++stats.cancelled;
+        break;
+      }
+      case EventRecord::kRescheduled: {
+        auto handle = handles.find(record.id);
+        if (handle != handles.end()) {
+          handle->second.Reschedule(record.delay);
+        }
+        ++stats.rescheduled;
+        break;
+      }
+    }
+  }
+  while (!queue.empty()) {
+    queue.Tick();
+  }
+  stats.ticks = queue.tick() - start;
+  return stats;
+}
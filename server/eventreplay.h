@@ -0,0 +1,60 @@
+#ifndef YOBAHACK_SERVER_EVENTREPLAY_H_
+#define YOBAHACK_SERVER_EVENTREPLAY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "server/eventjournal.h"
+#include "server/eventqueue.h"
+
+/** Прогоняет записанный журнал через очередь событий на полной скорости.
+ * Для каждого типа события регистрируется фабрика, которая по записи журнала
+ * строит функцию; постановки, отмены и переносы повторяются на тех же шагах
+ * (относительно начала журнала). Функции, построенные фабриками, не должны
+ * сами ставить события: все постановки уже есть в журнале.
+ * Используется для профилирования и регрессионных замеров.
+ */
+class EventReplay {
+ public:
+  typedef std::function<EventQueue::Function(const EventRecord &)> Factory;
+
+  /** Итоги прогона */
+  struct Stats {
+    std::uint64_t scheduled = 0;
+    std::uint64_t fired = 0; ///< Сколько выполнений записано в журнале
+    std::uint64_t cancelled = 0;
+    std::uint64_t rescheduled = 0;
+    std::uint64_t unknown = 0; ///< События без фабрики; вместо них ставится пустая функция
+    EventQueue::TickType ticks = 0; ///< Сколько шагов сделала очередь
+  };
+
+  EventReplay() = default;
+  EventReplay(const EventReplay &other) = delete;
+  EventReplay(const EventReplay &&other) = delete;
+
+  /** Загружает журнал из файла; бросает исключение при ошибке */
+  void Load(const std::string &path);
+
+  /** Задает записи напрямую, без файла */
+  inline void set_records(std::vector<EventRecord> &&records) noexcept {
+    records_ = std::move(records);
+  }
+
+  inline const std::vector<EventRecord> &records() const noexcept {
+    return records_;
+  }
+
+  /** Регистрирует фабрику функций для данного типа событий */
+  void Register(std::uint32_t type, Factory &&factory);
+
+  /** Прогоняет журнал через очередь и дорабатывает ее до опустошения */
+  Stats Run(EventQueue &queue);
+
+ private:
+  std::vector<EventRecord> records_;
+  std::unordered_map<std::uint32_t, Factory> factories_;
+};
+
+#endif // YOBAHACK_SERVER_EVENTREPLAY_H_
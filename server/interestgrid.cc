@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <stdexcept>
+#include "common/hex.h"
+#include "interestgrid.h"
+
+using namespace std;
+
+const int InterestGrid::kDefaultBucketSize;
+
+InterestGrid::InterestGrid(int rows, int cols, int bucket_size) :
+    rows_(rows), cols_(cols), bucket_size_(bucket_size) {
+  if (rows <= 0 || cols <= 0 || bucket_size <= 0) {
+    throw invalid_argument("Invalid interest grid size");
+  }
+  bucket_rows_ = (rows + bucket_size - 1) / bucket_size;
+  bucket_cols_ = (cols + bucket_size - 1) / bucket_size;
+  buckets_.resize(static_cast<size_t>(bucket_rows_) * bucket_cols_);
+}
+
+void InterestGrid::Subscribe(Id id, int row, int col, int radius) {
+  if (radius < 0) {
+    throw invalid_argument("Negative interest radius");
+  }
+  auto found = subscribers_.find(id);
+  if (found != subscribers_.end()) {
+    Subscriber &subscriber = found->second;
+    subscriber.radius = radius;
+    Range previous = subscriber.range;
+    subscriber.range = RangeOf(row, col, radius);
+    subscriber.row = row;
+    subscriber.col = col;
+    Erase(&subscriber, previous, &subscriber.range);
+    Insert(&subscriber, subscriber.range, &previous);
+    return;
+  }
+  Subscriber &subscriber = subscribers_[id];
+  subscriber = Subscriber{id, row, col, radius, RangeOf(row, col, radius)};
+  Insert(&subscriber, subscriber.range);
+}
+
+void InterestGrid::Unsubscribe(Id id) noexcept {
+  auto found = subscribers_.find(id);
+  if (found == subscribers_.end()) return;
+  Erase(&found->second, found->second.range);
+  subscribers_.erase(found);
+}
+
+void InterestGrid::Move(Id id, int row, int col) {
+  auto found = subscribers_.find(id);
+  if (found == subscribers_.end()) return;
+  Subscriber &subscriber = found->second;
+  subscriber.row = row;
+  subscriber.col = col;
+  Range range = RangeOf(row, col, subscriber.radius);
+  // Most moves are one step, which usually keeps the same buckets
+  if (range.first_row == subscriber.range.first_row && range.last_row == subscriber.range.last_row &&
+      range.first_col == subscriber.range.first_col && range.last_col == subscriber.range.last_col) {
+    return;
+  }
+  Erase(&subscriber, subscriber.range, &range);
+  Insert(&subscriber, range, &subscriber.range);
+  subscriber.range = range;
+}
+
+bool InterestGrid::Contains(Id id, int row, int col) const noexcept {
+  auto found = subscribers_.find(id);
+  return found != subscribers_.end() &&
+    HexDistance(found->second.row, found->second.col, row, col) <= found->second.radius;
+}
+
+void InterestGrid::Collect(int row, int col, vector<Id> &ids) const {
+  if (row < 0 || row >= rows_ || col < 0 || col >= cols_) return;
+  const vector<Subscriber *> &candidates =
+    buckets_[static_cast<size_t>(row / bucket_size_) * bucket_cols_ + col / bucket_size_];
+  for (const Subscriber *subscriber : candidates) {
+    if (HexDistance(subscriber->row, subscriber->col, row, col) <= subscriber->radius) {
+      ids.push_back(subscriber->id);
+    }
+  }
+}
+
+InterestGrid::Range InterestGrid::RangeOf(int row, int col, int radius) const noexcept {
+  // Every step changes row or column by at most one, so area fits in a
+  // square of 2 * radius + 1 cells
+  Range range;
+  range.first_row = max(row - radius, 0) / bucket_size_;
+  range.last_row = min(max(row + radius, 0), rows_ - 1) / bucket_size_;
+  range.first_col = max(col - radius, 0) / bucket_size_;
+  range.last_col = min(max(col + radius, 0), cols_ - 1) / bucket_size_;
+  return range;
+}
+
+void InterestGrid::Insert(Subscriber *subscriber, const Range &range, const Range *except) {
+  for (int bucket_row = range.first_row; bucket_row <= range.last_row; ++bucket_row) {
+    for (int bucket_col = range.first_col; bucket_col <= range.last_col; ++bucket_col) {
+      if (except && except->Contains(bucket_row, bucket_col)) continue;
+      bucket(bucket_row, bucket_col).push_back(subscriber);
+      ++bucket_updates_;
+    }
+  }
+}
+
+void InterestGrid::Erase(const Subscriber *subscriber, const Range &range, const Range *except) noexcept {
+  for (int bucket_row = range.first_row; bucket_row <= range.last_row; ++bucket_row) {
+    for (int bucket_col = range.first_col; bucket_col <= range.last_col; ++bucket_col) {
+      if (except && except->Contains(bucket_row, bucket_col)) continue;
+      vector<Subscriber *> &entries = bucket(bucket_row, bucket_col);
+      auto found = find(entries.begin(), entries.end(), subscriber);
+      if (found != entries.end()) {
+        *found = entries.back();
+        entries.pop_back();
+      }
+      ++bucket_updates_;
+    }
+  }
+}
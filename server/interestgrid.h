@@ -0,0 +1,105 @@
+#ifndef YOBAHACK_SERVER_INTERESTGRID_H_
+#define YOBAHACK_SERVER_INTERESTGRID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "common/outboundqueue.h"
+
+/** Area-of-interest index of one level.
+ * Every subscriber (connection of a player) is interested in cells within
+ * hex radius around its player (see HexDistance). Map is split in square
+ * buckets, and each bucket lists subscribers whose area overlaps it, so
+ * finding who sees an event costs one bucket lookup plus exact distance
+ * checks of its few subscribers. Moving subscriber touches only buckets
+ * which enter or leave its area.
+ * Not thread-safe; meant to be owned by the level's tick.
+ */
+class InterestGrid {
+ public:
+  typedef std::uint64_t Id; ///< Usually connection id
+
+  static const int kDefaultBucketSize = 8;
+
+  InterestGrid(int rows, int cols, int bucket_size = kDefaultBucketSize);
+  InterestGrid(const InterestGrid &other) = delete;
+  InterestGrid(const InterestGrid &&other) = delete;
+
+  /** Adds subscriber or changes its center and radius */
+  void Subscribe(Id id, int row, int col, int radius);
+
+  void Unsubscribe(Id id) noexcept;
+
+  /** Moves center of subscriber's area; does nothing for unknown id */
+  void Move(Id id, int row, int col);
+
+  /** Returns true if cell is within subscriber's area */
+  bool Contains(Id id, int row, int col) const noexcept;
+
+  /** Appends ids of subscribers whose area contains the cell */
+  void Collect(int row, int col, std::vector<Id> &ids) const;
+
+  /** Queues event message which happened in the cell on connections of
+   * subscribers who see it (see IPServer::Multicast).
+   */
+  template <class Server> void Route(Server &server, int row, int col, const OutboundMessage &message,
+                                     bool coalescable = false) {
+    routed_.clear();
+    Collect(row, col, routed_);
+    server.Multicast(message, routed_, coalescable);
+  }
+
+  inline std::size_t size() const noexcept {
+    return subscribers_.size();
+  }
+
+  /** Number of bucket insertions and removals; shows cost of updates */
+  inline std::size_t bucket_updates() const noexcept {
+    return bucket_updates_;
+  }
+
+ private:
+  /** Buckets covered by area, inclusive */
+  struct Range {
+    int first_row;
+    int last_row;
+    int first_col;
+    int last_col;
+
+    inline bool Contains(int bucket_row, int bucket_col) const noexcept {
+      return bucket_row >= first_row && bucket_row <= last_row &&
+        bucket_col >= first_col && bucket_col <= last_col;
+    }
+  };
+
+  struct Subscriber {
+    Id id;
+    int row;
+    int col;
+    int radius;
+    Range range;
+  };
+
+  Range RangeOf(int row, int col, int radius) const noexcept;
+  /** Adds subscriber to buckets of range which are not in except */
+  void Insert(Subscriber *subscriber, const Range &range, const Range *except = nullptr);
+  /** Removes subscriber from buckets of range which are not in except */
+  void Erase(const Subscriber *subscriber, const Range &range, const Range *except = nullptr) noexcept;
+
+  inline std::vector<Subscriber *> &bucket(int bucket_row, int bucket_col) noexcept {
+    return buckets_[static_cast<std::size_t>(bucket_row) * bucket_cols_ + bucket_col];
+  }
+
+  int rows_;
+  int cols_;
+  int bucket_size_;
+  int bucket_rows_;
+  int bucket_cols_;
+  std::vector<std::vector<Subscriber *>> buckets_;
+  std::unordered_map<Id, Subscriber> subscribers_; ///< Nodes are stable, buckets point to them
+  std::vector<Id> routed_; ///< Used by Route()
+  std::size_t bucket_updates_ = 0;
+};
+
+#endif // YOBAHACK_SERVER_INTERESTGRID_H_
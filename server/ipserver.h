@@ -1,20 +1,33 @@
 #ifndef YOBAHACK_SERVER_IPSERVER_H_
 #define YOBAHACK_SERVER_IPSERVER_H_
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <list>
+#include <vector>
 #include <thread>
 #include <exception>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <functional>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
-#include "common/sharedlockwrapper.h"
+#include <boost/asio/steady_timer.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "common/socketwrapper.h"
+#include "common/outboundqueue.h"
 #include "common/debug.h"
 #include "common/logging.h"
+#include "server/connectionregistry.h"
+#include "server/connectionpool.h"
+#include "server/timeoutwheel.h"
 
 template <class Connection, class Protocol>
  class IPServer;
@@ -25,12 +38,19 @@ template <class Connection, class Protocol>
  * You should use async operations and always have one read operation
  * queued. You should also handle socket disconnection, so that connection
  * is disposed.
+ * Start them with ReadSome(), Read(), ReadFrames(), WriteSome() and
+ * Write(): closed connection is reset and pooled (or destroyed) only after
+ * handlers of all of them have returned.
+ * If server has timeouts set, connection is Free()d when it does not
+ * complete handshake or stays silent for too long; call Touch() on every
+ * read and CompleteHandshake() when peer is authenticated.
  * \sa IPServer
  */
 template <class Connection, class Protocol>
  class IPConnection : public SocketWrapper<Protocol> {
  public:
   typedef IPServer<Connection, Protocol> ServerType;
+  typedef std::uint64_t ConnectionId;
 
   IPConnection(const IPConnection<Connection, Protocol> &other) = delete;
 
@@ -39,17 +59,7 @@ template <class Connection, class Protocol>
    */
   void Free() noexcept {
     if (closing_.exchange(true)) return;
-    PrepareDisconnect();
-    try {
-      Disconnect();
-    } catch (const std::exception &e) {
-      LogWarning(e.what());
-    }
-    // Destruction should be done ONLY after we handle all async ops callbacks
-    // and from io_service thread.
-    // God help you if you destruct this class when unhandled async ops
-    // are present.
-    socket().get_io_service().dispatch(std::bind(ServerType::CloseConnection, server_, this));
+    FreeClaimed();
   }
 
   /** Returns true if connection disposal is pending */
@@ -61,9 +71,54 @@ template <class Connection, class Protocol>
     return server_;
   }
 
+  /** Returns true if server is shutting down; no new reads are started */
+  inline bool draining() const noexcept {
+    return draining_;
+  }
+
+  /** Returns id of connection in server's registry */
+  inline ConnectionId id() const noexcept {
+    return id_;
+  }
+
+  /** Returns index of server's io_service this connection is bound to */
+  inline std::size_t worker() const noexcept {
+    return worker_;
+  }
+
+  /** Queues message for sending.
+   * Nothing is written until server's FlushAll(); all messages queued
+   * by then go out in one write.
+   * Coalescable messages (state updates superseded by next ones) are
+   * dropped when client is above server's low outbound watermark; client
+   * above high watermark is disconnected.
+   * Thread-safe.
+   */
+  void Send(OutboundMessage message, bool coalescable = false) {
+    if (Enqueue(std::move(message), coalescable)) {
+      FreeClaimed();
+    }
+  }
+
+  /** Returns bytes queued for sending and not yet written */
+  inline std::size_t outbound_bytes() noexcept {
+    return outbound_.pending_bytes();
+  }
+
+  /** Returns messages queued for sending and not yet written */
+  inline std::size_t outbound_messages() noexcept {
+    return outbound_.pending_messages();
+  }
+
+  /** Returns number of coalescable messages dropped because of backpressure */
+  inline std::size_t outbound_dropped() noexcept {
+    return outbound_.dropped();
+  }
+
  protected:  
   explicit IPConnection(boost::asio::io_service &io_service, ServerType *server) noexcept :
-    SocketWrapper<Protocol>(io_service), server_(server), closing_(false) { }
+    SocketWrapper<Protocol>(io_service), server_(server), id_(0), closing_(false),
+    timeout_stage_(kHandshake) { }
 
   /** Called after connection is established.
    * You should start processing connection from there.
@@ -73,14 +128,269 @@ template <class Connection, class Protocol>
   /** Called before forced disconnect (used by Free() method) **/
   virtual void PrepareDisconnect() noexcept { }
 
+  // Reads are not started while server drains connections
+  template <class MutableBufferSequence, class ReadHandler>
+   void ReadSome(const MutableBufferSequence &buffers, ReadHandler func) noexcept {
+    if (draining_) return;
+    SocketWrapper<Protocol>::ReadSome(buffers, Track(std::move(func)));
+  }
+
+  template <class MutableBufferSequence, class ReadHandler>
+   void Read(const MutableBufferSequence &buffers, ReadHandler func) noexcept {
+    if (draining_) return;
+    SocketWrapper<Protocol>::Read(buffers, Track(std::move(func)));
+  }
+
+  template <class ReadHandler> void ReadFrames(FrameBuffer &buffer, ReadHandler func) noexcept {
+    if (draining_) return;
+    SocketWrapper<Protocol>::ReadFrames(buffer, Track(std::move(func)));
+  }
+
+  template <class ConstBufferSequence, class WriteHandler>
+   void WriteSome(const ConstBufferSequence &buffers, WriteHandler func) noexcept {
+    SocketWrapper<Protocol>::WriteSome(buffers, Track(std::move(func)));
+  }
+
+  template <class ConstBufferSequence, class WriteHandler>
+   void Write(const ConstBufferSequence &buffers, WriteHandler func) noexcept {
+    SocketWrapper<Protocol>::Write(buffers, Track(std::move(func)));
+  }
+
+  /** Called when peer was silent for server's heartbeat interval.
+   * Typically sends a ping so that peer answers before idle timeout.
+   * Called from io_service thread, outside of server's registry locks.
+   */
+  virtual void HandleHeartbeat() noexcept { }
+
+  /** Pushes idle deadline forward; should be called on every read.
+   * Does not extend handshake deadline.
+   */
+  void Touch() noexcept {
+    if (timeout_stage_ == kHandshake) return;
+    timeout_stage_ = kIdle;
+    ArmIdle();
+  }
+
+  /** Switches connection from handshake timeout to idle timeout */
+  void CompleteHandshake() noexcept {
+    timeout_stage_ = kIdle;
+    ArmIdle();
+  }
+
+  /** Called when closed connection is put back into server's pool.
+   * Should bring connection to the state it had just after construction;
+   * allocated buffers should be kept for reuse.
+   **/
+  virtual void Reset() noexcept { }
+
  private:
   friend class IPServer<Connection, Protocol>;
 
+  enum TimeoutStage {
+    kHandshake,
+    kIdle,
+    kHeartbeat ///< Heartbeat was sent, waiting for anything from peer
+  };
+
+  /** Handler which tells connection when it has returned */
+  template <class Handler> struct TrackedHandler {
+    template <class... Args> void operator()(Args &&... args) {
+      handler(std::forward<Args>(args)...);
+      connection->Complete();
+    }
+
+    IPConnection *connection;
+    Handler handler;
+  };
+
+  /** Counts operation started with returned handler */
+  template <class Handler> TrackedHandler<Handler> Track(Handler &&handler) noexcept {
+    ++operations_;
+    return TrackedHandler<Handler>{ this, std::move(handler) };
+  }
+
+  /** Called when handler of operation has returned, and by server when
+   * connection is taken off the registry; the last call disposes of it
+   */
+  void Complete() noexcept {
+    if (--operations_ == 0) {
+      server_->DisposeConnection(static_cast<Connection *>(this));
+    }
+  }
+
+  /** What expired deadline means for connection */
+  enum ExpireAction {
+    kExpireNothing, ///< Deadline was pushed forward or connection is closing
+    kExpireHeartbeat, ///< Heartbeat should be sent
+    kExpireTimeout ///< Connection timed out and is claimed for disposal
+  };
+
+  /** Arms first deadline; called by server when connection is registered */
+  void StartTimeouts() noexcept {
+    if (server_->handshake_timeout_.count() > 0) {
+      timeout_stage_ = kHandshake;
+      ArmTimeout(server_->handshake_timeout_);
+    } else {
+      CompleteHandshake();
+    }
+  }
+
+  /** Returns true if heartbeat should be sent before idle timeout */
+  inline bool heartbeat_enabled() const noexcept {
+    return server_->heartbeat_interval_.count() > 0 &&
+      (server_->idle_timeout_.count() == 0 || server_->heartbeat_interval_ < server_->idle_timeout_);
+  }
+
+  /** Arms deadline of silent peer */
+  void ArmIdle() noexcept {
+    if (heartbeat_enabled()) {
+      ArmTimeout(server_->heartbeat_interval_);
+    } else if (server_->idle_timeout_.count() > 0) {
+      ArmTimeout(server_->idle_timeout_);
+    }
+  }
+
+  void ArmTimeout(std::chrono::milliseconds timeout) noexcept {
+    server_->timeouts(worker_, wheel_).Arm(timeout_, id_, timeout);
+  }
+
+  /** Called by server under registry lock when deadline expires.
+   * Connection is claimed for returned action: timed out one is marked
+   * closing, and one due for heartbeat is pinned, so that it is not
+   * disposed until Expire() is done.
+   */
+  ExpireAction ClaimExpired() noexcept {
+    // Re-armed by read after deadline was taken off the wheel
+    if (timeout_.armed() || closing_) return kExpireNothing;
+    if (timeout_stage_ == kIdle && heartbeat_enabled()) {
+      ++pins_;
+      // CloseConnection() checks pins after setting closing flag
+      if (closing_) {
+        --pins_;
+        return kExpireNothing;
+      }
+      return kExpireHeartbeat;
+    }
+    return closing_.exchange(true) ? kExpireNothing : kExpireTimeout;
+  }
+
+  /** Does action claimed by ClaimExpired(); called without registry locks,
+   * as it runs user code
+   */
+  void Expire(ExpireAction action) noexcept {
+    if (action == kExpireHeartbeat) {
+      timeout_stage_ = kHeartbeat;
+      HandleHeartbeat();
+      if (server_->idle_timeout_.count() > 0) {
+        ArmTimeout(server_->idle_timeout_ - server_->heartbeat_interval_);
+      } else {
+        // Heartbeats only, peer is never timed out
+        timeout_stage_ = kIdle;
+        ArmTimeout(server_->heartbeat_interval_);
+      }
+      --pins_;
+    } else if (action == kExpireTimeout) {
+      LogLimited(logging::kWarning, ServerType::kWarningsPerInterval, ServerType::kWarningInterval,
+                 timeout_stage_ == kHandshake ? "Handshake timeout" : "Idle timeout");
+      FreeClaimed();
+    }
+  }
+
+  /** Starts writing queued messages; called by server from io_service thread,
+   * under registry lock, so that counted write does not dispose of connection
+   */
+  void Flush() {
+    if (closing_) return;
+    ++operations_;
+    bool started = outbound_.Flush(this->socket(), [this](const boost::system::error_code &error) {
+                                     if (error) {
+                                       Free();
+                                     } else if (draining_ && outbound_bytes() == 0 && !closing_.exchange(true)) {
+                                       // Stopping server waits for drained connections to close
+                                       ++server_->drained_;
+                                       FreeClaimed();
+                                     }
+                                     Complete();
+                                   });
+    if (!started) --operations_;
+  }
+
+  /** Does the work of Send() except for disconnecting slow client.
+   * \return true if client is too slow and connection was claimed for
+   * disposal; caller should FreeClaimed() it, outside of registry locks
+   */
+  bool Enqueue(OutboundMessage message, bool coalescable) {
+    switch (outbound_.Push(std::move(message), coalescable)) {
+      case OutboundQueue::kScheduleFlush:
+        server_->MarkDirty(id_);
+        return false;
+      case OutboundQueue::kOverflow:
+        if (closing_.exchange(true)) return false;
+        LogLimited(logging::kWarning, ServerType::kWarningsPerInterval, ServerType::kWarningInterval,
+                   "Client is too slow, disconnecting");
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /** Prepares closed connection for reuse */
+  void Recycle() noexcept {
+    Reset();
+    outbound_.Reset();
+    id_ = 0;
+    closing_ = false;
+    draining_ = false;
+    timeout_stage_ = kHandshake;
+  }
+
+  /** Does the work of Free() after closing_ flag is set by caller */
+  void FreeClaimed() noexcept {
+    PrepareDisconnect();
+    // Socket is closed from io_service thread, not from whoever frees us
+    // (game thread evicting slow client, server stopping); claimed
+    // connection is not destroyed until CloseConnection() below is run.
+    // post() and not dispatch(): we may be called while registry is locked.
+    this->socket().get_io_service().post([this]() {
+        try {
+          this->Disconnect();
+        } catch (const std::exception &e) {
+          // Storm of dying connections should not make logger the bottleneck
+          LogLimited(logging::kWarning, ServerType::kWarningsPerInterval, ServerType::kWarningInterval,
+                     "Disconnect failed: {}", e.what());
+        }
+        // Server takes connection off the registry; it is disposed of when
+        // the handlers of aborted operations have returned (see Complete())
+        this->socket().get_io_service().post(std::bind(&ServerType::CloseConnection, server_, id_));
+      });
+  }
+
   ServerType *server_;
+  ConnectionId id_; ///< Set by server before connection becomes visible in registry
+  std::size_t worker_ = 0; ///< Index of server's io_service this connection is bound to
+  std::size_t wheel_ = 0; ///< Index of worker's timeouts wheel keeping deadline of this connection
   std::atomic_bool closing_;
+  std::atomic_bool draining_{false};
+  OutboundQueue outbound_;
+  TimeoutWheel::Entry timeout_;
+  std::atomic<TimeoutStage> timeout_stage_;
+  std::atomic<unsigned int> pins_{0}; ///< Server works with connection outside of registry locks
+  /** Operations whose handlers have not returned, plus one while connection is registered */
+  std::atomic<unsigned int> operations_{0};
 };
 
+#ifdef SO_REUSEPORT
+/** Socket option which lets several sockets listen on the same port;
+ * kernel spreads incoming connections between them. */
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePort;
+#endif
+
 /** Multi-threaded IP server based on thread pool.
+ * By default all threads share one io_service and one acceptor. In
+ * service-per-thread mode every thread gets its own io_service and its own
+ * acceptor bound to the same port with SO_REUSEPORT, so the kernel spreads
+ * incoming connections and each connection is handled by one thread (and,
+ * with CPU pinning, one core) for its whole life.
  * \param Protocol expected to be boost::asio::ip tcp or udp
  * \param Connection expected to be class inherited from IPConnection
  * \sa IPConnection
@@ -88,11 +398,17 @@ template <class Connection, class Protocol>
 template <class Connection, class Protocol> class IPServer {
  public:
   typedef std::unique_ptr<Connection> ConnectionPointer;
-  typedef std::list<ConnectionPointer> ConnectionList;
+  typedef ConnectionRegistry<Connection> Registry;
+  typedef typename Registry::Id ConnectionId;
+
+  typedef ConnectionPool<Connection> Pool;
+
+  /** Closed connections kept for reuse unless set_connection_pool() says otherwise */
+  static const std::size_t kDefaultPoolHighWater = 64;
+  static const std::chrono::milliseconds kDefaultDrainTimeout;
 
   explicit IPServer(const typename Protocol::endpoint &&endpoint) noexcept :
-    acceptor_(io_service_, endpoint),
-      connections_(new ConnectionList()) { }
+    endpoint_(endpoint) { }
 
   IPServer(const IPServer &other) = delete;
 
@@ -105,86 +421,214 @@ template <class Connection, class Protocol> class IPServer {
     using namespace std;
 
     if (working_) return;
-    // wait for threads to finish their previous work
-    // see StopService() comments
-    for (thread &thread : threads_) {
-      thread.join();
+    // threads are left running if StopService() was called from one of them
+    JoinThreads();
+    std::size_t workers_number = service_per_thread_ ? threads_number_ : 1;
+    // Threads of shared io_service do not contend for one wheel lock
+    std::size_t wheels_number = service_per_thread_ ? 1 : threads_number_;
+    if (workers_.size() != workers_number || workers_.front()->timeouts.size() != wheels_number) {
+      // Connections are bound to io_service of their worker
+      AssertMsg(connections_.size() == 0, "Connections are still alive");
+      workers_.clear();
+      for (std::size_t i = 0; i < workers_number; ++i) {
+        workers_.emplace_back(new Worker(this, i, wheels_number));
+        workers_.back()->pool.set_limits(pool_warm_size_, pool_high_water_);
+      }
+    }
+    for (auto &worker : workers_) {
+      // this thing prevents io_service from going out from run() loop
+      worker->io_service.reset();
+      worker->work.reset(new io_service::work(worker->io_service));
+      if (timeouts_enabled()) {
+        for (auto &timeouts : worker->timeouts) {
+          std::lock_guard<std::mutex> lock(timeouts->timer_mutex);
+          timeouts->ticking = true;
+          ScheduleTimeouts(*timeouts);
+        }
+      }
     }
-    threads_.clear();
-    // this thing prevents io_service from going out from run() loop
-    work_.reset(new io_service::work(io_service_));
     // spawn threads for io_service::run event loop
     for (int i = 0; i < threads_number_; ++i) {
-      threads_.push_back(thread(bind((size_t(io_service::*)())&io_service::run, &io_service_)));
+      io_service *service = &workers_[i % workers_.size()]->io_service;
+      threads_.push_back(thread(bind((size_t(io_service::*)())&io_service::run, service)));
+      if (pin_threads_) {
+        PinThread(threads_.back(), i);
+      }
     }
     working_ = true;
   }
 
-  /** Aborts all operations and sends thread pool signal to stop.
+  /** Result of StopService() */
+  struct DrainStats {
+    std::size_t drained; ///< Closed after all their messages were written
+    std::size_t forced; ///< Closed with messages still pending
+  };
+
+  /** Stops accepting and reading, drains connections and stops thread pool.
+   * Queued messages are flushed; connections are closed as soon as their
+   * outbound queues are empty, and the rest is forcibly closed after
+   * drain timeout. Then waits for threads to finish, unless called from
+   * one of them (they are joined by next StartService() then).
    * If pool is stopped, does nothing.
    * Not thread-safe.
    */
-  void StopService() noexcept {
-    if (!working_) return;
-    // There is no way to receive callback when all threads are stopped.
-    // One way to do this is to implement our own "run" function
-    // which will execute io_service_.run() and then clean up thread
-    // after itself.
-    // Other way is to clean threads up on next StartService()
-    // TODO (abbradar) Maybe later
+  DrainStats StopService(std::chrono::milliseconds drain_timeout = kDefaultDrainTimeout) noexcept {
+    DrainStats stats{ 0, 0 };
+    if (!working_) return stats;
     StopListening();
-    DisconnectAll();
-    work_.reset();
+    // connections do not start new reads from now on
+    draining_ = true;
+    connections_.ForEach([](ConnectionId, Connection &connection) {
+                           connection.draining_ = true;
+                         });
+    auto deadline = std::chrono::steady_clock::now() + drain_timeout;
+    while (true) {
+      FlushAll();
+      stats.drained += FreeIf([](Connection &connection) {
+                                return connection.outbound_bytes() == 0;
+                              });
+      // The rest close themselves once written out (see IPConnection::Flush());
+      // the last one to close, or message queued meanwhile, wakes us up
+      std::unique_lock<std::mutex> lock(dirty_mutex_);
+      if (!drain_changed_.wait_until(lock, deadline, [this]() {
+                                       return connections_.size() == 0 || !dirty_.empty();
+                                     }) || connections_.size() == 0) {
+        break;
+      }
+    }
+    draining_ = false;
+    stats.drained += drained_.exchange(0);
+    stats.forced = DisconnectAll();
+    for (auto &worker : workers_) {
+      for (auto &timeouts : worker->timeouts) {
+        StopTimeouts(*timeouts);
+      }
+      // io_service::run() returns when all closed connections are disposed
+      worker->work.reset();
+    }
     working_ = false;
+    if (!in_pool_thread()) {
+      JoinThreads();
+    }
+    return stats;
   }
 
   /** Returns true if we are accepting new connections */
   inline bool is_open() const noexcept {
-    return acceptor_.is_open();
+    return listening_;
   }
 
   /** Return acceptor's local endpoint */
   inline typename Protocol::endpoint local_endpoint() const noexcept {
-    return acceptor_.local_endpoint();
+    if (is_open()) {
+      boost::system::error_code ec;
+      return workers_.front()->acceptor.local_endpoint(ec);
+    }
+    return endpoint_;
   }
 
-  /** Sets now local endpoint for accepting new connections */
+  /** Sets now local endpoint for accepting new connections.
+   * If we are accepting connections, throws exception.
+   */
   void set_local_endpoint(const typename Protocol::endpoint &&endpoint) {
-    boost::system::error_code ec;
-    acceptor_.bind(endpoint, ec);
-    if (ec) throw std::runtime_error(ec.message());
+    if (is_open()) {
+      throw std::runtime_error("Server is listening");
+    }
+    endpoint_ = endpoint;
   }
 
   /** Starts thread pool if not started and starts accepting new connections.
    * If we are already accepting connections, does nothing.
+   * Throws exception if local endpoint cannot be bound.
    */
-  void StartListening() noexcept {
-    if (acceptor_.is_open()) return;
+  void StartListening() {
+    if (is_open()) return;
     StartService();
-    acceptor_.listen();
-    AcceptNext();
+    try {
+      for (auto &worker : workers_) {
+        OpenAcceptor(worker->acceptor);
+      }
+    } catch (...) {
+      StopListening();
+      throw;
+    }
+    // handlers check the flag instead of acceptors closed from other threads
+    listening_ = true;
+    for (auto &worker : workers_) {
+      worker->pool.Warm();
+      // several accepts are kept outstanding to keep up with connection storms
+      for (std::size_t i = 0; i < accept_backlog_; ++i) {
+        AcceptNext(*worker);
+      }
+    }
   }
 
   /** Stops listening for new connections.
    * If we are stopped already, does nothing.
    */
   void StopListening() noexcept {
-    acceptor_.close();
+    listening_ = false;
+    for (auto &worker : workers_) {
+      boost::system::error_code ec;
+      worker->acceptor.close(ec);
+      std::lock_guard<std::mutex> lock(worker->accept_mutex);
+      worker->accept_timer.cancel(ec);
+      worker->deferred_accepts = 0;
+    }
   }
 
-  /** Disconnects all clients from server.
-   * If */
-  void DisconnectAll() noexcept {
-    // This can be source of deadlocks, exceptions,
-    // nukes and other nasty things.
-    // We try to lock connections list and send Free() to all connections
-    // so they *should* be destroyed from another thread.
-    // In fact we block all io_service threads while working here
-    connections_.Lock();
-    for (ConnectionPointer &connection : *connections_) {
-      connection->Free();
+  /** Returns number of accepts kept outstanding on every acceptor */
+  inline std::size_t accept_backlog() const noexcept {
+    return accept_backlog_;
+  }
+
+  /** Sets number of accepts kept outstanding on every acceptor.
+   * If we are accepting connections, throws exception.
+   */
+  void set_accept_backlog(std::size_t value) {
+    if (is_open()) {
+      throw std::runtime_error("Server is listening");
     }
-    connections_.Unlock();
+    if (value == 0) {
+      throw std::out_of_range("Accept backlog should be > 0");
+    }
+    accept_backlog_ = value;
+  }
+
+  /** Returns maximal number of connections; 0 means no limit */
+  inline std::size_t max_connections() const noexcept {
+    return max_connections_;
+  }
+
+  /** Sets maximal number of connections; 0 means no limit.
+   * Connections accepted above the limit are closed right away.
+   * Thread-safe.
+   */
+  void set_max_connections(std::size_t value) noexcept {
+    max_connections_ = value;
+  }
+
+  /** Number of connections accepted and registered */
+  inline std::size_t accepted() const noexcept {
+    return accepted_;
+  }
+
+  /** Number of connections closed right after accept because of limit */
+  inline std::size_t rejected() const noexcept {
+    return rejected_;
+  }
+
+  /** Number of failed accepts */
+  inline std::size_t accept_errors() const noexcept {
+    return accept_errors_;
+  }
+
+  /** Disconnects all clients from server.
+   * Connections are destroyed later from io_service threads.
+   * \return Number of connections disconnected by this call
+   */
+  std::size_t DisconnectAll() noexcept {
+    return FreeIf([](Connection &) { return true; });
   }
 
   /** Returns number of threads in the thread pool. */
@@ -206,19 +650,105 @@ template <class Connection, class Protocol> class IPServer {
     threads_number_ = value;
   }
 
-  /** Close and dispose of connection by pointer */
-  void CloseConnection(Connection *pointer) {
-    connections_.Lock();
-    connections_->remove_if([pointer](const typename Connection::Pointer &p) -> bool {
-                              if (p == pointer) {
-                                if (p->closing())
-                                  return true;
-                                else
-                                  p->Free();
-                              }
-                              return false;
-                            });
-    connections_.Unlock();
+  /** Returns true if every thread has its own io_service and acceptor */
+  inline bool service_per_thread() const noexcept {
+    return service_per_thread_;
+  }
+
+  /** Switches between shared io_service and io_service-per-thread modes.
+   * Typically used with threads number equal to number of cores.
+   * If server is already working or SO_REUSEPORT is not supported, throws exception.
+   * Not thread-safe.
+   */
+  void set_service_per_thread(const bool value) {
+    if (working_) {
+      throw std::runtime_error("Service is running");
+    }
+#ifndef SO_REUSEPORT
+    if (value) {
+      throw std::runtime_error("SO_REUSEPORT is not supported");
+    }
+#endif
+    service_per_thread_ = value;
+  }
+
+  /** Returns true if threads are pinned to CPU cores */
+  inline bool pin_threads() const noexcept {
+    return pin_threads_;
+  }
+
+  /** Pins thread number i to core i modulo number of cores.
+   * Takes effect on next StartService(); ignored where not supported.
+   * Not thread-safe.
+   */
+  void set_pin_threads(const bool value) noexcept {
+    pin_threads_ = value;
+  }
+
+  /** Sets connection timeouts; zero disables corresponding timeout.
+   * \param handshake Time from accept to IPConnection::CompleteHandshake()
+   * \param idle Maximal time without reads (see IPConnection::Touch())
+   * \param heartbeat Time without reads after which
+   * IPConnection::HandleHeartbeat() is called; should be less than idle
+   * If server is already working, throws exception.
+   * Not thread-safe.
+   */
+  void set_timeouts(std::chrono::milliseconds handshake, std::chrono::milliseconds idle,
+                    std::chrono::milliseconds heartbeat = std::chrono::milliseconds(0)) {
+    if (working_) {
+      throw std::runtime_error("Service is running");
+    }
+    handshake_timeout_ = handshake;
+    idle_timeout_ = idle;
+    heartbeat_interval_ = heartbeat;
+  }
+
+  inline std::chrono::milliseconds handshake_timeout() const noexcept {
+    return handshake_timeout_;
+  }
+
+  inline std::chrono::milliseconds idle_timeout() const noexcept {
+    return idle_timeout_;
+  }
+
+  inline std::chrono::milliseconds heartbeat_interval() const noexcept {
+    return heartbeat_interval_;
+  }
+
+  /** Close and dispose of connection by id.
+   * If connection is not closing yet, it is Free()d first.
+   */
+  void CloseConnection(ConnectionId id) {
+    Connection *claimed = nullptr;
+    bool pinned = false;
+    bool found = connections_.With(id, [this, id, &claimed, &pinned](Connection &connection) {
+                                     if (!connection.closing_.exchange(true)) {
+                                       claimed = &connection;
+                                     } else if (connection.pins_ != 0) {
+                                       // Heartbeat is being sent (see HandleTimeouts()), retry after it
+                                       pinned = true;
+                                       connection.socket().get_io_service().post(
+                                         std::bind(&IPServer<Connection, Protocol>::CloseConnection, this, id));
+                                     }
+                                   });
+    if (!found || pinned) return;
+    if (claimed) {
+      // Will call us again after disconnection
+      claimed->FreeClaimed();
+    } else {
+      // Reset and pooling (or destruction) happen outside of registry locks
+      ConnectionPointer connection = connections_.Remove(id);
+      if (connection) {
+        --reserved_;
+        timeouts(connection->worker_, connection->wheel_).Disarm(connection->timeout_);
+        // Owned by its outstanding operations until the last one completes
+        connection.release()->Complete();
+        if (draining_ && connections_.size() == 0) {
+          std::lock_guard<std::mutex> lock(dirty_mutex_);
+          drain_changed_.notify_all();
+        }
+      }
+    }
   }
 
   /** Returns true if thread pool is working. */
@@ -226,44 +756,519 @@ template <class Connection, class Protocol> class IPServer {
     return working_;
   }
 
-  /** Returns wrapper to connections vector */
-  inline SharedLockWrapper<ConnectionList> &connections() noexcept {
+  /** Sets number of connections created in advance of accepting and
+   * maximum number of closed connections kept for reuse (none and
+   * kDefaultPoolHighWater by default).
+   * In io_service-per-thread mode limits apply to each thread.
+   * Not thread-safe.
+   */
+  void set_connection_pool(std::size_t warm_size, std::size_t high_water) {
+    if (warm_size > high_water) {
+      throw std::out_of_range("Warm size should not exceed high-water mark");
+    }
+    pool_warm_size_ = warm_size;
+    pool_high_water_ = high_water;
+    for (auto &worker : workers_) {
+      worker->pool.set_limits(warm_size, high_water);
+      if (working_) {
+        worker->pool.Warm();
+      }
+    }
+  }
+
+  /** Returns pool of idle connections of given io_service.
+   * There is only one in shared io_service mode.
+   */
+  inline Pool &connection_pool(std::size_t worker = 0) {
+    return workers_.at(worker)->pool;
+  }
+
+  /** Returns registry of active connections */
+  inline Registry &connections() noexcept {
     return connections_;
   }
 
+  ~IPServer() {
+    StopService();
+    JoinThreads();
+  }
+
+  /** Queues one message on every connection.
+   * Message is shared by all outbound queues and freed when last write of
+   * it completes, so broadcasting costs one serialization plus a pointer
+   * per connection.
+   * Thread-safe.
+   * \sa IPConnection::Send
+   */
+  void Broadcast(const OutboundMessage &message, bool coalescable = false) {
+    Broadcast(message, [](Connection &) { return true; }, coalescable);
+  }
+
+  /** Queues one message on every connection for which filter(connection)
+   * returns true (e.g. players in the same level).
+   * Filter is called under registry locks and should not call server.
+   * Clients found too slow are disconnected after all connections are
+   * visited, outside of the locks.
+   * Thread-safe.
+   */
+  template <class Filter>
+   void Broadcast(const OutboundMessage &message, Filter filter, bool coalescable = false) {
+    std::vector<Connection *> evicted;
+    try {
+      connections_.ForEach([&message, &filter, coalescable, &evicted](ConnectionId, Connection &connection) {
+                             if (!connection.closing() && filter(connection) &&
+                                 connection.Enqueue(message, coalescable)) {
+                               evicted.push_back(&connection);
+                             }
+                           });
+    } catch (...) {
+      FreeClaimed(evicted);
+      throw;
+    }
+    FreeClaimed(evicted);
+  }
+
+  /** Queues one message on connections with given ids (e.g. collected by
+   * InterestGrid); ids of closed connections are skipped.
+   * Unlike filtered Broadcast() does not visit other connections.
+   * Thread-safe.
+   */
+  template <class Ids>
+   void Multicast(const OutboundMessage &message, const Ids &ids, bool coalescable = false) {
+    std::vector<Connection *> evicted;
+    try {
+      for (ConnectionId id : ids) {
+        connections_.With(id, [&message, coalescable, &evicted](Connection &connection) {
+                            if (!connection.closing() && connection.Enqueue(message, coalescable)) {
+                              evicted.push_back(&connection);
+                            }
+                          });
+      }
+    } catch (...) {
+      FreeClaimed(evicted);
+      throw;
+    }
+    FreeClaimed(evicted);
+  }
+
+  /** Sets per-connection limits of pending outbound data in bytes.
+   * Above low watermark coalescable messages are dropped, above high one
+   * connection is disconnected. 0 means no limit.
+   * Thread-safe.
+   */
+  void set_outbound_watermarks(std::size_t low, std::size_t high) {
+    if (high && low > high) {
+      throw std::out_of_range("Low watermark should not exceed high one");
+    }
+    outbound_low_ = low;
+    outbound_high_ = high;
+    connections_.ForEach([low, high](ConnectionId, Connection &connection) {
+                           connection.outbound_.set_watermarks(low, high);
+                         });
+  }
+
+  /** Returns low watermark of pending outbound data */
+  inline std::size_t outbound_low_watermark() const noexcept {
+    return outbound_low_;
+  }
+
+  /** Returns high watermark of pending outbound data */
+  inline std::size_t outbound_high_watermark() const noexcept {
+    return outbound_high_;
+  }
+
+  /** Starts writing messages queued by connections since last call.
+   * Intended to be called once at the end of a game tick, so that all
+   * messages of the tick are coalesced into one write per connection.
+   * Thread-safe.
+   */
+  void FlushAll() {
+    std::vector<ConnectionId> dirty;
+    {
+      std::lock_guard<std::mutex> lock(dirty_mutex_);
+      dirty.swap(dirty_);
+    }
+    for (ConnectionId id : dirty) {
+      // Socket is touched only from its io_service; connection is looked up
+      // again there, as it could be closed in between.
+      connections_.With(id, [this, id](Connection &connection) {
+                          connection.socket().get_io_service().post(
+                            std::bind(&IPServer<Connection, Protocol>::FlushConnection, this, id));
+                        });
+    }
+    // Keep allocated memory for next tick
+    std::lock_guard<std::mutex> lock(dirty_mutex_);
+    if (dirty_.empty()) {
+      dirty.clear();
+      dirty_.swap(dirty);
+    }
+  }
+
  private:
-  /** Creates new IPConnection and tries to receive next connection. */
-  void AcceptNext() noexcept {
-    auto pointer = std::unique_ptr<Connection>(new Connection(io_service_, this));
-    // if connection is never received, this object will destruct on its own because of unique_ptr
-    acceptor_.async_accept(pointer->socket(),
-                           std::bind(&IPServer<Connection, Protocol>::HandleConnected, this,
-                                     std::move(pointer)));
+  friend class IPConnection<Connection, Protocol>;
+
+  typedef typename IPConnection<Connection, Protocol>::ExpireAction ExpireAction;
+
+  static const std::chrono::milliseconds kMinAcceptBackoff;
+  static const std::chrono::milliseconds kMaxAcceptBackoff;
+  /** Limit of warnings of every call site about single connections */
+  static const std::uint32_t kWarningsPerInterval = 10;
+  static const std::chrono::milliseconds kWarningInterval;
+
+  /** Resets connection and puts it back into pool (or destroys it);
+   * called when connection is off the registry and has no operations left
+   */
+  void DisposeConnection(Connection *connection) noexcept {
+    ConnectionPointer pointer(connection);
+    pointer->Recycle();
+    workers_[pointer->worker_]->pool.Release(std::move(pointer));
+  }
+
+  /** Frees connections for which predicate is true.
+   * \return Number of connections freed by this call
+   */
+  template <class Predicate>
+   std::size_t FreeIf(Predicate predicate) noexcept {
+    // Under shard locks we only claim connections by setting their closing
+    // flag; nobody else can destroy claimed connection until we queue its
+    // disposal, so the rest of Free() is safely done without locks.
+    std::vector<Connection *> claimed;
+    connections_.ForEach([&claimed, &predicate](ConnectionId, Connection &connection) {
+                           if (!connection.closing() && predicate(connection) &&
+                               !connection.closing_.exchange(true)) {
+                             claimed.push_back(&connection);
+                           }
+                         });
+    FreeClaimed(claimed);
+    return claimed.size();
+  }
+
+  /** Finishes disposal of connections claimed under registry locks;
+   * called after the locks are released, as it runs user code
+   */
+  static void FreeClaimed(const std::vector<Connection *> &claimed) noexcept {
+    for (Connection *connection : claimed) {
+      connection->FreeClaimed();
+    }
+  }
+
+  /** Returns true if called from one of the pool threads */
+  bool in_pool_thread() const noexcept {
+    for (const std::thread &thread : threads_) {
+      if (thread.get_id() == std::this_thread::get_id()) return true;
+    }
+    return false;
+  }
+
+  /** Waits for pool threads to finish */
+  void JoinThreads() noexcept {
+    for (std::thread &thread : threads_) {
+      if (!thread.joinable()) continue;
+      if (thread.get_id() == std::this_thread::get_id()) {
+        thread.detach();
+      } else {
+        thread.join();
+      }
+    }
+    threads_.clear();
+  }
+
+  /** Remembers connection which has messages waiting for FlushAll() */
+  void MarkDirty(ConnectionId id) {
+    std::lock_guard<std::mutex> lock(dirty_mutex_);
+    dirty_.push_back(id);
+    // Draining server flushes it (see StopService())
+    if (draining_) drain_changed_.notify_all();
+  }
+
+  /** Starts writing messages queued by connection, if it is still alive */
+  void FlushConnection(ConnectionId id) {
+    connections_.With(id, [](Connection &connection) {
+                        connection.Flush();
+                      });
+  }
+
+  /** Wheel of connection deadlines with timer which advances it */
+  struct Timeouts {
+    explicit Timeouts(boost::asio::io_service &io_service) : timer(io_service) { }
+
+    boost::asio::steady_timer timer;
+    std::mutex timer_mutex;
+    bool ticking = false; ///< Guarded by timer_mutex
+    TimeoutWheel wheel;
+    // Used only by timer handler
+    std::vector<ConnectionId> expired;
+    std::vector<std::pair<Connection *, ExpireAction>> claimed;
+  };
+
+  /** io_service with its own acceptor, pool of connections bound to it
+   * and wheels of their deadlines. Shared io_service has a wheel per
+   * thread, and its connections are spread between them.
+   */
+  struct Worker {
+    Worker(IPServer *server, std::size_t index, std::size_t wheels_number) :
+      acceptor(io_service),
+        accept_timer(io_service),
+        pool([server, this, index]() {
+               ConnectionPointer connection(new Connection(io_service, server));
+               connection->worker_ = index;
+               return connection;
+             }) {
+      for (std::size_t i = 0; i < wheels_number; ++i) {
+        timeouts.emplace_back(new Timeouts(io_service));
+      }
+    }
+
+    boost::asio::io_service io_service;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    typename Protocol::acceptor acceptor;
+    boost::asio::steady_timer accept_timer; ///< Restarts accepts after back-off
+    std::mutex accept_mutex;
+    std::size_t deferred_accepts = 0; ///< Guarded by accept_mutex
+    std::chrono::milliseconds accept_backoff{0}; ///< Guarded by accept_mutex
+    std::vector<std::unique_ptr<Timeouts>> timeouts;
+    std::atomic<std::size_t> next_wheel{0}; ///< Wheel of next accepted connection
+    Pool pool;
+  };
+
+  inline bool timeouts_enabled() const noexcept {
+    return handshake_timeout_.count() > 0 || idle_timeout_.count() > 0 ||
+      heartbeat_interval_.count() > 0;
+  }
+
+  inline TimeoutWheel &timeouts(std::size_t worker, std::size_t wheel) noexcept {
+    return workers_[worker]->timeouts[wheel]->wheel;
+  }
+
+  /** Schedules next turn of timeouts wheel; timer_mutex should be locked */
+  void ScheduleTimeouts(Timeouts &timeouts) {
+    timeouts.timer.expires_from_now(timeouts.wheel.resolution());
+    timeouts.timer.async_wait([this, &timeouts](const boost::system::error_code &error) {
+                                if (error) return;
+                                HandleTimeouts(timeouts);
+                                std::lock_guard<std::mutex> lock(timeouts.timer_mutex);
+                                if (timeouts.ticking) {
+                                  ScheduleTimeouts(timeouts);
+                                }
+                              });
+  }
+
+  /** Stops timeouts wheel so that its io_service can run out of work */
+  void StopTimeouts(Timeouts &timeouts) noexcept {
+    std::lock_guard<std::mutex> lock(timeouts.timer_mutex);
+    timeouts.ticking = false;
+    boost::system::error_code ec;
+    timeouts.timer.cancel(ec);
+  }
+
+  /** Expires connections whose deadlines have passed */
+  void HandleTimeouts(Timeouts &timeouts) {
+    std::vector<ConnectionId> &expired = timeouts.expired;
+    expired.clear();
+    timeouts.wheel.Advance(TimeoutWheel::Clock::now(), expired);
+    // Connections are only claimed under registry locks; heartbeats and
+    // disconnects run user code, so they are done after the locks are released
+    std::vector<std::pair<Connection *, ExpireAction>> &claimed = timeouts.claimed;
+    claimed.clear();
+    for (ConnectionId id : expired) {
+      connections_.With(id, [&claimed](Connection &connection) {
+                          ExpireAction action = connection.ClaimExpired();
+                          if (action != IPConnection<Connection, Protocol>::kExpireNothing) {
+                            claimed.emplace_back(&connection, action);
+                          }
+                        });
+    }
+    for (auto &item : claimed) {
+      item.first->Expire(item.second);
+    }
+  }
+
+  /** Opens, binds and starts listening on acceptor */
+  void OpenAcceptor(typename Protocol::acceptor &acceptor) {
+    acceptor.open(endpoint_.protocol());
+    acceptor.set_option(typename Protocol::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+    if (service_per_thread_) {
+      acceptor.set_option(ReusePort(true));
+    }
+#endif
+    acceptor.bind(endpoint_);
+    acceptor.listen();
+  }
+
+  /** Pins thread to core */
+  static void PinThread(std::thread &thread, int index) noexcept {
+#ifdef __linux__
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cores, &set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0) {
+      LogWarning("Cannot pin thread to CPU core");
+    }
+#endif
+  }
+
+  /** Takes IPConnection from pool and tries to receive next connection into it. */
+  void AcceptNext(Worker &worker) noexcept {
+    // if connection is never received, this object will destruct on its own
+    // together with the handler
+    std::shared_ptr<ConnectionPointer> pointer = std::make_shared<ConnectionPointer>(worker.pool.Acquire());
+    worker.acceptor.async_accept((*pointer)->socket(),
+                                 [this, &worker, pointer](const boost::system::error_code &error) {
+                                   HandleConnected(worker, std::move(*pointer), error);
+                                 });
+  }
+
+  /** What to do after failed accept */
+  enum AcceptErrorAction {
+    kStopAccepting, ///< Acceptor is closed
+    kRetry, ///< Only this connection is lost
+    kBackOff ///< Out of resources, retrying right away would only spin
+  };
+
+  static AcceptErrorAction ClassifyAcceptError(const boost::system::error_code &error) noexcept {
+    namespace error_ns = boost::asio::error;
+    if (error == error_ns::operation_aborted || error == error_ns::bad_descriptor) {
+      return kStopAccepting;
+    }
+    if (error == error_ns::connection_aborted || error == error_ns::connection_reset ||
+        error == error_ns::interrupted || error == error_ns::try_again ||
+        error == error_ns::would_block || error == error_ns::timed_out ||
+        error == error_ns::host_unreachable || error == error_ns::network_unreachable) {
+      return kRetry;
+    }
+    // EMFILE, ENFILE, ENOBUFS, ENOMEM and anything unknown
+    return kBackOff;
   }
 
   /** Called when connection is established */
-  void HandleConnected(ConnectionPointer &pointer, boost::system::error_code &&e) {
-    if (!e) {
-      // without errors? then push connection to list
-      connections_.Lock();
-      connections_->push_back(std::move(pointer));
-      pointer->HandleConnected();
-      connections_.Unlock();
-      // receive next connection
-      AcceptNext();
-    } else {
-      // TODO: should handle errors there
-      AssertMsg(false, e.message().c_str());
+  void HandleConnected(Worker &worker, ConnectionPointer &&pointer, const boost::system::error_code &error) {
+    if (error) {
+      worker.pool.Release(std::move(pointer));
+      HandleAcceptError(worker, error);
+      return;
+    }
+    // receive next connection before doing anything else
+    if (listening_) {
+      AcceptNext(worker);
     }
+    {
+      std::lock_guard<std::mutex> lock(worker.accept_mutex);
+      worker.accept_backoff = std::chrono::milliseconds(0);
+    }
+    if (!ReserveConnection()) {
+      // fast rejection: no registration, no user code
+      ++rejected_;
+      boost::system::error_code ec;
+      pointer->socket().close(ec);
+      worker.pool.Release(std::move(pointer));
+      return;
+    }
+    ++accepted_;
+    Connection *connection = pointer.get();
+    // Registry's reference; dropped by CloseConnection()
+    connection->operations_ = 1;
+    connection->wheel_ = worker.next_wheel++ % worker.timeouts.size();
+    connections_.Insert(std::move(pointer), [this](ConnectionId id, Connection &connection) {
+                          connection.id_ = id;
+                          connection.outbound_.set_watermarks(outbound_low_, outbound_high_);
+                          connection.StartTimeouts();
+                        });
+    // user code is called without any registry locks held
+    connection->HandleConnected();
   }
 
-  boost::asio::io_service io_service_;
-  std::unique_ptr<boost::asio::io_service::work> work_;
-  typename Protocol::acceptor acceptor_;
+  /** Takes a slot for accepted connection; false if limit is reached.
+   * Concurrent accepts on other workers cannot overshoot the limit.
+   */
+  bool ReserveConnection() noexcept {
+    std::size_t limit = max_connections_;
+    std::size_t reserved = reserved_;
+    do {
+      if (limit != 0 && reserved >= limit) return false;
+    } while (!reserved_.compare_exchange_weak(reserved, reserved + 1));
+    return true;
+  }
+
+  /** Restarts failed accept right away or after back-off delay */
+  void HandleAcceptError(Worker &worker, const boost::system::error_code &error) noexcept {
+    AcceptErrorAction action = ClassifyAcceptError(error);
+    if (action == kStopAccepting || !listening_) return;
+    ++accept_errors_;
+    if (action == kRetry) {
+      LogDebug("Accept failed, retrying: {}", error.message());
+      AcceptNext(worker);
+      return;
+    }
+    LogWarning("Accept failed, backing off: {}", error.message());
+    std::lock_guard<std::mutex> lock(worker.accept_mutex);
+    // one timer restarts all accepts failed meanwhile
+    if (worker.deferred_accepts++ != 0) return;
+    worker.accept_backoff = std::min(std::max(worker.accept_backoff * 2, kMinAcceptBackoff),
+                                     kMaxAcceptBackoff);
+    worker.accept_timer.expires_from_now(worker.accept_backoff);
+    worker.accept_timer.async_wait([this, &worker](const boost::system::error_code &error) {
+                                     if (error) return;
+                                     std::size_t deferred;
+                                     {
+                                       std::lock_guard<std::mutex> lock(worker.accept_mutex);
+                                       deferred = worker.deferred_accepts;
+                                       worker.deferred_accepts = 0;
+                                     }
+                                     if (!listening_) return;
+                                     for (std::size_t i = 0; i < deferred; ++i) {
+                                       AcceptNext(worker);
+                                     }
+                                   });
+  }
+
+  typename Protocol::endpoint endpoint_;
+  std::vector<std::unique_ptr<Worker>> workers_; ///< Should be destroyed after connections
   std::list<std::thread> threads_;
-  SharedLockWrapper<ConnectionList> connections_;
+  Registry connections_;
+  std::mutex dirty_mutex_;
+  std::vector<ConnectionId> dirty_; ///< Connections with unflushed messages
+  std::condition_variable drain_changed_; ///< Signalled under dirty_mutex_ while draining
+  std::atomic<bool> draining_{false};
+  std::atomic<std::size_t> drained_{0}; ///< Connections which closed themselves while draining
+  std::atomic<std::size_t> outbound_low_{0};
+  std::atomic<std::size_t> outbound_high_{0};
+  std::chrono::milliseconds handshake_timeout_{0};
+  std::chrono::milliseconds idle_timeout_{0};
+  std::chrono::milliseconds heartbeat_interval_{0};
   int threads_number_ = 2;
+  std::size_t accept_backlog_ = 4;
+  std::atomic<std::size_t> max_connections_{0};
+  std::atomic<std::size_t> reserved_{0}; ///< Registered connections and accepts being registered
+  std::atomic<std::size_t> accepted_{0};
+  std::atomic<std::size_t> rejected_{0};
+  std::atomic<std::size_t> accept_errors_{0};
+  std::size_t pool_warm_size_ = 0;
+  std::size_t pool_high_water_ = kDefaultPoolHighWater;
+  bool service_per_thread_ = false;
+  bool pin_threads_ = false;
   bool working_ = false;
+  std::atomic<bool> listening_{false};
 };
 
+template <class Connection, class Protocol>
+ const std::size_t IPServer<Connection, Protocol>::kDefaultPoolHighWater;
+
+template <class Connection, class Protocol>
+ const std::chrono::milliseconds IPServer<Connection, Protocol>::kDefaultDrainTimeout(1000);
+
+template <class Connection, class Protocol>
+ const std::chrono::milliseconds IPServer<Connection, Protocol>::kMinAcceptBackoff(10);
+
+template <class Connection, class Protocol>
+ const std::chrono::milliseconds IPServer<Connection, Protocol>::kMaxAcceptBackoff(1000);
+
+template <class Connection, class Protocol>
+ const std::uint32_t IPServer<Connection, Protocol>::kWarningsPerInterval;
+
+template <class Connection, class Protocol>
+ const std::chrono::milliseconds IPServer<Connection, Protocol>::kWarningInterval(1000);
+
 #endif // YOBAHACK_SERVER_IPSERVER_H_
@@ -0,0 +1,49 @@
+#include <new>
+#include "slabpool.h"
+
+void *SlabPool::Allocate(std::size_t size) {
+  std::size_t size_class = SizeClass(size);
+  if (size_class == kClasses) {
+    return ::operator new(size);
+  }
+  if (!free_[size_class]) {
+    Grow(size_class);
+  }
+  FreeBlock *block = free_[size_class];
+  free_[size_class] = block->next;
+  ++allocated_;
+  return block;
+}
+
+void SlabPool::Deallocate(void *pointer, std::size_t size) noexcept {
+  std::size_t size_class = SizeClass(size);
+  if (size_class == kClasses) {
+    ::operator delete(pointer);
+    return;
+  }
+  FreeBlock *block = static_cast<FreeBlock *>(pointer);
+  block->next = free_[size_class];
+  free_[size_class] = block;
+  --allocated_;
+}
+
+std::size_t SlabPool::SizeClass(std::size_t size) noexcept {
+  std::size_t size_class = 0;
+  while (size_class < kClasses && size > (std::size_t(1) << (kMinBlockBits + size_class))) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+void SlabPool::Grow(std::size_t size_class) {
+  std::size_t block_size = std::size_t(1) << (kMinBlockBits + size_class);
+  // new char[] gives us memory aligned for any fundamental type,
+  // and block sizes are multiples of that alignment
+  slabs_.emplace_back(new char[kSlabSize]);
+  char *slab = slabs_.back().get();
+  for (std::size_t offset = 0; offset + block_size <= kSlabSize; offset += block_size) {
+    FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + offset);
+    block->next = free_[size_class];
+    free_[size_class] = block;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef YOBAHACK_SERVER_SLABPOOL_H_
+#define YOBAHACK_SERVER_SLABPOOL_H_
+
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <memory>
+
+/** Pool of fixed-size blocks carved out of large slabs.
+ * Blocks are grouped in power-of-two size classes; freed blocks go to
+ * per-class free lists and are never returned to the system until pool
+ * is destroyed, so steady-state allocation does no malloc calls.
+ * Requests bigger than the largest class fall back to operator new.
+ * Not thread-safe.
+ */
+class SlabPool {
+ public:
+  SlabPool() = default;
+  SlabPool(const SlabPool &other) = delete;
+  SlabPool(const SlabPool &&other) = delete;
+
+  /** Returns memory block of at least given size, aligned as std::max_align_t */
+  void *Allocate(std::size_t size);
+
+  /** Returns block to pool; size must be the same as given to Allocate() */
+  void Deallocate(void *pointer, std::size_t size) noexcept;
+
+  /** Number of blocks currently handed out */
+  inline std::size_t allocated() const noexcept {
+    return allocated_;
+  }
+
+  /** Number of slabs requested from the system */
+  inline std::size_t slabs() const noexcept {
+    return slabs_.size();
+  }
+
+ private:
+  static const unsigned int kMinBlockBits = 6;
+  static const std::size_t kClasses = 4; ///< 64, 128, 256 and 512 bytes
+  static const std::size_t kSlabSize = 16384;
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  /** Returns size class for given size or kClasses if it is too big */
+  static std::size_t SizeClass(std::size_t size) noexcept;
+
+  /** Allocates new slab and splits it into blocks of given class */
+  void Grow(std::size_t size_class);
+
+  std::array<FreeBlock *, kClasses> free_ = {};
+  std::vector<std::unique_ptr<char[]>> slabs_;
+  std::size_t allocated_ = 0;
+};
+
+#endif // YOBAHACK_SERVER_SLABPOOL_H_
@@ -0,0 +1,185 @@
+#ifndef YOBAHACK_SERVER_SMALLFUNCTION_H_
+#define YOBAHACK_SERVER_SMALLFUNCTION_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include "server/slabpool.h"
+
+template <class Signature, std::size_t kInlineSize = 4 * sizeof(void *)>
+ class SmallFunction;
+
+/** Move-only replacement for std::function with inline storage.
+ * Callables which fit into kInlineSize bytes and are nothrow-movable
+ * are stored in place; bigger ones are put into given SlabPool (or onto
+ * heap if pool is not given), so typical small closures cost no allocations.
+ * Pool must outlive function object.
+ */
+template <class R, class... Args, std::size_t kInlineSize>
+ class SmallFunction<R(Args...), kInlineSize> {
+ public:
+  SmallFunction() noexcept = default;
+  SmallFunction(std::nullptr_t) noexcept { }
+
+  template <class F, class = typename std::enable_if<
+              !std::is_same<typename std::decay<F>::type, SmallFunction>::value>::type>
+   SmallFunction(F &&func, SlabPool *pool = nullptr) {
+    typedef typename std::decay<F>::type Functor;
+    Construct<Functor>(std::forward<F>(func), pool, std::integral_constant<bool, IsInline<Functor>()>());
+  }
+
+  SmallFunction(const SmallFunction &other) = delete;
+
+  SmallFunction(SmallFunction &&other) noexcept {
+    MoveFrom(other);
+  }
+
+  ~SmallFunction() {
+    Reset();
+  }
+
+  SmallFunction &operator =(SmallFunction &&other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  SmallFunction &operator =(std::nullptr_t) noexcept {
+    Reset();
+    return *this;
+  }
+
+  R operator ()(Args... args) const {
+    if (!ops_) throw std::bad_function_call();
+    return ops_->invoke(const_cast<Storage *>(&storage_), std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const noexcept {
+    return ops_ != nullptr;
+  }
+
+  /** Returns true if callable is stored in place */
+  inline bool is_inline() const noexcept {
+    return ops_ && ops_->is_inline;
+  }
+
+ private:
+  typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+  /** Type-erased operations on stored callable */
+  struct Ops {
+    R (*invoke)(Storage *storage, Args &&...args);
+    void (*move)(Storage *to, Storage *from) noexcept;
+    void (*destroy)(Storage *storage, SlabPool *pool) noexcept;
+    bool is_inline;
+  };
+
+  template <class Functor> static constexpr bool IsInline() {
+    return sizeof(Functor) <= kInlineSize && alignof(Functor) <= alignof(Storage)
+      && std::is_nothrow_move_constructible<Functor>::value;
+  }
+
+  template <class Functor> struct InlineOps {
+    static R Invoke(Storage *storage, Args &&...args) {
+      return (*reinterpret_cast<Functor *>(storage))(std::forward<Args>(args)...);
+    }
+
+    static void Move(Storage *to, Storage *from) noexcept {
+      Functor *source = reinterpret_cast<Functor *>(from);
+      new (to) Functor(std::move(*source));
+      source->~Functor();
+    }
+
+    static void Destroy(Storage *storage, SlabPool *) noexcept {
+      reinterpret_cast<Functor *>(storage)->~Functor();
+    }
+
+    static const Ops ops;
+  };
+
+  template <class Functor> struct PooledOps {
+    static Functor *&Pointer(Storage *storage) noexcept {
+      return *reinterpret_cast<Functor **>(storage);
+    }
+
+    static R Invoke(Storage *storage, Args &&...args) {
+      return (*Pointer(storage))(std::forward<Args>(args)...);
+    }
+
+    static void Move(Storage *to, Storage *from) noexcept {
+      Pointer(to) = Pointer(from);
+    }
+
+    static void Destroy(Storage *storage, SlabPool *pool) noexcept {
+      Functor *pointer = Pointer(storage);
+      pointer->~Functor();
+      if (pool) {
+        pool->Deallocate(pointer, sizeof(Functor));
+      } else {
+        ::operator delete(pointer);
+      }
+    }
+
+    static const Ops ops;
+  };
+
+  template <class Functor, class F> void Construct(F &&func, SlabPool *, std::true_type) {
+    new (&storage_) Functor(std::forward<F>(func));
+    ops_ = &InlineOps<Functor>::ops;
+  }
+
+  template <class Functor, class F> void Construct(F &&func, SlabPool *pool, std::false_type) {
+    static_assert(alignof(Functor) <= alignof(std::max_align_t), "Over-aligned callables are not supported");
+    void *memory = pool ? pool->Allocate(sizeof(Functor)) : ::operator new(sizeof(Functor));
+    try {
+      PooledOps<Functor>::Pointer(&storage_) = new (memory) Functor(std::forward<F>(func));
+    } catch (...) {
+      if (pool) {
+        pool->Deallocate(memory, sizeof(Functor));
+      } else {
+        ::operator delete(memory);
+      }
+      throw;
+    }
+    pool_ = pool;
+    ops_ = &PooledOps<Functor>::ops;
+  }
+
+  void MoveFrom(SmallFunction &other) noexcept {
+    if (other.ops_) {
+      other.ops_->move(&storage_, &other.storage_);
+      ops_ = other.ops_;
+      pool_ = other.pool_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  void Reset() noexcept {
+    if (ops_) {
+      ops_->destroy(&storage_, pool_);
+      ops_ = nullptr;
+    }
+  }
+
+  Storage storage_;
+  const Ops *ops_ = nullptr;
+  SlabPool *pool_ = nullptr;
+};
+
+template <class R, class... Args, std::size_t kInlineSize> template <class Functor>
+ const typename SmallFunction<R(Args...), kInlineSize>::Ops
+ SmallFunction<R(Args...), kInlineSize>::InlineOps<Functor>::ops = {
+  &InlineOps<Functor>::Invoke, &InlineOps<Functor>::Move, &InlineOps<Functor>::Destroy, true
+};
+
+template <class R, class... Args, std::size_t kInlineSize> template <class Functor>
+ const typename SmallFunction<R(Args...), kInlineSize>::Ops
+ SmallFunction<R(Args...), kInlineSize>::PooledOps<Functor>::ops = {
+  &PooledOps<Functor>::Invoke, &PooledOps<Functor>::Move, &PooledOps<Functor>::Destroy, false
+};
+
+#endif // YOBAHACK_SERVER_SMALLFUNCTION_H_
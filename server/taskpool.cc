@@ -0,0 +1,116 @@
+#include "taskpool.h"
+
+TaskPool::TaskPool(unsigned int threads_number) : pending_(0) {
+  if (threads_number == 0) {
+    threads_number = 1;
+  }
+  for (unsigned int i = 0; i < threads_number; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  for (unsigned int i = 1; i < threads_number; ++i) {
+    threads_.push_back(std::thread(&TaskPool::ThreadLoop, this, i));
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+void TaskPool::Run(std::size_t count, const Body &body) {
+  if (count == 0) return;
+  if (workers_.size() == 1 || count == 1) {
+    // Nothing to parallelize
+    for (std::size_t i = 0; i < count; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  // Body is published before tasks: a thread still spinning in Work() from
+  // previous Run() may take new task as soon as it is pushed
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    body_ = &body;
+    error_ = nullptr;
+    pending_ = count;
+    ++generation_;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    Worker &worker = *workers_[i % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(i);
+  }
+  wake_.notify_all();
+
+  Work(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]() { return pending_ == 0; });
+  body_ = nullptr;
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool TaskPool::Take(std::size_t worker, std::size_t &task) noexcept {
+  {
+    Worker &own = *workers_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < workers_.size(); ++i) {
+    Worker &victim = *workers_[(worker + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskPool::Work(std::size_t worker) noexcept {
+  std::size_t task;
+  while (Take(worker, task)) {
+    try {
+      (*body_)(task);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+    if (--pending_ == 0) {
+      // Lock is needed so that notification is not lost between check and wait in Run()
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_all();
+    }
+  }
+}
+
+void TaskPool::ThreadLoop(std::size_t worker) noexcept {
+  unsigned int generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, generation]() { return stopping_ || generation_ != generation; });
+      if (stopping_) return;
+      generation = generation_;
+    }
+    Work(worker);
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef YOBAHACK_SERVER_TASKPOOL_H_
+#define YOBAHACK_SERVER_TASKPOOL_H_
+
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+
+/** Fork-join thread pool with work stealing.
+ * Run() splits given number of tasks between per-thread deques; each thread
+ * takes work from the back of its own deque and, when it is empty, steals from
+ * the front of others. Calling thread takes part in the work too.
+ * Run() is not reentrant and should be called from one thread at a time.
+ */
+class TaskPool {
+ public:
+  typedef std::function<void(std::size_t)> Body;
+
+  /** Creates pool with given number of threads, including calling one */
+  explicit TaskPool(unsigned int threads_number);
+  TaskPool(const TaskPool &other) = delete;
+  TaskPool(const TaskPool &&other) = delete;
+  ~TaskPool();
+
+  /** Calls body(i) for every i in [0, count) and waits for all of them.
+   * If some call throws, first exception is rethrown after all tasks finish.
+   */
+  void Run(std::size_t count, const Body &body);
+
+  inline unsigned int threads_number() const noexcept {
+    return workers_.size();
+  }
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+  };
+
+  /** Takes task from own deque or steals one from others */
+  bool Take(std::size_t worker, std::size_t &task) noexcept;
+
+  /** Executes tasks until none are left */
+  void Work(std::size_t worker) noexcept;
+
+  void ThreadLoop(std::size_t worker) noexcept;
+
+  std::vector<std::unique_ptr<Worker>> workers_; ///< workers_[0] belongs to calling thread
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const Body *body_ = nullptr;
+  std::atomic<std::size_t> pending_;
+  std::exception_ptr error_;
+  unsigned int generation_ = 0;
+  bool stopping_ = false;
+};
+
+#endif // YOBAHACK_SERVER_TASKPOOL_H_
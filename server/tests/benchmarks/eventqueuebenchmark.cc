@@ -0,0 +1,42 @@
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "server/eventqueue.h"
+
+TEST(EventQueueBenchmark, PushBatch) {
+  const int kEvents = 100000;
+  const int kRounds = 10;
+  int fired = 0;
+  auto make_batch = [&fired]() {
+    std::vector<std::pair<EventQueue::Function, unsigned int>> batch;
+    batch.reserve(kEvents);
+    for (int i = 0; i < kEvents; ++i) {
+      // Задержки по всем уровням колеса вперемешку
+      batch.emplace_back([&fired]() { ++fired; }, (i * 7919) % 100000);
+    }
+    return batch;
+  };
+  std::chrono::steady_clock::duration pushed(0), batched(0);
+  for (int round = 0; round < kRounds; ++round) {
+    auto batch = make_batch();
+    EventQueue queue;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &event : batch) {
+      queue.Push(std::move(event.first), event.second);
+    }
+    pushed += std::chrono::steady_clock::now() - start;
+
+    batch = make_batch();
+    EventQueue batch_queue;
+    start = std::chrono::steady_clock::now();
+    batch_queue.PushBatch(batch.begin(), batch.end());
+    batched += std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(batch_queue.size(), queue.size());
+  }
+  std::cout << "Push(): " << std::chrono::duration_cast<std::chrono::nanoseconds>(pushed).count() / kEvents / kRounds
+            << " ns, PushBatch(): "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(batched).count() / kEvents / kRounds
+            << " ns per event" << std::endl;
+}
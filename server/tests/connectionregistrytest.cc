@@ -0,0 +1,53 @@
+#include <set>
+#include <vector>
+#include <thread>
+#include "connectionregistrytest.h"
+
+using namespace std;
+
+TEST_F(ConnectionRegistryTest, InsertRemove) {
+  vector<TestedRegistry::Id> ids;
+  for (int i = 0; i < 10; ++i) {
+    ids.push_back(registry_.Insert(TestedRegistry::Pointer(new TestedConnection(i))));
+  }
+  ASSERT_EQ(registry_.size(), 10u);
+  ASSERT_EQ(set<TestedRegistry::Id>(ids.begin(), ids.end()).size(), ids.size());
+
+  int value = -1;
+  ASSERT_TRUE(registry_.With(ids[3], [&value](TestedConnection &c) { value = c.value; }));
+  ASSERT_EQ(value, 3);
+
+  TestedRegistry::Pointer removed = registry_.Remove(ids[3]);
+  ASSERT_TRUE(removed);
+  ASSERT_EQ(removed->value, 3);
+  ASSERT_FALSE(registry_.Remove(ids[3]));
+  ASSERT_EQ(registry_.size(), 9u);
+
+  // Slot is reused, but old id stays dead
+  TestedRegistry::Id id = registry_.Insert(TestedRegistry::Pointer(new TestedConnection(42)));
+  ASSERT_NE(id, ids[3]);
+  ASSERT_FALSE(registry_.With(ids[3], [](TestedConnection &) { }));
+
+  int sum = 0;
+  registry_.ForEach([&sum](TestedRegistry::Id, TestedConnection &c) { sum += c.value; });
+  ASSERT_EQ(sum, 45 - 3 + 42);
+}
+
+TEST_F(ConnectionRegistryTest, Concurrent) {
+  const int kThreads = 4;
+  const int kIterations = 10000;
+  vector<thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.push_back(thread([this, kIterations]() {
+                               for (int i = 0; i < kIterations; ++i) {
+                                 TestedRegistry::Id id =
+                                   registry_.Insert(TestedRegistry::Pointer(new TestedConnection(i)));
+                                 ASSERT_TRUE(registry_.Remove(id));
+                               }
+                             }));
+  }
+  for (thread &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(registry_.size(), 0u);
+}
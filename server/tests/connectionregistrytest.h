@@ -0,0 +1,21 @@
+#ifndef YOBAHACK_TESTS_CONNECTIONREGISTRYTEST_H_
+#define YOBAHACK_TESTS_CONNECTIONREGISTRYTEST_H_
+
+#include <gtest/gtest.h>
+#include "server/connectionregistry.h"
+
+struct TestedConnection {
+  explicit TestedConnection(int value) : value(value) { }
+
+  int value;
+};
+
+class ConnectionRegistryTest : public testing::Test {
+ public:
+  typedef ConnectionRegistry<TestedConnection, 4> TestedRegistry;
+
+ protected:
+  TestedRegistry registry_;
+};
+
+#endif // YOBAHACK_TESTS_CONNECTIONREGISTRYTEST_H_
@@ -6,7 +6,225 @@ void FlagSet(bool &flag) {
 
 TEST_F(EventQueueTest, FirstTickTest) {
   bool flag = false;
-  eq_.Push(std::bind(&FlagSet, flag), 0);
+  eq_.Push(std::bind(&FlagSet, std::ref(flag)), 0);
   eq_.Tick();
   ASSERT_TRUE(flag);
 }
+
+TEST_F(EventQueueTest, DelayTest) {
+  // Задержки по разные стороны границ уровней колеса
+  const unsigned int delays[] = { 1, 255, 256, 257, 65535, 65536, 100000 };
+  int fired = 0;
+  for (unsigned int delay : delays) {
+    EventQueue::TickType expected = eq_.tick() + delay;
+    eq_.Push([this, expected, &fired]() {
+               EXPECT_EQ(eq_.tick(), expected);
+               ++fired;
+             }, delay);
+  }
+  ASSERT_EQ(eq_.size(), sizeof(delays) / sizeof(delays[0]));
+  while (!eq_.empty()) {
+    eq_.Tick();
+  }
+  ASSERT_EQ(fired, int(sizeof(delays) / sizeof(delays[0])));
+}
+
+TEST_F(EventQueueTest, PushFromEventTest) {
+  int fired = 0;
+  eq_.Push([this, &fired]() {
+             eq_.Push([&fired]() { ++fired; }, 0);
+           }, 3);
+  for (int i = 0; i < 4; ++i) {
+    eq_.Tick();
+  }
+  ASSERT_EQ(fired, 1);
+  ASSERT_TRUE(eq_.empty());
+}
+
+TEST_F(EventQueueTest, CancelTest) {
+  bool flag = false;
+  EventQueue::Handle handle = eq_.Push(std::bind(&FlagSet, std::ref(flag)), 1000);
+  ASSERT_TRUE(handle.pending());
+  ASSERT_TRUE(handle.Cancel());
+  ASSERT_FALSE(handle.pending());
+  ASSERT_FALSE(handle.Cancel());
+  ASSERT_EQ(eq_.size(), 0u);
+  ASSERT_EQ(eq_.tombstones(), 1u);
+  for (int i = 0; i < 1001; ++i) {
+    eq_.Tick();
+  }
+  ASSERT_FALSE(flag);
+  ASSERT_EQ(eq_.tombstones(), 0u);
+}
+
+TEST_F(EventQueueTest, RescheduleTest) {
+  EventQueue::TickType fired_at = 0;
+  EventQueue::Handle handle = eq_.Push([this, &fired_at]() { fired_at = eq_.tick(); }, 10);
+  ASSERT_TRUE(handle.Reschedule(300));
+  ASSERT_EQ(eq_.size(), 1u);
+  ASSERT_EQ(eq_.tombstones(), 1u);
+  while (!eq_.empty()) {
+    eq_.Tick();
+  }
+  ASSERT_EQ(fired_at, 300u);
+  ASSERT_FALSE(handle.pending());
+  ASSERT_FALSE(handle.Reschedule(1));
+}
+
+TEST_F(EventQueueTest, LargeClosureTest) {
+  // Не помещается во встроенный буфер и уходит в пул
+  std::array<int, 64> payload;
+  payload.fill(1);
+  int sum = 0;
+  auto closure = [payload, &sum]() {
+    for (int value : payload) sum += value;
+  };
+  eq_.Push(closure, 1);
+  ASSERT_EQ(eq_.pool().allocated(), 1u);
+  ASSERT_EQ(eq_.pool().slabs(), 1u);
+  eq_.Tick();
+  eq_.Tick();
+  ASSERT_EQ(sum, 64);
+  ASSERT_EQ(eq_.pool().allocated(), 0u);
+  // Освобожденный блок берется снова, новых слябов не нужно
+  eq_.Push(closure, 0);
+  ASSERT_EQ(eq_.pool().allocated(), 1u);
+  eq_.Tick();
+  ASSERT_EQ(sum, 128);
+  ASSERT_EQ(eq_.pool().allocated(), 0u);
+  ASSERT_EQ(eq_.pool().slabs(), 1u);
+}
+
+TEST_F(EventQueueTest, SameTickOrderTest) {
+  // Первое событие лежит на первом уровне и спускается на нулевой позже,
+  // чем туда попадает второе, но выполниться должно раньше
+  std::vector<int> order;
+  eq_.Push([&order]() { order.push_back(1); }, 300);
+  for (int i = 0; i < 100; ++i) {
+    eq_.Tick();
+  }
+  eq_.Push([&order]() { order.push_back(2); }, 200);
+  eq_.Push([&order]() { order.push_back(3); }, 200);
+  while (!eq_.empty()) {
+    eq_.Tick();
+  }
+  ASSERT_EQ(order, std::vector<int>({1, 2, 3}));
+}
+
+TEST_F(EventQueueTest, MoveOnlyClosureTest) {
+  std::unique_ptr<int> value(new int(42));
+  int result = 0;
+  eq_.Push(std::bind([&result](std::unique_ptr<int> &v) { result = *v; }, std::move(value)), 0);
+  eq_.Tick();
+  ASSERT_EQ(result, 42);
+}
+
+TEST_F(EventQueueTest, AffinityTest) {
+  const int kLanes = 8;
+  const int kEvents = 1000;
+  eq_.set_threads_number(4);
+  // В пределах одного ключа порядок должен сохраняться
+  std::vector<std::vector<int>> order(kLanes);
+  std::atomic<int> fired(0);
+  for (int i = 0; i < kEvents; ++i) {
+    int lane = i % kLanes;
+    eq_.Push([&order, &fired, lane, i]() {
+               order[lane].push_back(i);
+               ++fired;
+             }, 1, lane + 1);
+  }
+  // События, добавленные из параллельных событий, выполняются на том же шаге
+  eq_.Push([this, &fired]() {
+             eq_.Push([&fired]() { ++fired; }, 0, 2);
+           }, 1, 1);
+  eq_.Tick();
+  eq_.Tick();
+  ASSERT_EQ(fired, kEvents + 1);
+  for (int lane = 0; lane < kLanes; ++lane) {
+    ASSERT_EQ(order[lane].size(), std::size_t(kEvents / kLanes));
+    for (std::size_t i = 1; i < order[lane].size(); ++i) {
+      ASSERT_LT(order[lane][i - 1], order[lane][i]);
+    }
+  }
+  ASSERT_TRUE(eq_.empty());
+}
+
+TEST_F(EventQueueTest, ParallelCancelTest) {
+  eq_.set_threads_number(4);
+  // Отмена события того же шага срабатывает, как и в одном потоке
+  bool same = false, other = false, unbound = false;
+  EventQueue::Handle same_handle, other_handle, unbound_handle;
+  std::atomic<int> cancelled(0);
+  eq_.Push([&]() {
+             cancelled += same_handle.Cancel();
+             cancelled += unbound_handle.Cancel();
+           }, 1, 1);
+  same_handle = eq_.Push(std::bind(&FlagSet, std::ref(same)), 1, 1);
+  unbound_handle = eq_.Push(std::bind(&FlagSet, std::ref(unbound)), 1);
+  // Из другой дорожки отмена гонится с выполнением, но удавшаяся отмена
+  // означает, что событие не выполнится
+  eq_.Push([&]() {
+             cancelled += other_handle.Cancel();
+           }, 1, 2);
+  other_handle = eq_.Push(std::bind(&FlagSet, std::ref(other)), 1, 3);
+  eq_.Tick();
+  eq_.Tick();
+  ASSERT_FALSE(same);
+  ASSERT_FALSE(unbound);
+  ASSERT_EQ(cancelled, 3 - other);
+  ASSERT_TRUE(eq_.empty());
+  ASSERT_EQ(eq_.tombstones(), 0u);
+}
+
+TEST_F(EventQueueTest, PushBatchTest) {
+  int fired = 0;
+  std::vector<std::pair<std::function<void()>, unsigned int>> batch;
+  for (unsigned int i = 0; i < 100; ++i) {
+    batch.emplace_back([&fired]() { ++fired; }, i * 7);
+  }
+  std::vector<EventQueue::Handle> handles;
+  eq_.PushBatch(batch.begin(), batch.end(), EventQueue::kNoAffinity, &handles);
+  ASSERT_EQ(handles.size(), batch.size());
+  ASSERT_EQ(eq_.size(), batch.size());
+  ASSERT_TRUE(handles[50].Cancel());
+  while (!eq_.empty()) {
+    eq_.Tick();
+  }
+  ASSERT_EQ(fired, 99);
+}
+
+TEST_F(EventQueueTest, JournalReplayTest) {
+  const char *kPath = "eventqueuetest.journal";
+  const std::uint32_t kType = 7;
+  EventJournal journal;
+  journal.Open(kPath);
+  eq_.set_journal(&journal);
+  for (std::uint32_t i = 0; i < 10; ++i) {
+    eq_.Push([]() { }, i, EventQueue::Tag(kType, i + 1, &i, sizeof(i)));
+  }
+  eq_.Push([]() { }, 5).Cancel();
+  while (!eq_.empty()) {
+    eq_.Tick();
+  }
+  eq_.set_journal(nullptr);
+  journal.Close();
+  ASSERT_EQ(journal.dropped(), 0u);
+  ASSERT_EQ(journal.written(), 22u);
+
+  EventReplay replay;
+  replay.Load(kPath);
+  std::uint32_t sum = 0;
+  replay.Register(kType, [&sum](const EventRecord &record) -> EventQueue::Function {
+                    std::uint32_t value;
+                    std::memcpy(&value, record.payload, sizeof(value));
+                    return [&sum, value]() { sum += value; };
+                  });
+  EventQueue queue;
+  EventReplay::Stats stats = replay.Run(queue);
+  ASSERT_EQ(stats.scheduled, 11u);
+  ASSERT_EQ(stats.fired, 10u);
+  ASSERT_EQ(stats.cancelled, 1u);
+  ASSERT_EQ(stats.unknown, 1u);
+  ASSERT_EQ(sum, 45u);
+  std::remove(kPath);
+}
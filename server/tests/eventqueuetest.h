@@ -1,8 +1,15 @@
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <memory>
 #include <functional>
 #include <gtest/gtest.h>
-#include <boost/heap/priority_queue.hpp>
 #include "../server/eventqueue.h"
+#include "../server/eventreplay.h"
 
 class EventQueueTest : public ::testing::Test {
   protected:
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+#include "common/hex.h"
+#include "interestgridtest.h"
+
+using namespace std;
+
+const int InterestGridTest::kRows;
+const int InterestGridTest::kCols;
+
+void InterestGridTest::Check(int row, int col) {
+  vector<InterestGrid::Id> found, expected;
+  grid_.Collect(row, col, found);
+  for (const Position &position : positions_) {
+    if (HexDistance(position.row, position.col, row, col) <= position.radius) {
+      expected.push_back(position.id);
+    }
+  }
+  sort(found.begin(), found.end());
+  ASSERT_EQ(found, expected) << "cell " << row << ", " << col;
+}
+
+TEST_F(InterestGridTest, Distance) {
+  // Breadth-first search over empty field, as calc_distance() does
+  const int kSize = 20;
+  for (int start = 0; start < 4; ++start) {
+    int row = 7 + start / 2, col = 9 + start % 2;
+    vector<int> distance(kSize * kSize, numeric_limits<int>::max());
+    queue<pair<int, int>> cells;
+    cells.emplace(row, col);
+    distance[row * kSize + col] = 0;
+    vector<pair<int, int>> neighbours;
+    while (!cells.empty()) {
+      pair<int, int> cell = cells.front();
+      cells.pop();
+      neighbours.clear();
+      HexNeighbours(kSize, kSize, cell.first, cell.second, neighbours);
+      for (const pair<int, int> &next : neighbours) {
+        int &value = distance[next.first * kSize + next.second];
+        if (value == numeric_limits<int>::max()) {
+          value = distance[cell.first * kSize + cell.second] + 1;
+          cells.push(next);
+        }
+      }
+    }
+    for (int r = 0; r < kSize; ++r) {
+      for (int c = 0; c < kSize; ++c) {
+        ASSERT_EQ(HexDistance(row, col, r, c), distance[r * kSize + c]) << r << ", " << c;
+      }
+    }
+  }
+}
+
+TEST_F(InterestGridTest, Collect) {
+  for (InterestGrid::Id id = 1; id <= 200; ++id) {
+    Position position{id, static_cast<int>(random_() % kRows), static_cast<int>(random_() % kCols),
+                      static_cast<int>(3 + random_() % 10)};
+    positions_.push_back(position);
+    grid_.Subscribe(id, position.row, position.col, position.radius);
+  }
+  // Players wander around, some leave and come back
+  for (int step = 0; step < 50; ++step) {
+    for (Position &position : positions_) {
+      position.row = max(0, min(kRows - 1, position.row + static_cast<int>(random_() % 3) - 1));
+      position.col = max(0, min(kCols - 1, position.col + static_cast<int>(random_() % 3) - 1));
+      grid_.Move(position.id, position.row, position.col);
+    }
+    Position &changed = positions_[random_() % positions_.size()];
+    grid_.Unsubscribe(changed.id);
+    changed.radius = 1 + random_() % 5;
+    grid_.Subscribe(changed.id, changed.row, changed.col, changed.radius);
+    for (int i = 0; i < 20; ++i) {
+      Check(random_() % kRows, random_() % kCols);
+    }
+  }
+  ASSERT_EQ(grid_.size(), positions_.size());
+  const Position &first = positions_.front();
+  ASSERT_TRUE(grid_.Contains(first.id, first.row, first.col));
+  grid_.Unsubscribe(first.id);
+  positions_.erase(positions_.begin());
+  Check(first.row, first.col);
+}
+
+TEST_F(InterestGridTest, Incremental) {
+  grid_.Subscribe(1, 50, 50, 10);
+  // Area spans 3 x 3 buckets
+  size_t updates = grid_.bucket_updates();
+  ASSERT_EQ(updates, 9u);
+  // Moving within buckets changes nothing
+  grid_.Move(1, 50, 51);
+  ASSERT_EQ(grid_.bucket_updates(), updates);
+  // Crossing bucket borders adds a column of buckets, then drops one
+  grid_.Move(1, 50, 54);
+  ASSERT_EQ(grid_.bucket_updates(), updates + 3);
+  grid_.Move(1, 50, 58);
+  ASSERT_EQ(grid_.bucket_updates(), updates + 6);
+  positions_.push_back(Position{1, 50, 58, 10});
+  for (int col = 40; col < 70; ++col) {
+    Check(50, col);
+  }
+  MulticastRecorder server;
+  grid_.Route(server, 45, 60, OutboundMessage());
+  grid_.Route(server, 45, 70, OutboundMessage());
+  grid_.Route(server, 50, 47, OutboundMessage());
+  ASSERT_EQ(server.received, vector<InterestGrid::Id>({1}));
+}
@@ -0,0 +1,41 @@
+#ifndef YOBAHACK_TESTS_INTERESTGRIDTEST_H_
+#define YOBAHACK_TESTS_INTERESTGRIDTEST_H_
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "server/interestgrid.h"
+
+class InterestGridTest : public testing::Test {
+ public:
+  static const int kRows = 100;
+  static const int kCols = 120;
+
+  InterestGridTest() : grid_(kRows, kCols, 8), random_(7) { }
+
+ protected:
+  /** Checks that grid finds same subscribers as brute force */
+  void Check(int row, int col);
+
+  struct Position {
+    InterestGrid::Id id;
+    int row;
+    int col;
+    int radius;
+  };
+
+  InterestGrid grid_;
+  std::vector<Position> positions_;
+  std::mt19937 random_;
+};
+
+/** Records messages queued through Multicast() */
+struct MulticastRecorder {
+  template <class Ids> void Multicast(const OutboundMessage &message, const Ids &ids, bool coalescable) {
+    received.insert(received.end(), ids.begin(), ids.end());
+  }
+
+  std::vector<InterestGrid::Id> received;
+};
+
+#endif // YOBAHACK_TESTS_INTERESTGRIDTEST_H_
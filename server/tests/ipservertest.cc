@@ -1,7 +1,12 @@
+#include <set>
 #include <string>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 #include "ipservertest.h"
 
@@ -9,21 +14,42 @@ using namespace std;
 using namespace std::chrono;
 
 void TestedIPConnection::HandleConnected() noexcept {
-  ReadSome(boost::asio::buffer(buffer_), std::bind(&TestedIPConnection::HandleRead, this));
+  ReadSome(boost::asio::buffer(buffer_), std::bind(&TestedIPConnection::HandleRead, this, placeholders::_1, placeholders::_2));
 }
 
+std::function<void(TestedIPConnection &)> TestedIPConnection::on_disconnect;
+
 void TestedIPConnection::PrepareDisconnect() noexcept {
+  if (on_disconnect) on_disconnect(*this);
+}
+
+std::function<void()> TestedIPConnection::on_read_error;
+
+std::atomic<int> TestedIPConnection::resets(0);
+
+void TestedIPConnection::Reset() noexcept {
+  stop_ = false;
+  ++resets;
 }
 
 void TestedIPConnection::HandleRead(const boost::system::error_code &error, std::size_t bytes_transferred) noexcept {
+  if (error) {
+    if (on_read_error) on_read_error();
+    Free();
+    return;
+  }
   if (buffer_[bytes_transferred - 1] == '\n') stop_ = true;
   Write(boost::asio::buffer(buffer_, bytes_transferred),
-                     std::bind(&TestedIPConnection::HandleWrite, this));
+                     std::bind(&TestedIPConnection::HandleWrite, this, placeholders::_1, placeholders::_2));
 }
 
 void TestedIPConnection::HandleWrite(const boost::system::error_code &error, std::size_t bytes_transferred) noexcept {
+  if (error) {
+    Free();
+    return;
+  }
   if (stop_) Disconnect();
-  else ReadSome(boost::asio::buffer(buffer_), std::bind(&TestedIPConnection::HandleRead, this));
+  else ReadSome(boost::asio::buffer(buffer_), std::bind(&TestedIPConnection::HandleRead, this, placeholders::_1, placeholders::_2));
 }
 
 TEST_F(IPServerTest, OneConnection) {
@@ -33,8 +59,9 @@ TEST_F(IPServerTest, OneConnection) {
   string str = "TEST";
   float timeout = 0.1;
   server_.StartListening();
-  ASSERT_EQ(boost::asio::connect(socket, endpoint), endpoint);
   boost::system::error_code error;
+  socket.connect(endpoint, error);
+  ASSERT_FALSE(error);
   boost::asio::write(socket, boost::asio::buffer(str), error);
   ASSERT_FALSE(error);
   
@@ -46,11 +73,10 @@ TEST_F(IPServerTest, OneConnection) {
     duration<float> time_span = duration_cast<duration<float>>(cur_p - start_p);
     EXPECT_LT(time_span.count(), timeout);
     ASSERT_LT(time_span.count(), timeout * 10);
-    string curr;
-    curr.reserve(curr.size());
-    socket.read_some(boost::asio::buffer(curr), error);
+    array<char, 64> curr;
+    size_t bytes = socket.read_some(boost::asio::buffer(curr), error);
     ASSERT_FALSE(error);
-    buff += curr;
+    buff.append(curr.data(), bytes);
   }
   ASSERT_EQ(buff, str);
   boost::asio::write(socket, boost::asio::buffer("\n", 1), error);
@@ -66,3 +92,369 @@ TEST_F(IPServerTest, OneConnection) {
   ASSERT_EQ(error, boost::asio::error::eof);
 }
 
+
+TEST_F(IPServerTest, MaxConnections) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.set_max_connections(1);
+  server_.StartListening();
+
+  GameProtocol::socket first(io_service);
+  boost::system::error_code error;
+  first.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  // Wait for echo, so that connection is surely registered
+  boost::asio::write(first, boost::asio::buffer("A", 1), error);
+  ASSERT_FALSE(error);
+  array<char, 1> echo;
+  boost::asio::read(first, boost::asio::buffer(echo), error);
+  ASSERT_FALSE(error);
+
+  // Second one is closed right after accept
+  GameProtocol::socket second(io_service);
+  second.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  second.read_some(boost::asio::buffer(echo), error);
+  ASSERT_TRUE(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+  ASSERT_EQ(server_.accepted(), 1u);
+  ASSERT_EQ(server_.rejected(), 1u);
+  ASSERT_EQ(server_.connections().size(), 1u);
+
+  IPServerTest::TestedIPServer::DrainStats stats = server_.StopService(milliseconds(100));
+  ASSERT_EQ(stats.drained + stats.forced, 1u);
+  ASSERT_FALSE(server_.working());
+}
+
+TEST_F(IPServerTest, MaxConnectionsStorm) {
+  const size_t kLimit = 4;
+  const size_t kClients = 64;
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.set_threads_number(4);
+  server_.set_max_connections(kLimit);
+  server_.StartListening();
+
+  // Connects without waiting, so that accepts on all threads race for the last slots
+  vector<unique_ptr<GameProtocol::socket>> clients;
+  for (size_t i = 0; i < kClients; ++i) {
+    clients.emplace_back(new GameProtocol::socket(io_service));
+    boost::system::error_code error;
+    clients.back()->connect(endpoint, error);
+    ASSERT_FALSE(error);
+  }
+  steady_clock::time_point deadline = steady_clock::now() + seconds(5);
+  while (server_.accepted() + server_.rejected() < kClients) {
+    ASSERT_LT(steady_clock::now(), deadline);
+    this_thread::sleep_for(milliseconds(1));
+  }
+  ASSERT_EQ(server_.accepted(), kLimit);
+  ASSERT_EQ(server_.rejected(), kClients - kLimit);
+  ASSERT_EQ(server_.connections().size(), kLimit);
+
+  clients.clear();
+  server_.StopService(milliseconds(100));
+  ASSERT_EQ(server_.connections().size(), 0u);
+}
+
+TEST_F(IPServerTest, PoolReuse) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.StartListening();
+  int resets = TestedIPConnection::resets;
+  boost::system::error_code error;
+  array<char, 1> echo;
+  {
+    GameProtocol::socket socket(io_service);
+    socket.connect(endpoint, error);
+    ASSERT_FALSE(error);
+    boost::asio::write(socket, boost::asio::buffer("A", 1), error);
+    ASSERT_FALSE(error);
+    boost::asio::read(socket, boost::asio::buffer(echo), error);
+    ASSERT_FALSE(error);
+  }
+  // Closed connection is reset and put back into pool
+  steady_clock::time_point deadline = steady_clock::now() + seconds(1);
+  while (server_.connection_pool().idle() == 0) {
+    ASSERT_LT(steady_clock::now(), deadline);
+    this_thread::sleep_for(milliseconds(1));
+  }
+  ASSERT_EQ(TestedIPConnection::resets, resets + 1);
+  ASSERT_EQ(server_.connections().size(), 0u);
+
+  // Next accept takes it instead of making a new one
+  size_t created = server_.connection_pool().created();
+  GameProtocol::socket socket(io_service);
+  socket.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  boost::asio::write(socket, boost::asio::buffer("B", 1), error);
+  ASSERT_FALSE(error);
+  boost::asio::read(socket, boost::asio::buffer(echo), error);
+  ASSERT_FALSE(error);
+  ASSERT_EQ(echo[0], 'B');
+  ASSERT_EQ(server_.connection_pool().reused(), 1u);
+  ASSERT_EQ(server_.connection_pool().created(), created);
+  server_.StopService(milliseconds(100));
+}
+
+TEST_F(IPServerTest, PoolAfterHandlers) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.StartListening();
+  // Aborted read is still being handled while connection is taken off the registry
+  atomic<bool> handled(false);
+  atomic<size_t> idle_in_handler(1);
+  TestedIPConnection::on_read_error = [this, &handled, &idle_in_handler]() {
+    steady_clock::time_point deadline = steady_clock::now() + seconds(1);
+    while (server_.connections().size() != 0 && steady_clock::now() < deadline) {
+      this_thread::sleep_for(milliseconds(1));
+    }
+    this_thread::sleep_for(milliseconds(10));
+    idle_in_handler = server_.connection_pool().idle();
+    handled = true;
+  };
+  GameProtocol::socket socket(io_service);
+  boost::system::error_code error;
+  socket.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  array<char, 1> echo;
+  boost::asio::write(socket, boost::asio::buffer("A", 1), error);
+  ASSERT_FALSE(error);
+  boost::asio::read(socket, boost::asio::buffer(echo), error);
+  ASSERT_FALSE(error);
+
+  server_.DisconnectAll();
+  steady_clock::time_point deadline = steady_clock::now() + seconds(2);
+  while (!handled || server_.connection_pool().idle() == 0) {
+    ASSERT_LT(steady_clock::now(), deadline);
+    this_thread::sleep_for(milliseconds(1));
+  }
+  // Pooled only after the handler has returned
+  ASSERT_EQ(idle_in_handler, 0u);
+  server_.StopService(milliseconds(100));
+}
+
+TEST_F(IPServerTest, SlowClientEviction) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.set_outbound_watermarks(0, 1000);
+  server_.StartListening();
+  GameProtocol::socket first(io_service), second(io_service);
+  boost::system::error_code error;
+  for (GameProtocol::socket *socket : { &first, &second }) {
+    socket->connect(endpoint, error);
+    ASSERT_FALSE(error);
+    array<char, 1> echo;
+    boost::asio::write(*socket, boost::asio::buffer("A", 1), error);
+    ASSERT_FALSE(error);
+    boost::asio::read(*socket, boost::asio::buffer(echo), error);
+    ASSERT_FALSE(error);
+  }
+  vector<TestedIPServer::ConnectionId> ids;
+  server_.connections().ForEach([&ids](TestedIPServer::ConnectionId id, TestedIPConnection &) {
+                                  ids.push_back(id);
+                                });
+  ASSERT_EQ(ids.size(), 2u);
+  // User code of evicted connection runs outside of registry locks, so it
+  // may change registry; removing unknown id of the same shard takes the
+  // lock which Broadcast() and Multicast() hold while they visit it
+  atomic<int> evicted(0);
+  TestedIPConnection::on_disconnect = [&evicted](TestedIPConnection &connection) {
+    connection.server()->connections().Remove(connection.id() & 0xffffffffu);
+    ++evicted;
+  };
+  // Nothing is flushed, so the second message overflows high watermark
+  OutboundMessage message = MakeFrame(string(600, 'x').data(), 600);
+  server_.Multicast(message, vector<TestedIPServer::ConnectionId>({ ids[0] }));
+  server_.Multicast(message, vector<TestedIPServer::ConnectionId>({ ids[0] }));
+  ASSERT_EQ(evicted, 1);
+  server_.Broadcast(message);
+  server_.Broadcast(message);
+  ASSERT_EQ(evicted, 2);
+
+  steady_clock::time_point deadline = steady_clock::now() + seconds(1);
+  while (server_.connections().size() != 0) {
+    ASSERT_LT(steady_clock::now(), deadline);
+    this_thread::sleep_for(milliseconds(1));
+  }
+  for (GameProtocol::socket *socket : { &first, &second }) {
+    array<char, 1> rest;
+    socket->read_some(boost::asio::buffer(rest), error);
+    ASSERT_TRUE(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+  }
+  server_.StopService();
+}
+
+TEST_F(IPServerTest, Timeouts) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.set_timeouts(milliseconds(300), milliseconds(0));
+  // Timeouts wheel stands still while server is stopped
+  server_.StartListening();
+  server_.StopService();
+  this_thread::sleep_for(milliseconds(500));
+  // Timed out connection is freed outside of registry locks (see SlowClientEviction)
+  atomic<int> timed_out(0);
+  TestedIPConnection::on_disconnect = [&timed_out](TestedIPConnection &connection) {
+    connection.server()->connections().Remove(connection.id() & 0xffffffffu);
+    ++timed_out;
+  };
+  server_.StartListening();
+  steady_clock::time_point start = steady_clock::now();
+  GameProtocol::socket socket(io_service);
+  boost::system::error_code error;
+  socket.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  // Test connection never completes handshake
+  array<char, 1> echo;
+  boost::asio::write(socket, boost::asio::buffer("A", 1), error);
+  ASSERT_FALSE(error);
+  boost::asio::read(socket, boost::asio::buffer(echo), error);
+  ASSERT_FALSE(error);
+  socket.read_some(boost::asio::buffer(echo), error);
+  ASSERT_TRUE(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+  ASSERT_GE(steady_clock::now() - start, milliseconds(300));
+  ASSERT_EQ(timed_out, 1);
+  server_.StopService();
+}
+
+TEST_F(IPServerTest, TimeoutsSharedService) {
+  const int kClients = 8;
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  // Connections are spread between wheels of four threads
+  server_.set_threads_number(4);
+  server_.set_timeouts(milliseconds(200), milliseconds(0));
+  atomic<int> timed_out(0);
+  TestedIPConnection::on_disconnect = [&timed_out](TestedIPConnection &connection) {
+    connection.server()->connections().Remove(connection.id() & 0xffffffffu);
+    ++timed_out;
+  };
+  server_.StartListening();
+  vector<unique_ptr<GameProtocol::socket>> clients;
+  for (int i = 0; i < kClients; ++i) {
+    clients.emplace_back(new GameProtocol::socket(io_service));
+    boost::system::error_code error;
+    clients.back()->connect(endpoint, error);
+    ASSERT_FALSE(error);
+  }
+  for (auto &client : clients) {
+    array<char, 1> rest;
+    boost::system::error_code error;
+    client->read_some(boost::asio::buffer(rest), error);
+    ASSERT_TRUE(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+  }
+  ASSERT_EQ(timed_out, kClients);
+  server_.StopService();
+}
+
+TEST_F(IPServerTest, DrainStats) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.StartListening();
+  GameProtocol::socket reading(io_service), stalled(io_service);
+  boost::system::error_code error;
+  for (GameProtocol::socket *socket : { &reading, &stalled }) {
+    socket->connect(endpoint, error);
+    ASSERT_FALSE(error);
+    array<char, 1> echo;
+    boost::asio::write(*socket, boost::asio::buffer("A", 1), error);
+    ASSERT_FALSE(error);
+    boost::asio::read(*socket, boost::asio::buffer(echo), error);
+    ASSERT_FALSE(error);
+  }
+  // Much more than socket buffers hold, so it stays unsent to peer which does not read
+  string data(32 << 20, 'x');
+  OutboundMessage message = MakeFrame(data.data(), data.size());
+  server_.Broadcast(message);
+  atomic<size_t> received(0);
+  thread reader([&reading, &received]() {
+                  array<char, 65536> buffer;
+                  boost::system::error_code error;
+                  while (!error) {
+                    received += reading.read_some(boost::asio::buffer(buffer), error);
+                  }
+                });
+  TestedIPServer::DrainStats stats = server_.StopService(milliseconds(1000));
+  reader.join();
+  ASSERT_EQ(stats.drained, 1u);
+  ASSERT_EQ(stats.forced, 1u);
+  ASSERT_EQ(received, message->size());
+  ASSERT_EQ(server_.connections().size(), 0u);
+}
+
+TEST_F(IPServerTest, DrainWakesUp) {
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.StartListening();
+  GameProtocol::socket reading(io_service);
+  boost::system::error_code error;
+  reading.connect(endpoint, error);
+  ASSERT_FALSE(error);
+  array<char, 1> echo;
+  boost::asio::write(reading, boost::asio::buffer("A", 1), error);
+  ASSERT_FALSE(error);
+  boost::asio::read(reading, boost::asio::buffer(echo), error);
+  ASSERT_FALSE(error);
+  string data(8 << 20, 'x');
+  OutboundMessage message = MakeFrame(data.data(), data.size());
+  server_.Broadcast(message);
+  thread reader([&reading]() {
+                  array<char, 65536> buffer;
+                  boost::system::error_code error;
+                  while (!error) {
+                    reading.read_some(boost::asio::buffer(buffer), error);
+                  }
+                });
+  // Connection closes itself once its queue is written out, and that
+  // ends the wait long before drain timeout
+  steady_clock::time_point start = steady_clock::now();
+  TestedIPServer::DrainStats stats = server_.StopService(seconds(30));
+  ASSERT_LT(steady_clock::now() - start, seconds(10));
+  reader.join();
+  ASSERT_EQ(stats.drained, 1u);
+  ASSERT_EQ(stats.forced, 0u);
+  ASSERT_EQ(server_.connections().size(), 0u);
+}
+
+#ifdef SO_REUSEPORT
+TEST_F(IPServerTest, ServicePerThread) {
+  const int kWorkers = 4;
+  const size_t kConnections = 20;
+  boost::asio::io_service io_service;
+  GameProtocol::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), kGamePort);
+  server_.set_threads_number(kWorkers);
+  server_.set_service_per_thread(true);
+  server_.StartListening();
+  vector<unique_ptr<GameProtocol::socket>> sockets;
+  boost::system::error_code error;
+  for (size_t i = 0; i < kConnections; ++i) {
+    sockets.emplace_back(new GameProtocol::socket(io_service));
+    sockets.back()->connect(endpoint, error);
+    ASSERT_FALSE(error);
+    // Wait for echo, so that connection is surely registered
+    array<char, 1> echo;
+    boost::asio::write(*sockets.back(), boost::asio::buffer("A", 1), error);
+    ASSERT_FALSE(error);
+    boost::asio::read(*sockets.back(), boost::asio::buffer(echo), error);
+    ASSERT_FALSE(error);
+  }
+  ASSERT_EQ(server_.connections().size(), kConnections);
+  // Kernel spreads connections between acceptors of all workers
+  set<size_t> workers;
+  server_.connections().ForEach([&workers](TestedIPServer::ConnectionId, TestedIPConnection &connection) {
+                                  workers.insert(connection.worker());
+                                });
+  ASSERT_GT(workers.size(), 1u);
+  ASSERT_LT(*workers.rbegin(), size_t(kWorkers));
+
+  TestedIPServer::DrainStats stats = server_.StopService(milliseconds(100));
+  ASSERT_EQ(stats.drained + stats.forced, kConnections);
+  ASSERT_EQ(server_.connections().size(), 0u);
+  ASSERT_FALSE(server_.working());
+  for (auto &socket : sockets) {
+    array<char, 1> rest;
+    socket->read_some(boost::asio::buffer(rest), error);
+    ASSERT_TRUE(error == boost::asio::error::eof || error == boost::asio::error::connection_reset);
+  }
+}
+#endif
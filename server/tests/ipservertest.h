@@ -3,6 +3,7 @@
 
 #include <atomic>
 #include <array>
+#include <functional>
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include <gtest/gtest.h>
@@ -10,6 +11,11 @@
 #include "server/ipserver.h"
 
 class TestedIPConnection : public IPConnection<TestedIPConnection, GameProtocol> {
+ public:
+  static std::atomic<int> resets; ///< Number of Reset() calls of all connections
+  static std::function<void(TestedIPConnection &)> on_disconnect; ///< Called by PrepareDisconnect() if set
+  static std::function<void()> on_read_error; ///< Called by failed read before Free() if set
+
  private:
   static const size_t kBufferSize = 1024;
 
@@ -20,6 +26,8 @@ class TestedIPConnection : public IPConnection<TestedIPConnection, GameProtocol>
 
   virtual void PrepareDisconnect() noexcept;
 
+  virtual void Reset() noexcept;
+
   void HandleRead(const boost::system::error_code &error, std::size_t bytes_transferred) noexcept;
 
   void HandleWrite(const boost::system::error_code &error, std::size_t bytes_transferred) noexcept;
@@ -36,6 +44,11 @@ class IPServerTest : public testing::Test {
 
   IPServerTest() : server_(typename GameProtocol::endpoint(GameProtocol::v4(), kGamePort)) { }
 
+  ~IPServerTest() {
+    TestedIPConnection::on_disconnect = nullptr;
+    TestedIPConnection::on_read_error = nullptr;
+  }
+
  protected:
   TestedIPServer server_;
 };
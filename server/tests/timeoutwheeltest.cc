@@ -0,0 +1,74 @@
+#include <vector>
+#include "timeoutwheeltest.h"
+
+using namespace std;
+using namespace std::chrono;
+
+TEST_F(TimeoutWheelTest, Expire) {
+  TimeoutWheel::Entry short_entry, long_entry;
+  wheel_.Arm(short_entry, 1, milliseconds(30));
+  // Longer than one round of wheel
+  wheel_.Arm(long_entry, 2, milliseconds(200));
+  ASSERT_EQ(wheel_.size(), 2u);
+
+  vector<TimeoutWheel::Key> expired;
+  wheel_.Advance(At(20), expired);
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(60), expired);
+  ASSERT_EQ(expired, vector<TimeoutWheel::Key>({ 1 }));
+  ASSERT_FALSE(short_entry.armed());
+  ASSERT_TRUE(long_entry.armed());
+
+  expired.clear();
+  wheel_.Advance(At(150), expired);
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(250), expired);
+  ASSERT_EQ(expired, vector<TimeoutWheel::Key>({ 2 }));
+  ASSERT_EQ(wheel_.size(), 0u);
+}
+
+TEST_F(TimeoutWheelTest, Rearm) {
+  TimeoutWheel::Entry entry;
+  vector<TimeoutWheel::Key> expired;
+  // Deadline is pushed forward every time, as on every read
+  for (int time = 0; time <= 200; time += 20) {
+    wheel_.Advance(At(time), expired);
+    wheel_.Arm(entry, 7, milliseconds(50));
+  }
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(300), expired);
+  ASSERT_EQ(expired, vector<TimeoutWheel::Key>({ 7 }));
+
+  expired.clear();
+  wheel_.Arm(entry, 7, milliseconds(50));
+  wheel_.Disarm(entry);
+  wheel_.Advance(At(400), expired);
+  ASSERT_TRUE(expired.empty());
+
+  {
+    TimeoutWheel::Entry temporary;
+    wheel_.Arm(temporary, 8, milliseconds(50));
+  }
+  ASSERT_EQ(wheel_.size(), 0u);
+}
+
+TEST_F(TimeoutWheelTest, ArmIdle) {
+  TimeoutWheel::Entry entry;
+  vector<TimeoutWheel::Key> expired;
+  // Wheel was not advanced for a long time, deadline still counts from now
+  wheel_.Arm(entry, 3, milliseconds(500), At(1000));
+  wheel_.Advance(At(1010), expired);
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(1490), expired);
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(1530), expired);
+  ASSERT_EQ(expired, vector<TimeoutWheel::Key>({ 3 }));
+
+  // Same after wheel stood still while server was stopped
+  expired.clear();
+  wheel_.Arm(entry, 4, milliseconds(50), At(5000));
+  wheel_.Advance(At(5020), expired);
+  ASSERT_TRUE(expired.empty());
+  wheel_.Advance(At(5080), expired);
+  ASSERT_EQ(expired, vector<TimeoutWheel::Key>({ 4 }));
+}
@@ -0,0 +1,24 @@
+#ifndef YOBAHACK_TESTS_TIMEOUTWHEELTEST_H_
+#define YOBAHACK_TESTS_TIMEOUTWHEELTEST_H_
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include "server/timeoutwheel.h"
+
+class TimeoutWheelTest : public testing::Test {
+ public:
+  typedef TimeoutWheel::Clock Clock;
+
+  TimeoutWheelTest() : wheel_(std::chrono::milliseconds(10), 8), start_(Clock::now()) { }
+
+ protected:
+  /** Returns time point given number of milliseconds after test start */
+  inline Clock::time_point At(int milliseconds) const {
+    return start_ + std::chrono::milliseconds(milliseconds);
+  }
+
+  TimeoutWheel wheel_;
+  Clock::time_point start_;
+};
+
+#endif // YOBAHACK_TESTS_TIMEOUTWHEELTEST_H_
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include "timeoutwheel.h"
+
+using namespace std;
+
+TimeoutWheel::Entry::~Entry() {
+  TimeoutWheel *wheel = wheel_;
+  if (wheel) wheel->Disarm(*this);
+}
+
+TimeoutWheel::TimeoutWheel(Clock::duration resolution, size_t slots_number) :
+  slots_(max<size_t>(slots_number, 1), nullptr), resolution_(resolution), start_(Clock::now()) { }
+
+void TimeoutWheel::Arm(Entry &entry, Key key, Clock::duration timeout, Clock::time_point now) noexcept {
+  uint64_t ticks = (timeout + resolution_ - Clock::duration(1)) / resolution_;
+  uint64_t current = now > start_ ? (now - start_) / resolution_ : 0;
+  lock_guard<mutex> lock(mutex_);
+  if (entry.wheel_) Unlink(entry);
+  // Current tick is partly gone already, so count from the next one
+  entry.deadline_ = max(tick_, current) + 1 + max<uint64_t>(ticks, 1);
+  entry.key_ = key;
+  entry.wheel_ = this;
+  Entry *&head = slots_[entry.deadline_ % slots_.size()];
+  entry.prev_ = nullptr;
+  entry.next_ = head;
+  if (head) head->prev_ = &entry;
+  head = &entry;
+  ++size_;
+}
+
+void TimeoutWheel::Disarm(Entry &entry) noexcept {
+  lock_guard<mutex> lock(mutex_);
+  if (entry.wheel_) Unlink(entry);
+}
+
+void TimeoutWheel::Advance(Clock::time_point now, vector<Key> &expired) {
+  if (now < start_) return;
+  uint64_t target = (now - start_) / resolution_;
+  lock_guard<mutex> lock(mutex_);
+  if (target <= tick_) return;
+  // After full round every slot has been visited
+  uint64_t steps = min<uint64_t>(target - tick_, slots_.size());
+  for (uint64_t i = 1; i <= steps; ++i) {
+    Entry *entry = slots_[(tick_ + i) % slots_.size()];
+    while (entry) {
+      Entry *next = entry->next_;
+      if (entry->deadline_ <= target) {
+        expired.push_back(entry->key_);
+        Unlink(*entry);
+      }
+      entry = next;
+    }
+  }
+  tick_ = target;
+}
+
+size_t TimeoutWheel::size() noexcept {
+  lock_guard<mutex> lock(mutex_);
+  return size_;
+}
+
+void TimeoutWheel::Unlink(Entry &entry) noexcept {
+  if (entry.prev_) {
+    entry.prev_->next_ = entry.next_;
+  } else {
+    slots_[entry.deadline_ % slots_.size()] = entry.next_;
+  }
+  if (entry.next_) entry.next_->prev_ = entry.prev_;
+  entry.prev_ = entry.next_ = nullptr;
+  entry.wheel_ = nullptr;
+  --size_;
+}
@@ -0,0 +1,90 @@
+#ifndef YOBAHACK_SERVER_TIMEOUTWHEEL_H_
+#define YOBAHACK_SERVER_TIMEOUTWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/** Coarse-grained hashed timer wheel for connection deadlines.
+ * Time is split in ticks of fixed resolution; every slot keeps an
+ * intrusive list of entries whose deadline falls on it modulo number of
+ * slots. Arming, re-arming and disarming are O(1), so deadline can be
+ * pushed forward on every read. Deadlines fire up to two ticks late and
+ * never early.
+ * Thread-safe.
+ */
+class TimeoutWheel {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::uint64_t Key;
+
+  /** Wheel hook embedded into object with deadline */
+  class Entry {
+   public:
+    Entry() = default;
+    Entry(const Entry &other) = delete;
+
+    /** Disarms entry if it is still armed */
+    ~Entry();
+
+    /** Returns true if entry waits for its deadline */
+    inline bool armed() const noexcept {
+      return wheel_ != nullptr;
+    }
+
+   private:
+    friend class TimeoutWheel;
+
+    std::atomic<TimeoutWheel *> wheel_{nullptr}; ///< Read without lock by armed()
+    Entry *prev_ = nullptr;
+    Entry *next_ = nullptr;
+    std::uint64_t deadline_ = 0; ///< In wheel ticks
+    Key key_ = 0;
+  };
+
+  /** \param resolution Length of one tick
+   * \param slots_number Number of slots; deadlines longer than
+   * resolution * slots_number make more than one round
+   */
+  explicit TimeoutWheel(Clock::duration resolution = std::chrono::milliseconds(100),
+                        std::size_t slots_number = 512);
+  TimeoutWheel(const TimeoutWheel &other) = delete;
+  TimeoutWheel(const TimeoutWheel &&other) = delete;
+
+  /** (Re)arms entry to expire after timeout counted from now; key is
+   * reported on expiration. Wheel may lag behind the clock when it is not
+   * advanced for a while, so deadline does not depend on last Advance().
+   */
+  void Arm(Entry &entry, Key key, Clock::duration timeout, Clock::time_point now = Clock::now()) noexcept;
+
+  /** Disarms entry; does nothing if it is not armed */
+  void Disarm(Entry &entry) noexcept;
+
+  /** Moves wheel to given time, disarming expired entries and appending
+   * their keys to expired.
+   */
+  void Advance(Clock::time_point now, std::vector<Key> &expired);
+
+  /** Number of armed entries */
+  std::size_t size() noexcept;
+
+  inline Clock::duration resolution() const noexcept {
+    return resolution_;
+  }
+
+ private:
+  /** Removes entry from its slot; mutex_ should be locked */
+  void Unlink(Entry &entry) noexcept;
+
+  std::mutex mutex_;
+  std::vector<Entry *> slots_; ///< Heads of entries lists
+  Clock::duration resolution_;
+  Clock::time_point start_;
+  std::uint64_t tick_ = 0; ///< Last processed tick
+  std::size_t size_ = 0;
+};
+
+#endif // YOBAHACK_SERVER_TIMEOUTWHEEL_H_
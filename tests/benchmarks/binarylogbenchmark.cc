@@ -0,0 +1,23 @@
+#include <chrono>
+#include <iostream>
+#include "tests/binarylogtest.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+TEST_F(BinaryLogTest, Benchmark) {
+  const int kRecords = 200000;
+  logger_.destinations().clear();
+  logger_.set_level(kWarning);
+  Open();
+  LogNotice("Warming up");
+  auto start = steady_clock::now();
+  for (int i = 0; i < kRecords; ++i) {
+    LogNotice("Player {} moved to cell {}:{}", i, i % 64, i / 64);
+  }
+  auto elapsed = steady_clock::now() - start;
+  Close();
+  ASSERT_EQ(Decode(File(0)).size(), static_cast<size_t>(kRecords + 1));
+  cout << "Binary LogNotice(): " << duration_cast<nanoseconds>(elapsed).count() / kRecords << " ns" << endl;
+}
@@ -0,0 +1,20 @@
+#include <chrono>
+#include <iostream>
+#include "tests/flightrecordertest.h"
+
+using namespace std;
+using namespace logging;
+
+TEST_F(FlightRecorderTest, Benchmark) {
+  const int kRecords = 1000000;
+  recorder_.Start(path_);
+  LogNotice("Warming up");
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < kRecords; ++i) {
+    LogNotice("Player {} moved to cell {}:{}", i, i % 64, i / 64);
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  ASSERT_TRUE(received_.empty());
+  cout << "Recorded LogNotice(): " << chrono::duration_cast<chrono::nanoseconds>(elapsed).count() / kRecords
+       << " ns" << endl;
+}
@@ -0,0 +1,24 @@
+#include <chrono>
+#include <iostream>
+#include "tests/loggingtest.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+TEST_F(LoggingTest, Benchmark) {
+  const int kRecords = 100000;
+  logger_.destinations().clear();
+  logger_.StartAsync(kDropRecords, kRecords * 64);
+  // Buffer of this thread is made by first record
+  LogNotice("Warming up");
+  size_t dropped = logger_.dropped();
+  auto start = steady_clock::now();
+  for (int i = 0; i < kRecords; ++i) {
+    LogNotice("Player moved to another cell");
+  }
+  auto elapsed = steady_clock::now() - start;
+  logger_.StopAsync();
+  ASSERT_EQ(logger_.dropped(), dropped);
+  cout << "Asynchronous Log(): " << duration_cast<nanoseconds>(elapsed).count() / kRecords << " ns" << endl;
+}
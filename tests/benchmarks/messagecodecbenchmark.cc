@@ -0,0 +1,47 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <gtest/gtest.h>
+#include "common/protocol.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/** Measures encode and decode throughput of message */
+template <class Message> void Measure(const char *name, const Message &message) {
+  const int kCount = 1000000;
+  char buffer[64];
+  size_t size = 0;
+  auto start = steady_clock::now();
+  for (int i = 0; i < kCount; ++i) {
+    size += EncodeMessage(message, buffer, sizeof(buffer));
+    // Keeps compiler from dropping the loop
+    asm volatile("" : : "r"(buffer) : "memory");
+  }
+  auto encoded = steady_clock::now();
+  Message decoded;
+  size_t failed = 0;
+  for (int i = 0; i < kCount; ++i) {
+    failed += !DecodeMessage(buffer, size / kCount, decoded);
+    asm volatile("" : : "r"(&decoded) : "memory");
+  }
+  auto finish = steady_clock::now();
+  ASSERT_EQ(failed, 0u);
+  double encode = duration_cast<duration<double>>(encoded - start).count();
+  double decode = duration_cast<duration<double>>(finish - encoded).count();
+  cout << name << " (" << size / kCount << " bytes): encode " << static_cast<int>(kCount / encode / 1e6)
+       << " M/s, decode " << static_cast<int>(kCount / decode / 1e6) << " M/s" << endl;
+}
+
+}
+
+TEST(MessageCodecBenchmark, EncodeDecode) {
+  string name = "anonymous";
+  string text = "Hello, world! Who wants to kill a dragon?";
+  Measure("Hello", HelloMessage{kProtocolVersion, BytesView{name.data(), name.size()}});
+  Measure("Welcome", WelcomeMessage{0x0102030405060708, 12345});
+  Measure("Move", MoveMessage{100500, -17, 129});
+  Measure("Chat", ChatMessage{42, BytesView{text.data(), text.size()}});
+}
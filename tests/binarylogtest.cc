@@ -0,0 +1,117 @@
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "binarylogtest.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+const int BinaryLogTest::kMaxFiles;
+
+TEST_F(BinaryLogTest, Text) {
+  Open(1 << 20);
+  auto start = system_clock::now();
+  LogNotice("{} + {} = {}, {} {} {}", -2, 3u, 1.5, true, 'c', string("text"));
+  LogNotice("Missing {} and {}", nullptr == nullptr);
+  LogNotice("Literal {} without arguments");
+  LogNotice("Smallest {}", static_cast<long long>(-9223372036854775807ll - 1));
+  LogNotice("Endpoint {}", boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 80));
+  LogWarning(string("Not a literal").c_str());
+  LogWarning(string("Not a literal {}").c_str(), 1);
+  LogError("Long {}", string(1000, 'x'));
+  // Array which is not a literal may change or go away after the call
+  for (char digit : { '1', '2' }) {
+    char buffer[] = "Buffer ? {}";
+    buffer[7] = digit;
+    LogWarning(buffer, 3);
+  }
+  // Records are readable before file is closed
+  vector<BinaryLogEntry> entries = Decode(File(0));
+  ASSERT_EQ(Texts(entries), received_);
+  ASSERT_EQ(entries[9].text, "Buffer 2 3");
+  ASSERT_TRUE(entries[9].file.empty());
+  ASSERT_EQ(entries.front().level, kNotice);
+  ASSERT_EQ(entries.front().file, __FILE__);
+  ASSERT_EQ(entries[5].level, kWarning);
+  ASSERT_TRUE(entries[5].file.empty());
+  ASSERT_LE(abs(duration_cast<milliseconds>(entries.front().time - start).count()), 100);
+  Close();
+  ASSERT_EQ(Texts(Decode(File(0))), received_);
+}
+
+TEST_F(BinaryLogTest, Levels) {
+  Open(1 << 20, 4, kNotice);
+  logger_.set_level(kWarning);
+  // Only binary log receives notices, and nothing receives debug records
+  LogNotice("Binary {}", 1);
+  LogWarning("Both {}", 2);
+  LogDebug("None {}", 3);
+  Close();
+  ASSERT_EQ(received_, vector<string>({"Both 2"}));
+  ASSERT_EQ(Texts(Decode(File(0))), vector<string>({"Binary 1", "Both 2"}));
+  ASSERT_FALSE(logger_.enabled(kNotice));
+}
+
+TEST_F(BinaryLogTest, Rotation) {
+  const int kRecords = 1000;
+  logger_.set_level(kWarning);
+  Open(BinaryLog::kMinFileSize, 3);
+  for (int i = 0; i < kRecords; ++i) {
+    LogNotice("Record {}", i);
+  }
+  ASSERT_GE(log_->rotations(), 2u);
+  Close();
+  ASSERT_FALSE(ifstream(File(3)).good());
+  // Every file has its formats, and old files hold earlier records
+  int next = -1;
+  for (int file = 2; file >= 0; --file) {
+    for (const string &text : Texts(Decode(File(file)))) {
+      int record = stoi(text.substr(text.find(' ') + 1));
+      if (next >= 0) {
+        ASSERT_EQ(record, next);
+      }
+      next = record + 1;
+    }
+  }
+  ASSERT_EQ(next, kRecords);
+  // Log of previous run is kept
+  Open(BinaryLog::kMinFileSize, 3);
+  Close();
+  ASSERT_EQ(Texts(Decode(File(1))).back(), "Record 999");
+}
+
+TEST_F(BinaryLogTest, Threads) {
+  const int kThreads = 4, kRecords = 10000;
+  logger_.set_level(kWarning);
+  Open(65536, kMaxFiles);
+  vector<thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([t]() {
+                           for (int i = 0; i < kRecords; ++i) {
+                             LogNotice("{} {}", t, i);
+                           }
+                         });
+  }
+  for (thread &t : threads) {
+    t.join();
+  }
+  ASSERT_LT(log_->rotations(), static_cast<size_t>(kMaxFiles));
+  ASSERT_EQ(log_->dropped(), 0u);
+  size_t files = log_->rotations() + 1;
+  Close();
+  // Order of every thread is kept
+  vector<int> next(kThreads, 0);
+  for (int file = files - 1; file >= 0; --file) {
+    for (const string &text : Texts(Decode(File(file)))) {
+      size_t space = text.find(' ');
+      int t = stoi(text.substr(0, space));
+      ASSERT_EQ(stoi(text.substr(space + 1)), next[t]++);
+    }
+  }
+  ASSERT_EQ(next, vector<int>(kThreads, kRecords));
+}
+
@@ -0,0 +1,89 @@
+#ifndef YOBAHACK_TESTS_BINARYLOGTEST_H_
+#define YOBAHACK_TESTS_BINARYLOGTEST_H_
+
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common/binarylog.h"
+
+class BinaryLogTest : public testing::Test {
+ public:
+  BinaryLogTest()
+      : logger_(logging::Logger::instance()), path_("/tmp/yobahack-binarylogtest-" + std::to_string(getpid())) {
+    logger_.set_write_to_stderr(false);
+    logger_.set_level(logging::kDebug);
+    logger_.destinations().push_back([this](logging::LogMessageLevel, const char *msg) {
+                                       std::lock_guard<std::mutex> lock(mutex_);
+                                       received_.push_back(msg);
+                                     });
+  }
+
+  ~BinaryLogTest() {
+    Close();
+    for (int i = 0; i < kMaxFiles; ++i) {
+      std::remove(File(i).c_str());
+    }
+    logger_.destinations().clear();
+    logger_.set_level(logging::kNotice);
+    logger_.set_write_to_stderr(true);
+  }
+
+ protected:
+  static const int kMaxFiles = 64;
+
+  /** Makes binary log and sets it to logger */
+  void Open(std::size_t file_size = logging::BinaryLog::kDefaultFileSize, std::size_t files = 4,
+            logging::LogMessageLevel level = logging::kDebug) {
+    log_.reset(new logging::BinaryLog(path_, file_size, files));
+    logger_.set_binary_log(log_.get(), level);
+  }
+
+  /** Removes binary log from logger and closes it */
+  void Close() {
+    logger_.set_binary_log(nullptr);
+    log_.reset();
+  }
+
+  /** Name of log file; old ones have greater index */
+  inline std::string File(int index) const {
+    return index == 0 ? path_ : path_ + "." + std::to_string(index);
+  }
+
+  /** Decodes all records of file */
+  std::vector<logging::BinaryLogEntry> Decode(const std::string &file) {
+    std::ifstream stream(file, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    logging::BinaryLogReader reader(data.data(), data.size());
+    EXPECT_TRUE(reader.valid());
+    std::vector<logging::BinaryLogEntry> entries;
+    logging::BinaryLogEntry entry;
+    while (reader.Next(entry)) {
+      entries.push_back(entry);
+    }
+    EXPECT_FALSE(reader.corrupt());
+    return entries;
+  }
+
+  /** Text of records */
+  static std::vector<std::string> Texts(const std::vector<logging::BinaryLogEntry> &entries) {
+    std::vector<std::string> texts;
+    for (const logging::BinaryLogEntry &entry : entries) {
+      texts.push_back(entry.text);
+    }
+    return texts;
+  }
+
+  logging::Logger &logger_;
+  std::string path_;
+  std::unique_ptr<logging::BinaryLog> log_;
+  std::mutex mutex_;
+  std::vector<std::string> received_;
+};
+
+#endif // YOBAHACK_TESTS_BINARYLOGTEST_H_
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common/application.h"
+#include "flightrecordertest.h"
+
+using namespace std;
+using namespace logging;
+
+vector<BinaryLogEntry> FlightRecorderTest::Decode() {
+  ifstream stream(path_, ios::binary);
+  string data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+  BinaryLogReader reader(data.data(), data.size());
+  EXPECT_TRUE(reader.valid());
+  vector<BinaryLogEntry> entries;
+  BinaryLogEntry entry;
+  while (reader.Next(entry)) {
+    entries.push_back(entry);
+  }
+  EXPECT_FALSE(reader.corrupt());
+  return entries;
+}
+
+size_t FlightRecorderTest::Find(const string &text) {
+  vector<BinaryLogEntry> entries = Decode();
+  return count_if(entries.begin(), entries.end(), [&text](const BinaryLogEntry &entry) { return entry.text == text; });
+}
+
+TEST_F(FlightRecorderTest, Dump) {
+  const int kRecords = 8;
+  recorder_.Start(path_, kRecords);
+  ASSERT_TRUE(logger_.enabled(kDebug));
+  // Ring of this thread may hold records of other tests before the marker
+  LogNotice("Dump starts");
+  LogNotice("Main {}", 1);
+  thread worker([]() {
+                  for (int i = 0; i < 20; ++i) {
+                    LogNotice("Worker {}", i);
+                  }
+                  LogNotice(string("Worker done").c_str());
+                });
+  worker.join();
+  LogWarning("Main {}", 2);
+  // Nothing but the warning passes the level of text log
+  ASSERT_EQ(received_, vector<string>({"Main 2"}));
+  recorder_.Dump();
+  vector<BinaryLogEntry> entries = Decode();
+  auto marker = find_if(entries.rbegin(), entries.rend(),
+                        [](const BinaryLogEntry &entry) { return entry.text == "Dump starts"; });
+  ASSERT_NE(marker, entries.rend());
+  vector<BinaryLogEntry> main_entries;
+  vector<string> worker_texts, main_texts;
+  bool after_marker = false;
+  for (const BinaryLogEntry &entry : entries) {
+    if (entry.thread != marker->thread) {
+      ASSERT_EQ(entry.text.find("Worker"), 0u);
+      worker_texts.push_back(entry.text);
+    } else if (after_marker) {
+      main_entries.push_back(entry);
+      main_texts.push_back(entry.text);
+    } else {
+      after_marker = &entry == &*marker;
+    }
+  }
+  // Only last records of every thread are kept
+  ASSERT_EQ(worker_texts.size(), static_cast<size_t>(kRecords));
+  ASSERT_EQ(worker_texts.front(), "Worker 13");
+  ASSERT_EQ(worker_texts.back(), "Worker done");
+  ASSERT_EQ(main_texts, vector<string>({"Main 1", "Main 2"}));
+  ASSERT_EQ(main_entries.back().level, kWarning);
+  ASSERT_EQ(main_entries.back().file, __FILE__);
+  // File is written once
+  remove(path_.c_str());
+  recorder_.Dump();
+  ASSERT_FALSE(ifstream(path_).good());
+  recorder_.Stop();
+  ASSERT_FALSE(logger_.enabled(kNotice));
+}
+
+TEST_F(FlightRecorderTest, Crash) {
+  ASSERT_DEATH({
+      recorder_.Start(path_);
+      LogNotice("Before signal {}", 42);
+      raise(SIGSEGV);
+    }, "");
+  ASSERT_EQ(Find("Before signal 42"), 1u);
+  ASSERT_DEATH({
+      recorder_.Start(path_);
+      LogNotice("Before abort");
+      Application::instance().Abort();
+    }, "");
+  ASSERT_EQ(Find("Before abort"), 1u);
+#if DEBUG_LEVEL != 0
+  ASSERT_DEATH({
+      recorder_.Start(path_);
+      LogNotice("Before assertion");
+      AssertMsg(false, "Broken");
+    }, "");
+  vector<BinaryLogEntry> entries = Decode();
+  // Rings of this process may hold records of other tests before these
+  auto found = find_if(entries.begin(), entries.end(),
+                       [](const BinaryLogEntry &entry) { return entry.text == "Before assertion"; });
+  ASSERT_NE(found, entries.end());
+  ASSERT_NE(++found, entries.end());
+  ASSERT_EQ(found->level, kCritical);
+  ASSERT_NE(found->text.find("Broken"), string::npos);
+#endif
+}
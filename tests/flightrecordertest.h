@@ -0,0 +1,48 @@
+#ifndef YOBAHACK_TESTS_FLIGHTRECORDERTEST_H_
+#define YOBAHACK_TESTS_FLIGHTRECORDERTEST_H_
+
+#include <unistd.h>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common/binarylog.h"
+#include "common/flightrecorder.h"
+
+class FlightRecorderTest : public testing::Test {
+ public:
+  FlightRecorderTest()
+      : logger_(logging::Logger::instance()), recorder_(logging::FlightRecorder::instance()),
+        path_("/tmp/yobahack-flightrecordertest-" + std::to_string(getpid())) {
+    logger_.set_write_to_stderr(false);
+    logger_.set_level(logging::kWarning);
+    logger_.destinations().push_back([this](logging::LogMessageLevel, const char *msg) {
+                                       std::lock_guard<std::mutex> lock(mutex_);
+                                       received_.push_back(msg);
+                                     });
+  }
+
+  ~FlightRecorderTest() {
+    recorder_.Stop();
+    std::remove(path_.c_str());
+    logger_.destinations().clear();
+    logger_.set_level(logging::kNotice);
+    logger_.set_write_to_stderr(true);
+  }
+
+ protected:
+  /** Decodes crash file */
+  std::vector<logging::BinaryLogEntry> Decode();
+
+  /** Number of records of crash file with given text */
+  std::size_t Find(const std::string &text);
+
+  logging::Logger &logger_;
+  logging::FlightRecorder &recorder_;
+  std::string path_;
+  std::mutex mutex_;
+  std::vector<std::string> received_;
+};
+
+#endif // YOBAHACK_TESTS_FLIGHTRECORDERTEST_H_
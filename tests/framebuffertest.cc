@@ -0,0 +1,153 @@
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <boost/asio.hpp>
+#include "common/socketwrapper.h"
+#include "framebuffertest.h"
+
+using namespace std;
+using namespace std::chrono;
+
+void FrameBufferTest::Feed(const string &bytes, size_t chunk) {
+  for (size_t offset = 0; offset < bytes.size(); offset += chunk) {
+    size_t size = min(chunk, bytes.size() - offset);
+    boost::asio::mutable_buffer free = buffer_.Prepare(size);
+    ASSERT_GE(boost::asio::buffer_size(free), size);
+    memcpy(boost::asio::buffer_cast<char *>(free), bytes.data() + offset, size);
+    buffer_.Commit(size);
+  }
+}
+
+TEST_F(FrameBufferTest, SplitMessages) {
+  vector<string> messages = { "a", "", "hello", string(100, 'x'), "tail" };
+  string stream;
+  for (const string &message : messages) {
+    AppendFrame(stream, message);
+  }
+  // Byte by byte, so every header and body is split
+  vector<string> received;
+  for (char c : stream) {
+    Feed(string(1, c), 1);
+    Frame frame;
+    while (buffer_.Next(frame)) {
+      received.push_back(string(frame.data, frame.size));
+    }
+  }
+  ASSERT_EQ(received, messages);
+  ASSERT_EQ(buffer_.pending(), 0u);
+  ASSERT_FALSE(buffer_.malformed());
+}
+
+TEST_F(FrameBufferTest, TooLarge) {
+  string stream;
+  AppendFrame(stream, string(2000, 'x'));
+  Feed(stream.substr(0, 8), 8);
+  Frame frame;
+  ASSERT_FALSE(buffer_.Next(frame));
+  ASSERT_TRUE(buffer_.malformed());
+}
+
+TEST_F(FrameBufferTest, ReadFramesWithoutRoom) {
+  using boost::asio::local::stream_protocol;
+  struct Reader : public SocketWrapper<stream_protocol> {
+    explicit Reader(boost::asio::io_service &io_service) : SocketWrapper(io_service) { }
+    using SocketWrapper::ReadFrames;
+  };
+  boost::asio::io_service io_service;
+  stream_protocol::socket out(io_service);
+  boost::system::error_code error;
+  auto read = [&io_service, &error](Reader &reader, FrameBuffer &buffer) {
+    reader.ReadFrames(buffer, [&error](const boost::system::error_code &e, size_t) { error = e; });
+    io_service.run();
+    io_service.reset();
+  };
+
+  // Messages are not taken, so buffer fills up with the largest one
+  Reader full(io_service);
+  boost::asio::local::connect_pair(full.socket(), out);
+  FrameBuffer buffer(16, 12);
+  string stream;
+  AppendFrame(stream, string(12, 'm'));
+  AppendFrame(stream, "next");
+  boost::asio::write(out, boost::asio::buffer(stream));
+  while (!error && buffer.pending() < 16) {
+    read(full, buffer);
+  }
+  ASSERT_FALSE(error);
+  read(full, buffer);
+  ASSERT_TRUE(error);
+  ASSERT_FALSE(full.socket().is_open());
+  out.close();
+
+  // Peer announced message larger than allowed
+  Reader malformed(io_service);
+  boost::asio::local::connect_pair(malformed.socket(), out);
+  buffer.Reset();
+  stream.clear();
+  AppendFrame(stream, string(13, 'm'));
+  boost::asio::write(out, boost::asio::buffer(stream));
+  error.clear();
+  read(malformed, buffer);
+  Frame frame;
+  ASSERT_FALSE(buffer.Next(frame));
+  ASSERT_TRUE(buffer.malformed());
+  read(malformed, buffer);
+  ASSERT_TRUE(error);
+  ASSERT_FALSE(malformed.socket().is_open());
+}
+
+// Compares draining a local socket into FrameBuffer with reading header
+// and body of every message by separate calls into own buffer.
+TEST_F(FrameBufferTest, Throughput) {
+  using boost::asio::local::stream_protocol;
+  static const size_t kMessages = 200000;
+  const string kMessage(48, 'm');
+  string stream;
+  for (size_t i = 0; i < kMessages; ++i) {
+    AppendFrame(stream, kMessage);
+  }
+
+  auto measure = [&stream](function<size_t(stream_protocol::socket &)> reader) -> double {
+    boost::asio::io_service io_service;
+    stream_protocol::socket in(io_service), out(io_service);
+    boost::asio::local::connect_pair(in, out);
+    thread writer([&out, &stream]() { boost::asio::write(out, boost::asio::buffer(stream)); });
+    steady_clock::time_point start = steady_clock::now();
+    size_t received = reader(in);
+    duration<double> time = steady_clock::now() - start;
+    writer.join();
+    EXPECT_EQ(received, kMessages);
+    return stream.size() / time.count() / (1 << 20);
+  };
+
+  double framed = measure([](stream_protocol::socket &socket) -> size_t {
+                            FrameBuffer buffer;
+                            size_t received = 0;
+                            while (received < kMessages) {
+                              boost::system::error_code e;
+                              size_t bytes = socket.read_some(buffer.Prepare(FrameBuffer::kReadSize), e);
+                              buffer.Commit(bytes);
+                              Frame frame;
+                              while (buffer.Next(frame)) {
+                                ++received;
+                              }
+                            }
+                            return received;
+                          });
+  double per_call = measure([](stream_protocol::socket &socket) -> size_t {
+                              vector<char> body;
+                              size_t received = 0;
+                              while (received < kMessages) {
+                                unsigned char header[FrameBuffer::kHeaderSize];
+                                boost::asio::read(socket, boost::asio::buffer(header));
+                                size_t size = header[0] | header[1] << 8 | header[2] << 16 | header[3] << 24;
+                                body.resize(size);
+                                boost::asio::read(socket, boost::asio::buffer(body));
+                                ++received;
+                              }
+                              return received;
+                            });
+  cout << "FrameBuffer: " << framed << " MiB/s, per-call reads: " << per_call << " MiB/s" << endl;
+}
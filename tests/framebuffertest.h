@@ -0,0 +1,24 @@
+#ifndef YOBAHACK_TESTS_FRAMEBUFFERTEST_H_
+#define YOBAHACK_TESTS_FRAMEBUFFERTEST_H_
+
+#include <string>
+#include <gtest/gtest.h>
+#include "common/framebuffer.h"
+
+class FrameBufferTest : public testing::Test {
+ protected:
+  /** Appends message with header to string */
+  static void AppendFrame(std::string &out, const std::string &message) {
+    char header[FrameBuffer::kHeaderSize];
+    FrameBuffer::WriteHeader(header, message.size());
+    out.append(header, sizeof(header));
+    out.append(message);
+  }
+
+  /** Feeds bytes to buffer in chunks of given size */
+  void Feed(const std::string &bytes, std::size_t chunk);
+
+  FrameBuffer buffer_{16, 1024};
+};
+
+#endif // YOBAHACK_TESTS_FRAMEBUFFERTEST_H_
@@ -0,0 +1,179 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "loggingtest.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace logging;
+
+TEST_F(LoggingTest, Sync) {
+  LogWarning("one");
+  LogNotice("two");
+  logger_.set_level(kWarning);
+  LogNotice("hidden");
+  ASSERT_EQ(received(), vector<string>({"one", "two"}));
+}
+
+TEST_F(LoggingTest, Async) {
+  logger_.StartAsync(kBlock, 1024);
+  const int kThreads = 4, kRecords = 1000;
+  vector<thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([t]() {
+                           for (int i = 0; i < kRecords; ++i) {
+                             LogNotice((to_string(t) + " " + to_string(i)).c_str());
+                           }
+                         });
+  }
+  for (thread &t : threads) {
+    t.join();
+  }
+  logger_.Flush();
+  // Nothing is lost with blocking policy, order of each thread is kept
+  vector<string> records = received();
+  ASSERT_EQ(records.size(), static_cast<size_t>(kThreads * kRecords));
+  vector<int> next(kThreads, 0);
+  for (const string &record : records) {
+    size_t space = record.find(' ');
+    int t = stoi(record.substr(0, space));
+    ASSERT_EQ(stoi(record.substr(space + 1)), next[t]++);
+  }
+  ASSERT_EQ(logger_.dropped(), 0u);
+  // Long message is truncated
+  logger_.StopAsync();
+  logger_.StartAsync(kBlock, 1024);
+  LogNotice(string(1000, 'x').c_str());
+  logger_.StopAsync();
+  ASSERT_EQ(received().back().size(), Logger::kMaxMessage);
+}
+
+TEST_F(LoggingTest, Drop) {
+  logger_.StartAsync(kDropRecords, 256);
+  // Slow destination makes buffer overflow
+  logger_.destinations().push_back([](LogMessageLevel, const char *) {
+                                     this_thread::sleep_for(milliseconds(1));
+                                   });
+  size_t dropped = logger_.dropped();
+  for (int i = 0; i < 100; ++i) {
+    LogNotice("spam");
+  }
+  logger_.Flush();
+  ASSERT_GT(logger_.dropped(), dropped);
+  ASSERT_EQ(received().size() + logger_.dropped() - dropped, 100u);
+}
+
+TEST_F(LoggingTest, Reentrant) {
+  // Destination which logs itself, much more than fits into a buffer
+  logger_.destinations().push_back([](LogMessageLevel, const char *msg) {
+                                     if (string(msg) != "outer") return;
+                                     for (int i = 0; i < 20; ++i) {
+                                       LogNotice("inner {}", i);
+                                     }
+                                   });
+  LogNotice("outer");
+  logger_.StartAsync(kBlock, 256);
+  LogNotice("outer");
+  logger_.Flush();
+  // Inner messages went to stderr, not to destinations
+  ASSERT_EQ(received(), vector<string>({"outer", "outer"}));
+}
+
+TEST_F(LoggingTest, Format) {
+  LogNotice("{} + {} = {}, {} {} {}", -2, 3u, 1.5, true, 'c', string("text"));
+  LogNotice("Missing {} and {}", nullptr == nullptr);
+  LogNotice("Literal {} without arguments");
+  LogNotice("Smallest {}", static_cast<long long>(-9223372036854775807ll - 1));
+  LogNotice("Endpoint {}", boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 80));
+  ASSERT_EQ(received(), vector<string>({"-2 + 3 = 1.5, true c text", "Missing true and {}",
+                                        "Literal {} without arguments", "Smallest -9223372036854775808",
+                                        "Endpoint 127.0.0.1:80"}));
+}
+
+TEST_F(LoggingTest, Lazy) {
+  int evaluated = 0;
+  auto argument = [&evaluated]() { return ++evaluated; };
+  logger_.set_level(kWarning);
+  LogNotice("Hidden {}", argument());
+  LogWarning("Shown {}", argument());
+  ASSERT_EQ(evaluated, 1);
+#if LOG_MAX_LEVEL < 4
+  // Compiled out regardless of logger's level
+  logger_.set_level(kDebug);
+  LogDebug("Hidden {}", argument());
+  ASSERT_EQ(evaluated, 1);
+#endif
+  ASSERT_EQ(received(), vector<string>({"Shown 1"}));
+}
+
+TEST_F(LoggingTest, Limited) {
+  auto log = [](int i) {
+    LogLimited(kWarning, 10, milliseconds(50), "Limited {}", i);
+  };
+  for (int i = 0; i < 25; ++i) {
+    log(i);
+  }
+  vector<string> records = received();
+  ASSERT_EQ(records.size(), 10u);
+  ASSERT_EQ(records.back(), "Limited 9");
+  // Next window starts with summary of the previous one
+  this_thread::sleep_for(milliseconds(60));
+  log(25);
+  records = received();
+  ASSERT_EQ(records.size(), 12u);
+  ASSERT_EQ(records[10].find("Suppressed 15 similar messages from "), 0u);
+  ASSERT_NE(records[10].find("loggingtest.cc:"), string::npos);
+  ASSERT_EQ(records[11], "Limited 25");
+}
+
+TEST_F(LoggingTest, LimitedQuiet) {
+  auto log = [](int i) {
+    LogLimited(kWarning, 2, milliseconds(50), "Quiet {}", i);
+  };
+  // Storm which ends is reported without next message of the site: in
+  // synchronous mode by the next message of any site
+  for (int i = 0; i < 5; ++i) {
+    log(i);
+  }
+  ASSERT_EQ(received().size(), 2u);
+  LogNotice("Storm goes on");
+  ASSERT_EQ(received().size(), 3u);
+  this_thread::sleep_for(milliseconds(60));
+  LogNotice("Storm is over");
+  vector<string> records = received();
+  ASSERT_EQ(records.size(), 5u);
+  ASSERT_EQ(records[3].find("Suppressed 3 similar messages from "), 0u);
+  ASSERT_EQ(records[4], "Storm is over");
+  // Flush() does not wait for the interval
+  for (int i = 5; i < 10; ++i) {
+    log(i);
+  }
+  logger_.Flush();
+  records = received();
+  ASSERT_EQ(records.size(), 8u);
+  ASSERT_EQ(records[7].find("Suppressed 3 similar messages from "), 0u);
+  // Background thread reports it once interval is over
+  this_thread::sleep_for(milliseconds(60));
+  logger_.StartAsync(kBlock, 1024);
+  for (int i = 10; i < 15; ++i) {
+    log(i);
+  }
+  steady_clock::time_point deadline = steady_clock::now() + seconds(5);
+  while (received().size() < 11) {
+    ASSERT_LT(steady_clock::now(), deadline);
+    this_thread::sleep_for(milliseconds(1));
+  }
+  records = received();
+  ASSERT_EQ(records[8], "Quiet 10");
+  ASSERT_EQ(records[9], "Quiet 11");
+  ASSERT_EQ(records[10].find("Suppressed 3 similar messages from "), 0u);
+}
+
+TEST_F(LoggingTest, Sampled) {
+  for (int i = 0; i < 10; ++i) {
+    LogSampled(kNotice, 3, "Sampled {}", i);
+  }
+  ASSERT_EQ(received(), vector<string>({"Sampled 0", "Sampled 3", "Sampled 6", "Sampled 9"}));
+}
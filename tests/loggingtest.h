@@ -0,0 +1,39 @@
+#ifndef YOBAHACK_TESTS_LOGGINGTEST_H_
+#define YOBAHACK_TESTS_LOGGINGTEST_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common/logging.h"
+
+class LoggingTest : public testing::Test {
+ public:
+  LoggingTest() : logger_(logging::Logger::instance()) {
+    logger_.set_write_to_stderr(false);
+    logger_.set_level(logging::kDebug);
+    logger_.destinations().push_back([this](logging::LogMessageLevel, const char *msg) {
+                                       std::lock_guard<std::mutex> lock(mutex_);
+                                       received_.push_back(msg);
+                                     });
+  }
+
+  ~LoggingTest() {
+    logger_.StopAsync();
+    logger_.destinations().clear();
+    logger_.set_level(logging::kNotice);
+    logger_.set_write_to_stderr(true);
+  }
+
+ protected:
+  inline std::vector<std::string> received() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return received_;
+  }
+
+  logging::Logger &logger_;
+  std::mutex mutex_;
+  std::vector<std::string> received_;
+};
+
+#endif // YOBAHACK_TESTS_LOGGINGTEST_H_
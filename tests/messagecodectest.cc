@@ -0,0 +1,76 @@
+#include <random>
+#include "messagecodectest.h"
+
+using namespace std;
+
+TEST_F(MessageCodecTest, Layout) {
+  ASSERT_EQ(MoveMessage::Schema::kFieldCount, 3u);
+  static_assert(MaxMessageSize<MoveMessage>() == 1 + 5 + 5 + 5, "Move message size");
+  static_assert(MaxMessageSize<WelcomeMessage>() == 1 + 8 + 5, "Welcome message size");
+  static_assert(MaxMessageSize<ChatMessage>() == kUnboundedSize, "Chat message size");
+  static_assert(HelloMessage::Schema::MinSize() == 3, "Hello message size");
+  MoveMessage move{300, -1, 63};
+  ASSERT_EQ(Encode(move), string("\x03\xac\x02\x01\x7e", 5));
+  WelcomeMessage welcome{0x0102030405060708, 1};
+  ASSERT_EQ(Encode(welcome), string("\x02\x08\x07\x06\x05\x04\x03\x02\x01\x01", 10));
+}
+
+TEST_F(MessageCodecTest, RoundTrip) {
+  Handler handler;
+  string name = "anonymous";
+  vector<string> messages = {
+    Encode(HelloMessage{kProtocolVersion, BytesView{name.data(), name.size()}}),
+    Encode(WelcomeMessage{~0ull, 7}),
+    Encode(MoveMessage{~0u, -2147483647 - 1, 2147483647}),
+    Encode(ChatMessage{1, BytesView{"", 0}})
+  };
+  for (const string &message : messages) {
+    ASSERT_TRUE(GameMessages::Dispatch(message.data(), message.size(), handler));
+  }
+  ASSERT_EQ(handler.received, vector<string>({"hello anonymous", "welcome 18446744073709551615",
+                                              "move -2147483648 2147483647", "chat "}));
+  // Byte fields point into receive buffer
+  HelloMessage hello;
+  ASSERT_TRUE(DecodeMessage(messages[0].data(), messages[0].size(), hello));
+  ASSERT_EQ(hello.name.data, messages[0].data() + 4);
+  // Encoder does not write past buffer
+  char small[4];
+  ASSERT_EQ(EncodeMessage(hello, small, sizeof(small)), 0u);
+}
+
+TEST_F(MessageCodecTest, Malformed) {
+  Handler handler;
+  string move = Encode(MoveMessage{1, 2, 3});
+  // Every truncated message and trailing garbage are rejected
+  for (size_t size = 0; size < move.size(); ++size) {
+    ASSERT_FALSE(GameMessages::Dispatch(move.data(), size, handler));
+  }
+  ASSERT_FALSE(GameMessages::Dispatch((move + '\0').data(), move.size() + 1, handler));
+  // Unknown type
+  ASSERT_FALSE(GameMessages::Dispatch("\x7f", 1, handler));
+  // Overlong varint and value out of range
+  ASSERT_FALSE(GameMessages::Dispatch("\x03\x81\x00\x01\x01", 5, handler));
+  ASSERT_FALSE(GameMessages::Dispatch("\x03\xff\xff\xff\xff\x1f\x01\x01", 8, handler));
+  ASSERT_TRUE(GameMessages::Dispatch("\x03\xff\xff\xff\xff\x0f\x01\x01", 8, handler));
+  // Length of bytes beyond the end
+  ASSERT_FALSE(GameMessages::Dispatch("\x04\x01\x10hello", 8, handler));
+  ASSERT_EQ(handler.received, vector<string>({"move -1 -1"}));
+}
+
+TEST_F(MessageCodecTest, Fuzz) {
+  Handler handler;
+  mt19937 random(1);
+  size_t accepted = 0;
+  string data;
+  for (int i = 0; i < 200000; ++i) {
+    data.resize(random() % 16);
+    for (char &c : data) {
+      c = static_cast<char>(random());
+    }
+    // Valid type byte makes decoder go deeper
+    if (!data.empty()) data[0] = static_cast<char>(1 + random() % 4);
+    accepted += GameMessages::Dispatch(data.data(), data.size(), handler);
+  }
+  ASSERT_EQ(accepted, handler.received.size());
+}
+
@@ -0,0 +1,39 @@
+#ifndef YOBAHACK_TESTS_MESSAGECODECTEST_H_
+#define YOBAHACK_TESTS_MESSAGECODECTEST_H_
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common/protocol.h"
+
+class MessageCodecTest : public testing::Test {
+ protected:
+  /** Remembers dispatched messages */
+  struct Handler {
+    void operator()(const HelloMessage &message) {
+      received.push_back("hello " + message.name.str());
+    }
+
+    void operator()(const WelcomeMessage &message) {
+      received.push_back("welcome " + std::to_string(message.session));
+    }
+
+    void operator()(const MoveMessage &message) {
+      received.push_back("move " + std::to_string(message.row) + " " + std::to_string(message.col));
+    }
+
+    void operator()(const ChatMessage &message) {
+      received.push_back("chat " + message.text.str());
+    }
+
+    std::vector<std::string> received;
+  };
+
+  /** Encodes message and returns its bytes without length header */
+  template <class Message> static std::string Encode(const Message &message) {
+    OutboundMessage frame = MakeMessage(message);
+    return frame->substr(FrameBuffer::kHeaderSize);
+  }
+};
+
+#endif // YOBAHACK_TESTS_MESSAGECODECTEST_H_
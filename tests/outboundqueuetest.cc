@@ -0,0 +1,75 @@
+#include <string>
+#include "common/framebuffer.h"
+#include "outboundqueuetest.h"
+
+using namespace std;
+
+TEST_F(OutboundQueueTest, Coalescing) {
+  ASSERT_EQ(queue_.Push(MakeFrame("first", 5)), OutboundQueue::kScheduleFlush);
+  ASSERT_EQ(queue_.Push(MakeFrame("second", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.pending_messages(), 2u);
+  bool failed = false, done = false;
+  ASSERT_TRUE(queue_.Flush(out_, [&failed, &done](const boost::system::error_code &error) {
+                             failed = static_cast<bool>(error);
+                             done = true;
+                           }));
+  // Queued while first write is in flight; goes with the next one
+  ASSERT_EQ(queue_.Push(MakeFrame("third", 5)), OutboundQueue::kQueued);
+  io_service_.run();
+  ASSERT_TRUE(done);
+  ASSERT_FALSE(failed);
+  ASSERT_EQ(queue_.pending_bytes(), 0u);
+
+  FrameBuffer buffer;
+  vector<string> received;
+  while (received.size() < 3) {
+    size_t bytes = in_.read_some(buffer.Prepare(in_.available()));
+    buffer.Commit(bytes);
+    Frame frame;
+    while (buffer.Next(frame)) {
+      received.push_back(string(frame.data, frame.size));
+    }
+  }
+  ASSERT_EQ(received, vector<string>({ "first", "second", "third" }));
+  // Queue is idle again, so next message needs a flush
+  ASSERT_EQ(queue_.Push(MakeFrame("", 0)), OutboundQueue::kScheduleFlush);
+}
+
+TEST_F(OutboundQueueTest, SharedMessage) {
+  OutboundMessage message = MakeFrame("broadcast", 9);
+  const string *buffer = message.get();
+  OutboundQueue other;
+  queue_.Push(OutboundMessage(message));
+  other.Push(OutboundMessage(message));
+  // No copies, only references
+  ASSERT_EQ(message.use_count(), 3);
+  queue_.Flush(out_, [](const boost::system::error_code &) { });
+  io_service_.run();
+  ASSERT_EQ(message.use_count(), 2);
+  other.Reset();
+  ASSERT_EQ(message.use_count(), 1);
+  ASSERT_EQ(message.get(), buffer);
+}
+
+TEST_F(OutboundQueueTest, Watermarks) {
+  // Every frame here is 4 + 6 bytes
+  queue_.set_watermarks(30, 50);
+  ASSERT_EQ(queue_.Push(MakeFrame("state1", 6), true), OutboundQueue::kScheduleFlush);
+  ASSERT_EQ(queue_.Push(MakeFrame("event1", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.Push(MakeFrame("state2", 6), true), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.pending_bytes(), 30u);
+  // Above low watermark: stale states go first
+  ASSERT_EQ(queue_.Push(MakeFrame("state3", 6), true), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.dropped(), 2u);
+  ASSERT_EQ(queue_.pending_messages(), 2u);
+  ASSERT_EQ(queue_.Push(MakeFrame("event2", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.Push(MakeFrame("state4", 6), true), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.dropped(), 3u);
+  ASSERT_EQ(queue_.Push(MakeFrame("event3", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.dropped(), 4u);
+  ASSERT_EQ(queue_.Push(MakeFrame("event4", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.Push(MakeFrame("event5", 6)), OutboundQueue::kQueued);
+  ASSERT_EQ(queue_.Push(MakeFrame("state5", 6), true), OutboundQueue::kDropped);
+  ASSERT_EQ(queue_.Push(MakeFrame("event6", 6)), OutboundQueue::kOverflow);
+  ASSERT_EQ(queue_.pending_bytes(), 50u);
+}
@@ -0,0 +1,23 @@
+#ifndef YOBAHACK_TESTS_OUTBOUNDQUEUETEST_H_
+#define YOBAHACK_TESTS_OUTBOUNDQUEUETEST_H_
+
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include "common/outboundqueue.h"
+
+class OutboundQueueTest : public testing::Test {
+ public:
+  typedef boost::asio::local::stream_protocol::socket Socket;
+
+  OutboundQueueTest() : in_(io_service_), out_(io_service_) {
+    boost::asio::local::connect_pair(in_, out_);
+  }
+
+ protected:
+  boost::asio::io_service io_service_;
+  Socket in_;
+  Socket out_;
+  OutboundQueue queue_;
+};
+
+#endif // YOBAHACK_TESTS_OUTBOUNDQUEUETEST_H_
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <iostream>
+#include "snapshottest.h"
+
+using namespace std;
+
+void SnapshotTest::Push() {
+  const Snapshot *previous = history_.latest().get();
+  CellMatrix cells = cells_;
+  vector<Entity> entities = entities_;
+  history_.Push(Snapshot::Make(tick_, move(cells), move(entities), previous));
+}
+
+void SnapshotTest::Step() {
+  uniform_int_distribution<size_t> cell(0, cells_.size() - 1);
+  for (int i = 0; i < 3; ++i) {
+    cells_[cell(random_)] = static_cast<uint8_t>(random_());
+  }
+  uniform_int_distribution<size_t> entity(0, entities_.size() - 1);
+  for (int i = 0; i < 5; ++i) {
+    Entity &moved = entities_[entity(random_)];
+    moved.row += static_cast<int32_t>(random_() % 3) - 1;
+    moved.col += static_cast<int32_t>(random_() % 3) - 1;
+  }
+  // Sometimes one entity dies and another one is born
+  if (random_() % 4 == 0) {
+    entities_.erase(entities_.begin() + entity(random_));
+    entities_.push_back(Entity{static_cast<uint32_t>(1000 + tick_), 5, 5, 7});
+  }
+  ++tick_;
+  Push();
+}
+
+TEST_F(SnapshotTest, Changes) {
+  Push();
+  ASSERT_FALSE(history_.latest()->has_changes());
+  cells_.at(1, 2) = 9;
+  entities_[0].row = -5;
+  entities_.pop_back();
+  entities_.push_back(Entity{1, 0, 0, 0});
+  ++tick_;
+  Push();
+  const Snapshot &snapshot = *history_.latest();
+  ASSERT_TRUE(snapshot.has_changes());
+  ASSERT_EQ(snapshot.changed_cells(), vector<uint32_t>({66}));
+  ASSERT_EQ(snapshot.changed_entities(), vector<uint32_t>({1, 3, 150}));
+  ASSERT_EQ(snapshot.Find(3)->row, -5);
+  ASSERT_EQ(snapshot.Find(150), nullptr);
+}
+
+/** Client gets every update, but acknowledgements reach server late and
+ * some updates are lost; client state should always match server's.
+ */
+TEST_F(SnapshotTest, LossyDeltas) {
+  Push();
+  SnapshotEncoder encoder;
+  Snapshot::Tick client_tick = 0;
+  CellMatrix client_cells;
+  vector<Entity> client_entities;
+  vector<Snapshot::Tick> acks; // In flight to server
+  size_t full_bytes = 0, delta_bytes = 0;
+  for (int i = 0; i < 500; ++i) {
+    Step();
+    size_t full_sent = encoder.full_sent();
+    const string &data = encoder.Encode(history_);
+    (encoder.full_sent() > full_sent ? full_bytes : delta_bytes) += data.size();
+    if (random_() % 5 == 0) continue; // Lost
+    ASSERT_TRUE(ApplySnapshot(data.data(), data.size(), client_tick, client_cells, client_entities));
+    ASSERT_EQ(client_tick, tick_);
+    ASSERT_EQ(client_cells, cells_);
+    vector<Entity> expected = entities_;
+    sort(expected.begin(), expected.end(), [](const Entity &a, const Entity &b) { return a.id < b.id; });
+    ASSERT_EQ(client_entities, expected);
+    acks.push_back(client_tick);
+    if (acks.size() > 3) {
+      encoder.Acknowledge(acks.front());
+      acks.erase(acks.begin());
+    }
+  }
+  // Full snapshots are sent only until the first acknowledgement arrives
+  ASSERT_LE(encoder.full_sent(), 8u);
+  ASSERT_EQ(encoder.full_sent() + encoder.delta_sent(), 500u);
+  size_t full = full_bytes / encoder.full_sent(), delta = delta_bytes / encoder.delta_sent();
+  cout << "Full snapshot " << full << " bytes, average delta " << delta << " bytes" << endl;
+  ASSERT_LT(delta, full / 10);
+}
+
+TEST_F(SnapshotTest, Fallback) {
+  Push();
+  SnapshotEncoder encoder;
+  encoder.Encode(history_);
+  encoder.Acknowledge(tick_);
+  Step();
+  encoder.Encode(history_);
+  ASSERT_EQ(encoder.delta_sent(), 1u);
+  // Unknown tick is ignored
+  encoder.Acknowledge(tick_ + 100);
+  // Baseline falls out of history
+  for (int i = 0; i < 100; ++i) Step();
+  const string &data = encoder.Encode(history_);
+  ASSERT_EQ(encoder.full_sent(), 2u);
+  // Delta does not apply to state older than its baseline
+  Snapshot::Tick client_tick = 0;
+  CellMatrix client_cells;
+  vector<Entity> client_entities;
+  ASSERT_TRUE(ApplySnapshot(data.data(), data.size(), client_tick, client_cells, client_entities));
+  encoder.Acknowledge(tick_);
+  Step();
+  Step();
+  const string &delta = encoder.Encode(history_);
+  ASSERT_EQ(encoder.delta_sent(), 2u);
+  Snapshot::Tick old_tick = tick_ - 3;
+  ASSERT_FALSE(ApplySnapshot(delta.data(), delta.size(), old_tick, client_cells, client_entities));
+  ASSERT_TRUE(ApplySnapshot(delta.data(), delta.size(), client_tick, client_cells, client_entities));
+  ASSERT_EQ(client_cells, cells_);
+  // Truncated data is rejected
+  ASSERT_FALSE(ApplySnapshot(delta.data(), 3, client_tick, client_cells, client_entities));
+}
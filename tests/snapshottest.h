@@ -0,0 +1,31 @@
+#ifndef YOBAHACK_TESTS_SNAPSHOTTEST_H_
+#define YOBAHACK_TESTS_SNAPSHOTTEST_H_
+
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "common/snapshot.h"
+
+class SnapshotTest : public testing::Test {
+ public:
+  SnapshotTest() : cells_(64, 64), random_(42) {
+    for (std::uint32_t id = 1; id <= 50; ++id) {
+      entities_.push_back(Entity{id * 3, static_cast<std::int32_t>(id % 64), static_cast<std::int32_t>(id / 2), id});
+    }
+  }
+
+ protected:
+  /** Changes a few cells and entities and pushes snapshot of next tick */
+  void Step();
+
+  /** Pushes snapshot of current world to history */
+  void Push();
+
+  CellMatrix cells_;
+  std::vector<Entity> entities_;
+  Snapshot::Tick tick_ = 0;
+  SnapshotHistory history_;
+  std::mt19937 random_;
+};
+
+#endif // YOBAHACK_TESTS_SNAPSHOTTEST_H_
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "unreliablechanneltest.h"
+
+using namespace std;
+using namespace std::chrono;
+
+TEST(SequenceStateTest, LatestWins) {
+  SequenceState state;
+  ASSERT_TRUE(state.Receive(10));
+  ASSERT_TRUE(state.Receive(12));
+  // Late datagram is dropped, but acknowledged
+  ASSERT_FALSE(state.Receive(11));
+  ASSERT_FALSE(state.Receive(12));
+  ASSERT_EQ(state.ack(), 12);
+  ASSERT_EQ(state.ack_bits(), 3u);
+  // Wrap-around
+  SequenceState wrapped;
+  ASSERT_TRUE(wrapped.Receive(65535));
+  ASSERT_TRUE(wrapped.Receive(1));
+  ASSERT_EQ(wrapped.ack_bits(), 2u);
+}
+
+TEST(SequenceStateTest, Acknowledge) {
+  SequenceState sender, receiver;
+  SequenceState::Clock::time_point now = SequenceState::Clock::now();
+  for (int i = 0; i < 5; ++i) {
+    uint16_t sequence = sender.Next(now);
+    // Datagrams 1 and 3 are lost
+    if (sequence != 1 && sequence != 3) receiver.Receive(sequence);
+  }
+  DatagramHeader header = {};
+  receiver.Stamp(header, now);
+  vector<uint16_t> acked;
+  sender.Acknowledge(header, now + milliseconds(10), acked);
+  sort(acked.begin(), acked.end());
+  ASSERT_EQ(acked, vector<uint16_t>({ 0, 2, 4 }));
+  ASSERT_EQ(sender.rtt(), milliseconds(10));
+  // Repeated acks are reported once
+  acked.clear();
+  sender.Acknowledge(header, now + milliseconds(20), acked);
+  ASSERT_TRUE(acked.empty());
+}
+
+TEST(SequenceStateTest, NothingReceived) {
+  SequenceState sender, receiver;
+  SequenceState::Clock::time_point now = SequenceState::Clock::now();
+  sender.Next(now);
+  // Datagram 0 is lost, receiver still sends zero ack
+  DatagramHeader header = {};
+  receiver.Stamp(header, now);
+  ASSERT_FALSE(receiver.received_any());
+  ASSERT_EQ(header.ack, 0);
+  char wire[DatagramHeader::kSize];
+  header.Write(wire);
+  header = DatagramHeader::Read(wire);
+  ASSERT_EQ(header.flags, DatagramHeader::kNothingReceived);
+  vector<uint16_t> acked;
+  sender.Acknowledge(header, now, acked);
+  ASSERT_TRUE(acked.empty());
+  // Once something arrives, zero ack is real
+  receiver.Receive(0);
+  receiver.Stamp(header, now);
+  ASSERT_EQ(header.flags, 0);
+  sender.Acknowledge(header, now, acked);
+  ASSERT_EQ(acked, vector<uint16_t>({ 0 }));
+}
+
+TEST_F(UnreliableChannelTest, LossyLink) {
+  const int kUpdates = 2000;
+  const microseconds kInterval(500);
+  mutex mutex;
+  vector<SequenceState::Clock::time_point> received;
+  vector<int> indices;
+  int last_index = -1;
+  client_.set_receive_handler([&](UnreliableChannel::Session, uint16_t, const char *data, size_t size) {
+                                int index;
+                                ASSERT_EQ(size, sizeof(index));
+                                memcpy(&index, data, sizeof(index));
+                                if (index < 0) return;
+                                lock_guard<std::mutex> lock(mutex);
+                                // latest-wins: never goes back
+                                ASSERT_GT(index, last_index);
+                                last_index = index;
+                                received.push_back(SequenceState::Clock::now());
+                                indices.push_back(index);
+                              });
+  atomic<int> acked(0);
+  server_.set_ack_handler([&acked](UnreliableChannel::Session, uint16_t) { ++acked; });
+  server_.set_simulated_loss(0.2);
+  Open();
+  UnreliableChannel::Session session = server_.CreateSession();
+  client_.AddSession(session, server_.local_endpoint());
+
+  // Client speaks first, so that server learns its address
+  int hello = -1;
+  ASSERT_TRUE(client_.Send(session, reinterpret_cast<const char *>(&hello), sizeof(hello)));
+  while (!server_.Send(session, reinterpret_cast<const char *>(&hello), sizeof(hello))) {
+    this_thread::sleep_for(milliseconds(1));
+  }
+
+  SequenceState::Clock::time_point start = SequenceState::Clock::now();
+  for (int i = 0; i < kUpdates; ++i) {
+    this_thread::sleep_until(start + kInterval * i);
+    server_.Send(session, reinterpret_cast<const char *>(&i), sizeof(i));
+    // Client acknowledges with its own (input) datagrams
+    if (i % 10 == 0) {
+      client_.Send(session, reinterpret_cast<const char *>(&i), sizeof(i));
+    }
+  }
+  this_thread::sleep_for(milliseconds(20));
+
+  lock_guard<std::mutex> lock(mutex);
+  ASSERT_GT(received.size(), kUpdates / 2u);
+  // Time between consecutive states seen by client; each lost datagram
+  // costs one interval instead of a retransmission timeout
+  vector<microseconds> gaps;
+  vector<int> skipped;
+  for (size_t i = 1; i < received.size(); ++i) {
+    gaps.push_back(duration_cast<microseconds>(received[i] - received[i - 1]));
+    skipped.push_back(indices[i] - indices[i - 1]);
+  }
+  sort(gaps.begin(), gaps.end());
+  sort(skipped.begin(), skipped.end());
+  microseconds p50 = gaps[gaps.size() / 2], p99 = gaps[gaps.size() * 99 / 100];
+  cout << "20% loss, " << kInterval.count() << " us interval: received " << received.size()
+       << "/" << kUpdates << ", gap p50 " << p50.count() << " us, p99 " << p99.count()
+       << " us, max " << gaps.back().count() << " us, dropped " << server_.dropped() << endl;
+  // Four losses in a row happen with probability 0.0016, so 99% of
+  // states follow the previous one within four updates
+  ASSERT_LE(skipped[skipped.size() * 99 / 100], 4);
+  // Wall clock adds scheduling noise; the bound only rules out anything
+  // like a retransmission timeout
+  ASSERT_LT(p99, kInterval * 100);
+  ASSERT_GT(acked.load(), 0);
+  ASSERT_GT(server_.rtt(session), SequenceState::Clock::duration::zero());
+}
@@ -0,0 +1,39 @@
+#ifndef YOBAHACK_TESTS_UNRELIABLECHANNELTEST_H_
+#define YOBAHACK_TESTS_UNRELIABLECHANNELTEST_H_
+
+#include <thread>
+#include <memory>
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include "common/unreliablechannel.h"
+
+class UnreliableChannelTest : public testing::Test {
+ public:
+  UnreliableChannelTest() : work_(new boost::asio::io_service::work(io_service_)),
+                            server_(io_service_), client_(io_service_) {
+    thread_ = std::thread([this]() { io_service_.run(); });
+  }
+
+  ~UnreliableChannelTest() {
+    server_.Close();
+    client_.Close();
+    work_.reset();
+    thread_.join();
+  }
+
+ protected:
+  /** Opens both channels on loopback; handlers should be set by now */
+  void Open() {
+    boost::asio::ip::address loopback = boost::asio::ip::address_v4::loopback();
+    server_.Open(UnreliableChannel::Protocol::endpoint(loopback, 0));
+    client_.Open(UnreliableChannel::Protocol::endpoint(loopback, 0));
+  }
+
+  boost::asio::io_service io_service_;
+  std::unique_ptr<boost::asio::io_service::work> work_;
+  UnreliableChannel server_;
+  UnreliableChannel client_;
+  std::thread thread_;
+};
+
+#endif // YOBAHACK_TESTS_UNRELIABLECHANNELTEST_H_